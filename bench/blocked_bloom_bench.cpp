@@ -0,0 +1,88 @@
+/*
+ * Compares blocked_bloom_filter with scalable_bloom_filter: inserts and
+ * lookups per second, the memory, and the false positive rate measured
+ * on as many urls never inserted (next to the rate each filter estimates
+ * for itself). The filters are sized for the urls inserted.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude bench/blocked_bloom_bench.cpp -o blocked_bloom_bench -pthread
+ *   ./blocked_bloom_bench [urls]
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+
+#include <filter.h>
+
+namespace {
+
+	typedef std::chrono::steady_clock clock_type;
+
+	/* host/path urls, about 1000 urls a host */
+	std::vector<std::string> make_urls(size_t count, const char* prefix) {
+		std::vector<std::string> urls;
+		urls.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			urls.push_back(
+				"www.host" + std::to_string(i / 1000) + ".com/" + prefix + "/page-" + std::to_string(i) + ".html"
+			);
+		}
+		return urls;
+	}
+
+	double mops(size_t count, clock_type::duration spent) {
+		return count / std::chrono::duration<double>(spent).count() / 1e6;
+	}
+
+	template <typename _Filter>
+	void run(const char* name, _Filter& filter, const std::vector<std::string>& seen, const std::vector<std::string>& unseen) {
+		auto start = clock_type::now();
+		for (const auto& each : seen) { filter.insert(each); }
+		auto inserted = clock_type::now() - start;
+
+		size_t hits = 0;
+		start = clock_type::now();
+		for (const auto& each : seen) { hits += filter.contains(each) ? 1 : 0; }
+		auto found = clock_type::now() - start;
+
+		size_t false_positives = 0;
+		start = clock_type::now();
+		for (const auto& each : unseen) { false_positives += filter.contains(each) ? 1 : 0; }
+		auto missed = clock_type::now() - start;
+
+		std::cout << name
+		          << "\tinsert " << mops(seen.size(), inserted) << " M/s"
+		          << ", hit " << mops(seen.size(), found) << " M/s"
+		          << ", miss " << mops(unseen.size(), missed) << " M/s"
+		          << ", " << filter.memory() / double(1 << 20) << " MB"
+		          << ", fp " << 100.0 * false_positives / unseen.size() << "%"
+		          << " (estimated " << 100.0 * filter.false_positive_rate() << "%)"
+		          << (hits == seen.size() ? "" : ", LOST URLS") << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	const size_t count = 1 < argc ? std::strtoul(argv[1], nullptr, 10) : 1000000u;
+
+	const auto seen   = make_urls(count, "seen");
+	const auto unseen = make_urls(count, "unseen");
+
+	const auto& cpu = tools::simd::detect_cpu();
+	std::cout << count << " urls, blocked inserts with " << (cpu.avx2 ? "avx2" : cpu.sse2 ? "sse2" : "scalar") << std::endl;
+
+	for (double rate : { 0.01, 0.001, 0.0001 }) {
+		crawler::scalable_bloom_filter filter(count, rate);
+		std::string name = "scalable p=" + std::to_string(rate).substr(0, 6);
+		run(name.c_str(), filter, seen, unseen);
+	}
+
+	for (size_t bits : { 8u, 12u, 16u, 24u }) {
+		crawler::blocked_bloom_filter filter(count, bits);
+		std::string name = "blocked " + std::to_string(bits) + " bits";
+		run(name.c_str(), filter, seen, unseen);
+	}
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Counts the calls to the global operator new while one producer and one
+ * consumer pass 2M messages through a queue of 256, after 200k to warm
+ * the pools up, and times them. The messages made with new and queued in
+ * a std::deque (as before the block pools) are the baseline, the pooled
+ * ones (make_message, the pooled deque or the ring) must not allocate
+ * per message: a few allocations are the pools' lists of batches growing.
+ * Made from a string, an url_message also interns its host and copies
+ * its path, which takes an arena block once in a while.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude bench/message_alloc_bench.cpp -o message_alloc_bench -pthread
+ *   ./message_alloc_bench
+ *
+ * Exits with 1 if a pooled run allocates more than max_allocations.
+ */
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+#include <message_queue.h>
+#include <messages.h>
+
+namespace {
+
+	std::atomic<size_t> allocations(0);
+}
+
+void* operator new(size_t bytes) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* result = std::malloc(0 == bytes ? 1 : bytes)) { return result; }
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+	static const size_t max_allocations = 16u;
+
+	typedef tools::msg_ptr<crawler::crawler_msg_catagory> pointer;
+
+	typedef tools::bounded_blocking_queue<pointer, std::deque<pointer>> plain_queue;
+	typedef tools::bounded_blocking_queue<pointer, std::deque<pointer, tools::pool_allocator<pointer>>> pooled_queue;
+	typedef tools::bounded_blocking_queue<pointer, tools::mpmc_ring<pointer>> ring_queue;
+
+	/* @ret  the heap allocations once warmed up */
+	template <typename _Queue, typename _Make>
+	size_t run(const char* name, _Make make) {
+		static const size_t warm_up  = 200000u;
+		static const size_t messages = 2000000u;
+
+		_Queue queue(256);
+
+		std::thread consumer([&queue]() {
+			for (size_t i = 0; i < warm_up + messages; ++i) {
+				auto msg = queue.wait_and_pop();
+				if (crawler::crawler_msg_catagory::URL == msg->catagory()) {
+					(void)static_cast<crawler::url_message*>(msg.get())->depth();
+				}
+			}
+		});
+
+		size_t before = 0;
+		auto   start  = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < warm_up + messages; ++i) {
+			if (warm_up == i) {
+				before = allocations.load();
+				start  = std::chrono::steady_clock::now();
+			}
+			make(queue, i);
+		}
+		consumer.join();
+
+		size_t count = allocations.load() - before;
+		double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		std::printf("%-48s %8zu allocs, %.4f/msg %6.0f ns/msg\n", name, count, double(count) / messages, nanos / messages);
+		return count;
+	}
+}
+
+int main() {
+	using namespace crawler;
+
+	compact_url location("www.runoob.com/html/html-tutorial.html");
+
+	run<plain_queue>("new url_message, std::deque", [&location](plain_queue& queue, size_t) {
+		queue.wait_and_push(pointer(new url_message(location)));
+	});
+
+	size_t pooled = 0;
+	auto   check  = [&pooled](size_t count) { pooled = std::max(pooled, count); };
+
+	check(run<pooled_queue>("make_message<url_message>, pooled deque", [&location](pooled_queue& queue, size_t) {
+		queue.wait_and_push(tools::make_message<url_message>(location));
+	}));
+
+	check(run<ring_queue>("make_message<url_message>, mpmc_ring", [&location](ring_queue& queue, size_t) {
+		queue.wait_and_push(tools::make_message<url_message>(location));
+	}));
+
+	check(run<pooled_queue>("make_message<stop_signal>, pooled deque", [](pooled_queue& queue, size_t) {
+		queue.wait_and_push(tools::make_message<stop_signal>());
+	}));
+
+	auto resp = std::make_shared<http_response>("www.runoob.com/html/html-tutorial.html");
+	resp->seal();
+	check(run<pooled_queue>("make_message<http_resp_message>, pooled deque", [&resp](pooled_queue& queue, size_t) {
+		queue.wait_and_push(tools::make_message<http_resp_message>(resp));
+	}));
+
+	/* the host is interned and the path copied to an arena, a 1 MB block now and then, not checked */
+	std::string url = "www.runoob.com/html/page-000000.html";
+	run<pooled_queue>("make_message<url_message> from a string", [&url](pooled_queue& queue, size_t i) {
+		url[30] = static_cast<char>('0' + i % 10);
+		queue.wait_and_push(tools::make_message<url_message>(url));
+	});
+
+	std::printf("chunks taken: 64 B blocks %zu, 512 B blocks %zu\n", tools::block_pool<64>::chunks(), tools::block_pool<512>::chunks());
+
+	return pooled <= max_allocations ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+/*
+ * Moves shared_ptrs through bounded_blocking_queue, with the std::deque
+ * and mutex backend and with the mpmc_ring backend, for N producers and
+ * N consumers, then for one producer and N consumers. The sum of the
+ * values popped is checked, so a lost or doubled item fails the run.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude bench/mpmc_ring_bench.cpp -o mpmc_ring_bench -pthread
+ *   ./mpmc_ring_bench [items] [threads]...
+ *
+ * items is 400000 and threads 1 2 4 8 16 by default. Contention only
+ * shows with as many cores as threads.
+ */
+
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+
+#include <bounded_blocking_queue.h>
+
+namespace {
+
+	typedef std::shared_ptr<long> item_ptr;
+
+	typedef tools::bounded_blocking_queue<item_ptr, std::deque<item_ptr>>       deque_queue;
+	typedef tools::bounded_blocking_queue<item_ptr, tools::mpmc_ring<item_ptr>> ring_queue;
+
+	const size_t capacity = 1024u;
+
+	/* @ret  millions of items moved per second, negative if items were lost */
+	template <typename _Queue>
+	double run(size_t producers, size_t consumers, size_t items) {
+		_Queue q(capacity);
+
+		const size_t per_producer = items / producers;
+		const long   total        = static_cast<long>(per_producer * producers);
+
+		std::atomic<long> taken(0), sum(0);
+		std::vector<std::thread> threads;
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < producers; ++i) {
+			threads.emplace_back([&q, per_producer]() {
+				for (size_t k = 0; k < per_producer; ++k) { q.wait_and_push(std::make_shared<long>(static_cast<long>(k))); }
+			});
+		}
+		for (size_t i = 0; i < consumers; ++i) {
+			threads.emplace_back([&q, &taken, &sum, total]() {
+				long local = 0;
+				while (taken.fetch_add(1) < total) { local += *q.wait_and_pop(); }
+				sum += local;
+			});
+		}
+		for (auto& each : threads) { each.join(); }
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		const long expected = static_cast<long>(producers) * static_cast<long>(per_producer * (per_producer - 1) / 2);
+		if (expected != sum.load()) { return -1.0; }
+
+		return total / seconds / 1e6;
+	}
+
+	bool report(const char* name, size_t producers, size_t consumers, size_t items) {
+		double a = run<deque_queue>(producers, consumers, items);
+		double b = run<ring_queue>(producers, consumers, items);
+
+		std::cout << name << " " << producers << "/" << consumers << ": deque+mutex " << a
+		          << " Mops/s, mpmc_ring " << b << " Mops/s";
+		if (0 < a && 0 < b) { std::cout << ", " << b / a << "x"; }
+		std::cout << std::endl;
+
+		if (a < 0 || b < 0) { std::cerr << "items lost or doubled" << std::endl; }
+		return 0 <= a && 0 <= b;
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t items = 1 < argc ? std::strtoul(argv[1], nullptr, 10) : 400000u;
+
+	std::vector<size_t> counts;
+	for (int i = 2; i < argc; ++i) { counts.push_back(std::max<size_t>(1u, std::strtoul(argv[i], nullptr, 10))); }
+	if (counts.empty()) { counts = { 1, 2, 4, 8, 16 }; }
+
+	std::cout << "cores: " << std::thread::hardware_concurrency() << ", capacity " << capacity
+	          << ", " << items << " items" << std::endl;
+
+	bool good = true;
+	for (auto n : counts) { good = report("producers/consumers", n, n, items) && good; }
+	for (auto n : counts) {
+		if (1 < n) { good = report("producers/consumers", 1, n, items) && good; }
+	}
+
+	return good ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+/*
+ * Times response_resovler (the regex extractor) against link_resovler on
+ * the same page, a synthetic one or a file given with its url.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude bench/resovler_bench.cpp -o resovler_bench -lboost_regex -pthread
+ *   ./resovler_bench [page base]
+ */
+
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <resovler.h>
+
+namespace {
+
+	std::string make_page() {
+		std::string page = "<html><body>\n";
+
+		for (size_t i = 0; i < 400; ++i) {
+			const std::string n = std::to_string(i);
+			page += "<div class=\"x\"><p>some text here for padding the page " + n + "</p>";
+
+			switch (i % 5) {
+			case 0: page += "<a href=\"/css/css" + n + ".html\" title=\"t\">x</a>"; break;
+			case 1: page += "<a target=\"_blank\" href=\"//www.runoob.com/js/\">x</a>"; break;
+			case 2: page += "<a href=\"https://www.w3cschool.cn/p" + n + "\">x</a>"; break;
+			case 3: page += "<a href='/'>home</a>"; break;
+			case 4: page += "<a href=\"javascript:void(0)\">j</a><a class=\"c\" href=\"/rel/page.html\">r</a>"; break;
+			}
+
+			page += "</div>\n";
+		}
+
+		return page + "</body></html>";
+	}
+
+	/*
+	 * @param links  the links found, the empty results the regex gives for
+	 *               some links it can not resolve are not counted.
+	 * @ret          seconds per page
+	 */
+	double time_of(tools::string_resovler& resovler, const std::string& page, const std::string& base, size_t& links) {
+		using clock_type = std::chrono::steady_clock;
+
+		size_t rounds = 0;
+		resovler.resovle(page, base, [&links](std::string_view, size_t, const std::string& link) {
+			if (!link.empty()) { ++links; }
+		});
+
+		auto start = clock_type::now();
+		auto spent = clock_type::duration::zero();
+
+		/* at least a second, at least 3 rounds */
+		while (rounds < 3 || spent < std::chrono::seconds(1)) {
+			resovler.resovle(page, base, [](std::string_view, size_t, const std::string&) { });
+			++rounds;
+			spent = clock_type::now() - start;
+		}
+
+		return std::chrono::duration<double>(spent).count() / rounds;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::string page = make_page();
+	std::string base = "www.runoob.com/html/html-tutorial.html";
+
+	if (3 <= argc) {
+		std::ifstream in(argv[1], std::ios::binary);
+		std::stringstream text;
+		text << in.rdbuf();
+		page = text.str();
+		base = argv[2];
+	}
+
+	crawler::response_resovler regex;
+	crawler::link_resovler     links;
+
+	size_t regex_links = 0, found_links = 0;
+	double regex_time = time_of(regex, page, base, regex_links);
+	double links_time = time_of(links, page, base, found_links);
+
+	const double mb = page.size() / double(1 << 20);
+
+	std::cout << "page: " << page.size() << " bytes" << std::endl;
+	std::cout << "response_resovler: " << regex_links << " links, " << regex_time * 1e3 << " ms/page, "
+	          << mb / regex_time << " MB/s" << std::endl;
+	std::cout << "link_resovler:     " << found_links << " links, " << links_time * 1e3 << " ms/page, "
+	          << mb / links_time << " MB/s" << std::endl;
+	std::cout << "speedup: " << regex_time / links_time << "x" << std::endl;
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Times the tag prefilter of link_resovler, scan_tags_scalar,
+ * scan_tags_sse2 and scan_tags_avx2, on html-like text (a '<' every 40
+ * bytes or so, an anchor every 400) and on text with a tag every 8 bytes.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude bench/simd_scan_bench.cpp -o simd_scan_bench
+ *   ./simd_scan_bench
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <simd_scan.h>
+
+namespace {
+
+	std::string make_text(size_t bytes, size_t tag_every, size_t anchor_every) {
+		std::mt19937 rng(7);
+		std::string  text(bytes, ' ');
+
+		for (size_t i = 0; i < bytes; ++i) { text[i] = static_cast<char>('b' + rng() % 20); }
+		for (size_t i = 0; i + 1 < bytes; i += tag_every) { text[i] = '<'; text[i + 1] = 'p'; }
+		for (size_t i = anchor_every / 2; i + 1 < bytes; i += anchor_every) { text[i] = '<'; text[i + 1] = 'a'; }
+
+		return text;
+	}
+
+	/* @ret  MB/s, the candidates are taken 32 at a time as link_resovler does */
+	double throughput(tools::simd::scan_tags_fn fn, const std::string& text, size_t& found) {
+		using clock_type = std::chrono::steady_clock;
+
+		const char* candidates[32];
+		size_t      rounds = 0;
+		auto        start  = clock_type::now();
+		auto        spent  = clock_type::duration::zero();
+
+		while (spent < std::chrono::milliseconds(500)) {
+			const char* itr  = text.data();
+			const char* last = itr + text.size();
+			found = 0;
+
+			while (itr < last) {
+				size_t count = fn(itr, last, candidates, 32);
+				found += count;
+				if (count < 32) { break; }
+				itr = candidates[count - 1] + 1;
+			}
+
+			++rounds;
+			spent = clock_type::now() - start;
+		}
+
+		return text.size() * double(rounds) / (1 << 20) / std::chrono::duration<double>(spent).count();
+	}
+
+	void run(const char* name, const std::string& text) {
+		using namespace tools::simd;
+
+		std::cout << name << " (" << text.size() / 1024 << " KB)" << std::endl;
+
+		size_t found = 0;
+		double scalar = throughput(&scan_tags_scalar, text, found);
+		std::cout << "  scalar: " << scalar << " MB/s, " << found << " candidates" << std::endl;
+
+#ifdef _CRAWLER_SIMD_X86_
+		if (detect_cpu().sse2) {
+			double mbs = throughput(&scan_tags_sse2, text, found);
+			std::cout << "  sse2:   " << mbs << " MB/s, " << found << " candidates, " << mbs / scalar << "x" << std::endl;
+		}
+		if (detect_cpu().avx2) {
+			double mbs = throughput(&scan_tags_avx2, text, found);
+			std::cout << "  avx2:   " << mbs << " MB/s, " << found << " candidates, " << mbs / scalar << "x" << std::endl;
+		}
+#endif
+	}
+}
+
+int main() {
+	run("html-like", make_text(1u << 20, 40, 400));
+	run("tag-dense", make_text(1u << 20, 8, 64));
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <csr_graph.h>
+#include <debug.h>
+
+/*
+ * graph_convert <url.txt> <graph.csr>   converts the output of a crawl once,
+ * graph_convert --info <graph.csr>      maps it and tells its size and the
+ *                                       urls linked to most.
+ */
+int main(int argc, char** argv) {
+
+	if (3 != argc) {
+		CRAWLER_LOG(
+			tools::debug_type::FATAL, "main", "Usage: graph_convert <url.txt> <graph.csr> | --info <graph.csr>"
+		);
+		return -1;
+	}
+
+	if (std::string("--info") != argv[1]) {
+		auto start = std::chrono::steady_clock::now();
+
+		if (!crawler::csr_graph::convert(argv[1], argv[2])) { return -2; }
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start
+		).count();
+		CRAWLER_LOG(tools::debug_type::INFO, "main", "Converted ", argv[1], " in ", elapsed, " ms.");
+		return 0;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	auto graph = crawler::csr_graph::open(argv[2]);
+	if (nullptr == graph) { return -2; }
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start
+	).count();
+
+	CRAWLER_LOG(
+		tools::debug_type::INFO, "main", 
+		"Urls: ", graph->nodes(), ", links: ", graph->edges(), ", opened in ", elapsed, " us."
+	);
+
+	std::vector<uint32_t> ids(graph->nodes());
+	for (uint32_t i = 0; i < ids.size(); ++i) { ids[i] = i; }
+
+	const size_t top = std::min<size_t>(10u, ids.size());
+	std::partial_sort(ids.begin(), ids.begin() + top, ids.end(), [&graph](uint32_t a, uint32_t b) {
+		return graph->in(a).size() > graph->in(b).size();
+	});
+
+	for (size_t i = 0; i < top; ++i) {
+		CRAWLER_LOG(
+			tools::debug_type::INFO, "main", 
+			graph->in(ids[i]).size(), " in, ", graph->out(ids[i]).size(), " out: ", graph->url(ids[i])
+		);
+	}
+
+	return 0;
+}
@@ -11,6 +11,8 @@
 #include <chrono>
 #include <condition_variable>
 
+#include <mpmc_ring.h>
+
 namespace tools {
 
 	/*
@@ -67,6 +69,74 @@ namespace tools {
 			return ptr;
 		}
 
+		/*
+		 * @note  pushes [first, last) in order, waits whenever the queue is
+		 *        full and takes the lock once for every run of free slots.
+		 */
+		template <typename _InputItr>
+		void push_bulk(_InputItr first, _InputItr last) {
+			std::unique_lock<std::mutex> locker(m_mutex);
+			while (first != last) {
+				m_full.wait(locker, [this]() { return !this->_full(); });
+				this->_notify(m_empty, this->_push_some(first, last));
+			}
+		}
+
+		/*
+		 * @ret  the number of items pushed before the time ran out, the
+		 *       rest of the range is left untouched.
+		 */
+		template <typename _InputItr, typename _Rep, typename _Period>
+		size_t push_bulk_for(
+			_InputItr                                 first, 
+			_InputItr                                 last, 
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			const auto deadline = std::chrono::steady_clock::now() + time;
+			size_t count = 0;
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+			while (first != last) {
+				if (!m_full.wait_until(locker, deadline, [this]() { return !this->_full(); })) {
+					break;
+				}
+				size_t pushed = this->_push_some(first, last);
+				this->_notify(m_empty, pushed);
+				count += pushed;
+			}
+
+			return count;
+		}
+
+		/*
+		 * @param out   receives the items.
+		 * @param max   the max number of items to pop.
+		 * @param time  how long to wait for the first item.
+		 * @ret         the number of items popped, 0 on timeout.
+		 */
+		template <typename _OutputItr, typename _Rep, typename _Period>
+		size_t pop_bulk(
+			_OutputItr                                  out, 
+			size_t                                      max, 
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			std::unique_lock<std::mutex> locker(m_mutex);
+			if (!m_empty.wait_for(locker, time, [this]() { return !this->_empty(); })) {
+				return 0;
+			}
+
+			size_t count = 0;
+			while (count < max && !this->_empty()) {
+				*out = std::move(m_container.front());
+				++out;
+				m_container.pop_front();
+				++count;
+			}
+			this->_notify(m_full, count);
+
+			return count;
+		}
+
 		bool try_push(const value_type& item) {
 			std::lock_guard<std::mutex> locker(m_mutex);
 			if (this->_full()) { return false; }
@@ -113,7 +183,27 @@ namespace tools {
 			return ptr;
 		}
 
+		/* the number of items, it may have changed once it is returned */
+		size_type size() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_container.size();
+		}
+
 	private:
+		template <typename _InputItr>
+		size_t _push_some(_InputItr& first, _InputItr last) {
+			size_t count = 0;
+			for (; first != last && !this->_full(); ++first, ++count) {
+				m_container.push_back(*first);
+			}
+			return count;
+		}
+
+		static void _notify(std::condition_variable& cond, size_t count) {
+			if (1 < count) { cond.notify_all(); }
+			else if (1 == count) { cond.notify_one(); }
+		}
+
 		bool _empty() const { return m_container.empty(); }
 		bool _full() const { return m_capacity <= m_container.size(); }
 
@@ -182,7 +272,7 @@ namespace tools {
 		bool wait_and_push_for(raw_ptr p, const std::chrono::duration<_Rep, _Period>& time) {
 			std::unique_lock<std::mutex> locker(m_mutex);
 			bool not_full =
-				m_empty.wait_for(locker, time, [this]() { return !this->_full(); });
+				m_full.wait_for(locker, time, [this]() { return !this->_full(); });
 
 			if (not_full) {
 				m_container.push_back(smart_ptr(p));
@@ -196,7 +286,7 @@ namespace tools {
 		bool wait_and_push_for(pointer&& item, const std::chrono::duration<_Rep, _Period>& time) {
 			std::unique_lock<std::mutex> locker(m_mutex);
 			bool not_full =
-				m_empty.wait_for(locker, time, [this]() { return !this->_full(); });
+				m_full.wait_for(locker, time, [this]() { return !this->_full(); });
 
 			if (not_full) {
 				m_container.push_back(std::move(item));
@@ -237,6 +327,74 @@ namespace tools {
 			return pointer();
 		}
 
+		/*
+		 * @note  moves [first, last) in order (pointers or raw pointers), waits whenever the queue is
+		 *        full and takes the lock once for every run of free slots.
+		 */
+		template <typename _InputItr>
+		void push_bulk(_InputItr first, _InputItr last) {
+			std::unique_lock<std::mutex> locker(m_mutex);
+			while (first != last) {
+				m_full.wait(locker, [this]() { return !this->_full(); });
+				this->_notify(m_empty, this->_push_some(first, last));
+			}
+		}
+
+		/*
+		 * @ret  the number of items pushed before the time ran out, the
+		 *       rest of the range is left untouched.
+		 */
+		template <typename _InputItr, typename _Rep, typename _Period>
+		size_t push_bulk_for(
+			_InputItr                                 first, 
+			_InputItr                                 last, 
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			const auto deadline = std::chrono::steady_clock::now() + time;
+			size_t count = 0;
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+			while (first != last) {
+				if (!m_full.wait_until(locker, deadline, [this]() { return !this->_full(); })) {
+					break;
+				}
+				size_t pushed = this->_push_some(first, last);
+				this->_notify(m_empty, pushed);
+				count += pushed;
+			}
+
+			return count;
+		}
+
+		/*
+		 * @param out   receives the pointers.
+		 * @param max   the max number of items to pop.
+		 * @param time  how long to wait for the first item.
+		 * @ret         the number of items popped, 0 on timeout.
+		 */
+		template <typename _OutputItr, typename _Rep, typename _Period>
+		size_t pop_bulk(
+			_OutputItr                                  out, 
+			size_t                                      max, 
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			std::unique_lock<std::mutex> locker(m_mutex);
+			if (!m_empty.wait_for(locker, time, [this]() { return !this->_empty(); })) {
+				return 0;
+			}
+
+			size_t count = 0;
+			while (count < max && !this->_empty()) {
+				*out = std::move(m_container.front());
+				++out;
+				m_container.pop_front();
+				++count;
+			}
+			this->_notify(m_full, count);
+
+			return count;
+		}
+
 		bool try_push(pointer&& item) {
 			std::lock_guard<std::mutex> locker(m_mutex);
 			if (this->_full()) { return false; }
@@ -291,6 +449,12 @@ namespace tools {
 			return std::make_shared<value_type>(*m_container.back());
 		}
 
+		/* the number of items, it may have changed once it is returned */
+		size_type size() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_container.size();
+		}
+
 		void clear() {
 			std::lock_guard<std::mutex> locker(m_mutex);
 			m_container.clear();
@@ -298,6 +462,20 @@ namespace tools {
 		}
 
 	private:
+		template <typename _InputItr>
+		size_t _push_some(_InputItr& first, _InputItr last) {
+			size_t count = 0;
+			for (; first != last && !this->_full(); ++first, ++count) {
+				m_container.push_back(pointer(std::move(*first)));
+			}
+			return count;
+		}
+
+		static void _notify(std::condition_variable& cond, size_t count) {
+			if (1 < count) { cond.notify_all(); }
+			else if (1 == count) { cond.notify_one(); }
+		}
+
 		bool _empty() const { return m_container.empty(); }
 		bool _full() const { return m_capacity <= m_container.size(); }
 
@@ -312,6 +490,213 @@ namespace tools {
 		const size_type         m_capacity;
 		container_type          m_container;
 	};
+
+	/*
+	 * Lock-free backend for smart_ptr type, selected with
+	 * bounded_blocking_queue<std::shared_ptr<_Tp>, mpmc_ring<std::shared_ptr<_Tp>>>.
+	 * Pushing and popping never take a lock, blocking calls spin, yield and
+	 * then park (backoff_waiter). The capacity is rounded up to a power of
+	 * two.
+	 */
+	template <typename _Tp>
+	class bounded_blocking_queue<std::shared_ptr<_Tp>, mpmc_ring<std::shared_ptr<_Tp>>> {
+
+		typedef mpmc_ring<std::shared_ptr<_Tp>>                   container_type;
+		typedef std::shared_ptr<_Tp>                              smart_ptr;
+		typedef bounded_blocking_queue<smart_ptr, container_type> self_type;
+		typedef typename container_type::size_type                size_type;
+
+		typedef _Tp* raw_ptr;
+
+	public:
+		typedef _Tp                        value_type;
+		typedef _Tp&                       reference;
+		typedef const _Tp&                 const_reference;
+		typedef std::shared_ptr<_Tp>       pointer;
+		typedef const std::shared_ptr<_Tp> const_pointer;
+
+	public:
+		bounded_blocking_queue() : m_container(default_capacity) { }
+		explicit bounded_blocking_queue(size_type capacity) : m_container(capacity) { }
+
+		~bounded_blocking_queue() { clear(); }
+
+		/* uncopyable */
+		bounded_blocking_queue(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		void wait_and_push(pointer&& item) {
+			m_full.wait([this, &item]() { return m_container.try_push(std::move(item)); });
+			m_empty.notify_one();
+		}
+
+		void wait_and_push(raw_ptr p) {
+			this->wait_and_push(smart_ptr(p));
+		}
+
+		template <typename _Rep, typename _Period>
+		bool wait_and_push_for(raw_ptr p, const std::chrono::duration<_Rep, _Period>& time) {
+			return this->wait_and_push_for(smart_ptr(p), time);
+		}
+
+		template <typename _Rep, typename _Period>
+		bool wait_and_push_for(pointer&& item, const std::chrono::duration<_Rep, _Period>& time) {
+			bool not_full = m_full.wait_until(
+				[this, &item]() { return m_container.try_push(std::move(item)); },
+				std::chrono::steady_clock::now() + time
+			);
+
+			if (not_full) { m_empty.notify_one(); }
+
+			return not_full;
+		}
+
+		void wait_and_pop(value_type& out) {
+			out = *this->wait_and_pop();
+		}
+
+		pointer wait_and_pop() {
+			pointer ptr;
+			m_empty.wait([this, &ptr]() { return m_container.try_pop(ptr); });
+			m_full.notify_one();
+			return ptr;
+		}
+
+		template <typename _Rep, typename _Period>
+		pointer wait_and_pop_for(const std::chrono::duration<_Rep, _Period>& time) {
+			pointer ptr;
+			bool not_empty = m_empty.wait_until(
+				[this, &ptr]() { return m_container.try_pop(ptr); },
+				std::chrono::steady_clock::now() + time
+			);
+
+			if (not_empty) { m_full.notify_one(); }
+
+			return ptr;
+		}
+
+		/*
+		 * @note  moves [first, last) in order (pointers or raw pointers),
+		 *        consumers are woken once per run instead of once per item.
+		 */
+		template <typename _InputItr>
+		void push_bulk(_InputItr first, _InputItr last) {
+			this->push_bulk_for(first, last, std::chrono::steady_clock::duration::max());
+		}
+
+		/*
+		 * @ret  the number of items pushed before the time ran out, the
+		 *       rest of the range is left untouched.
+		 */
+		template <typename _InputItr, typename _Rep, typename _Period>
+		size_t push_bulk_for(
+			_InputItr                                   first, 
+			_InputItr                                   last, 
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			const auto deadline = _deadline(time);
+			size_t count = 0;
+
+			for (; first != last; ++first, ++count) {
+				/* the item is only moved from when it is pushed */
+				if (m_container.try_push(std::move(*first))) { continue; }
+
+				/* full, wake the consumers before waiting for them */
+				m_empty.notify_all();
+				bool not_full = m_full.wait_until(
+					[this, &first]() { return m_container.try_push(std::move(*first)); }, deadline
+				);
+				if (!not_full) { break; }
+			}
+
+			m_empty.notify_all();
+			return count;
+		}
+
+		/*
+		 * @param out   receives the pointers.
+		 * @param max   the max number of items to pop.
+		 * @param time  how long to wait for the first item.
+		 * @ret         the number of items popped, 0 on timeout.
+		 */
+		template <typename _OutputItr, typename _Rep, typename _Period>
+		size_t pop_bulk(
+			_OutputItr                                  out, 
+			size_t                                      max, 
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			if (0 == max) { return 0; }
+
+			pointer ptr;
+			bool not_empty = m_empty.wait_until(
+				[this, &ptr]() { return m_container.try_pop(ptr); }, _deadline(time)
+			);
+			if (!not_empty) { return 0; }
+
+			size_t count = 0;
+			do {
+				*out = std::move(ptr);
+				++out;
+				++count;
+			} while (count < max && m_container.try_pop(ptr));
+
+			m_full.notify_all();
+			return count;
+		}
+
+		bool try_push(pointer&& item) {
+			if (!m_container.try_push(std::move(item))) { return false; }
+			m_empty.notify_one();
+			return true;
+		}
+
+		bool try_push(raw_ptr p) {
+			return this->try_push(smart_ptr(p));
+		}
+
+		bool try_pop(value_type& out) {
+			auto ptr = this->try_pop();
+			if (nullptr == ptr) { return false; }
+			out = *ptr;
+			return true;
+		}
+
+		pointer try_pop() {
+			pointer ptr;
+			if (!m_container.try_pop(ptr)) { return pointer(nullptr); }
+			m_full.notify_one();
+			return ptr;
+		}
+
+		void clear() {
+			pointer ignored;
+			while (m_container.try_pop(ignored)) { }
+			m_full.notify_all();
+		}
+
+		/* the number of items, it may have changed once it is returned */
+		size_type size() const { return m_container.size(); }
+
+	private:
+		template <typename _Rep, typename _Period>
+		static std::chrono::steady_clock::time_point _deadline(
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			const auto now = std::chrono::steady_clock::now();
+			/* saturate instead of overflowing for "wait forever" */
+			if (std::chrono::steady_clock::time_point::max() - now < time) {
+				return std::chrono::steady_clock::time_point::max();
+			}
+			return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(time);
+		}
+
+	private:
+		static const size_type default_capacity = 1024u;
+
+		backoff_waiter m_full;
+		backoff_waiter m_empty;
+		container_type m_container;
+	};
 }
 
 #endif
\ No newline at end of file
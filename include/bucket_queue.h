@@ -0,0 +1,325 @@
+#ifndef _CRAWLER_BUCKET_QUEUE_H_
+#define _CRAWLER_BUCKET_QUEUE_H_
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace tools {
+
+	/*
+	 * A thread-safe queue(bounded) which hands out the items of the highest
+	 * priority first, and items of one priority in the order they came.
+	 * The priorities are a small number of levels (up to 64), every level
+	 * is a fifo, so a push or a pop is O(1). The levels are split into
+	 * shards with a lock each, every push (or bulk push) goes to the next
+	 * shard, and a pop picks the shard with the highest level from a bit
+	 * mask per shard read without locking. With several threads the order
+	 * across shards is therefore approximate: an item may be passed by one
+	 * of the same level pushed later.
+	 *
+	 * It has the interface of bounded_blocking_queue used by the crawler.
+	 */
+	template <typename _Tp>
+	class bucket_queue {
+
+		typedef bucket_queue<_Tp> self_type;
+
+	public:
+		typedef _Tp                                      value_type;
+		typedef std::function<size_t(const value_type&)> ranker_type;
+
+		static const size_t max_levels     = 64u;
+		static const size_t default_shards = 4u;
+
+		/*
+		 * @param capacity  the max number of items.
+		 * @param levels    the number of priorities, at most max_levels.
+		 * @param rank      the priority of an item, 0 to levels - 1,
+		 *                  higher is popped first.
+		 * @param shards    the number of locks the levels are split by.
+		 */
+		bucket_queue(
+			size_t      capacity,
+			size_t      levels,
+			ranker_type rank,
+			size_t      shards = default_shards
+		) :
+			m_capacity(capacity),
+			m_levels(_clamp(levels, 1u, max_levels)),
+			m_rank(std::move(rank)),
+			m_shards(shards < 1u ? 1u : shards),
+			m_reserved(0),
+			m_size(0),
+			m_next_shard(0),
+			m_waiters(0)
+		{
+			for (auto& each : m_shards) { each.buckets.resize(m_levels); }
+		}
+
+		/* uncopyable */
+		bucket_queue(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		void wait_and_push(value_type&& item) {
+			while (0 == this->_reserve(1, std::chrono::steady_clock::time_point::max())) { }
+			this->_push(&item, &item + 1);
+		}
+
+		bool try_push(value_type&& item) {
+			if (0 == this->_try_reserve(1)) { return false; }
+			this->_push(&item, &item + 1);
+			return true;
+		}
+
+		/*
+		 * @note  takes one lock for every run of free slots.
+		 * @ret   the number of items moved in before the time ran out, the
+		 *        rest of the range is left untouched.
+		 */
+		template <typename _RandomItr, typename _Rep, typename _Period>
+		size_t push_bulk_for(
+			_RandomItr                                  first,
+			_RandomItr                                  last,
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			const auto deadline = std::chrono::steady_clock::now() + time;
+			size_t count = 0;
+
+			while (first != last) {
+				size_t wanted = static_cast<size_t>(last - first);
+				size_t slots  = this->_try_reserve(wanted);
+
+				if (0 == slots) { slots = this->_reserve(wanted, deadline); }
+				if (0 == slots) { break; }
+
+				this->_push(first, first + slots);
+				first += slots;
+				count += slots;
+			}
+
+			return count;
+		}
+
+		bool try_pop(value_type& out) {
+			if (0 == this->_pop(&out, 1)) { return false; }
+			this->_notify_waiters();
+			return true;
+		}
+
+		/*
+		 * @param out   receives the items, the highest priority first.
+		 * @param max   the max number of items to pop.
+		 * @param time  how long to wait for the first item.
+		 * @ret         the number of items popped, 0 on timeout.
+		 */
+		template <typename _OutputItr, typename _Rep, typename _Period>
+		size_t pop_bulk(
+			_OutputItr                                  out,
+			size_t                                      max,
+			const std::chrono::duration<_Rep, _Period>& time
+		) {
+			size_t count = this->_pop(out, max);
+
+			if (0 == count && 0 != max && this->_wait_not_empty(time)) {
+				count = this->_pop(out, max);
+			}
+
+			if (0 != count) { this->_notify_waiters(); }
+
+			return count;
+		}
+
+		void clear() {
+			value_type item;
+			while (0 != this->_pop(&item, 1)) { }
+			this->_notify_waiters();
+		}
+
+		size_t size() const { return m_size.load(); }
+		bool empty() const { return 0 == this->size(); }
+
+		size_t capacity() const { return m_capacity; }
+		size_t levels() const { return m_levels; }
+
+	private:
+		struct shard {
+			shard() : mask(0) { }
+
+			std::mutex                          mutex;
+			std::vector<std::deque<value_type>> buckets;
+			/* bit i is set while bucket i is not empty */
+			std::atomic<uint64_t>               mask;
+		};
+
+		static size_t _clamp(size_t value, size_t low, size_t high) {
+			return value < low ? low : (high < value ? high : value);
+		}
+
+		static size_t _top(uint64_t mask) {
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanReverse64(&index, mask);
+			return index;
+#else
+			return 63u - __builtin_clzll(mask);
+#endif
+		}
+
+		/*
+		 * @ret  the number of slots taken, up to wanted.
+		 */
+		size_t _try_reserve(size_t wanted) {
+			size_t reserved = m_reserved.load();
+			while (reserved < m_capacity) {
+				size_t slots = m_capacity - reserved < wanted ? m_capacity - reserved : wanted;
+				if (m_reserved.compare_exchange_weak(reserved, reserved + slots)) { return slots; }
+			}
+			return 0;
+		}
+
+		/*
+		 * @ret  0 if the queue was still full at deadline.
+		 */
+		size_t _reserve(size_t wanted, std::chrono::steady_clock::time_point deadline) {
+			size_t slots = 0;
+
+			std::unique_lock<std::mutex> locker(m_wait_mutex);
+			++m_waiters;
+			m_changed.wait_until(locker, deadline, [this, wanted, &slots]() {
+				slots = this->_try_reserve(wanted);
+				return 0 != slots;
+			});
+			--m_waiters;
+
+			return slots;
+		}
+
+		/*
+		 * @note  the slots have been reserved.
+		 */
+		template <typename _RandomItr>
+		void _push(_RandomItr first, _RandomItr last) {
+			auto& target = m_shards[m_next_shard.fetch_add(1, std::memory_order_relaxed) % m_shards.size()];
+			{
+				std::lock_guard<std::mutex> locker(target.mutex);
+
+				uint64_t mask = 0;
+				for (; first != last; ++first) {
+					size_t level = m_rank(*first);
+					if (m_levels <= level) { level = m_levels - 1; }
+
+					target.buckets[level].push_back(std::move(*first));
+					mask |= uint64_t(1) << level;
+					/* counted before it can be popped */
+					++m_size;
+				}
+				target.mask.fetch_or(mask, std::memory_order_release);
+			}
+
+			this->_notify_waiters();
+		}
+
+		/*
+		 * @note  takes the items of the shard with the highest level while
+		 *        they are not below the top level of the other shards.
+		 * @ret   the number of items popped, up to max.
+		 */
+		template <typename _OutputItr>
+		size_t _pop(_OutputItr out, size_t max) {
+			size_t count = 0;
+
+			while (count < max) {
+				shard* best = nullptr;
+				size_t best_level = 0;
+				size_t next_level = 0;
+
+				for (auto& each : m_shards) {
+					uint64_t mask = each.mask.load(std::memory_order_acquire);
+					if (0 == mask) { continue; }
+
+					size_t level = _top(mask);
+					if (nullptr == best || best_level < level) {
+						if (nullptr != best) { next_level = best_level; }
+						best = &each;
+						best_level = level;
+					}
+					else if (next_level < level) {
+						next_level = level;
+					}
+				}
+
+				if (nullptr == best) { break; }
+
+				std::lock_guard<std::mutex> locker(best->mutex);
+
+				uint64_t mask = best->mask.load(std::memory_order_relaxed);
+
+				while (count < max && 0 != mask && next_level <= _top(mask)) {
+					size_t level  = _top(mask);
+					auto&  bucket = best->buckets[level];
+
+					*out = std::move(bucket.front());
+					++out;
+					bucket.pop_front();
+					++count;
+
+					--m_size;
+					--m_reserved;
+
+					if (bucket.empty()) { mask &= ~(uint64_t(1) << level); }
+				}
+
+				best->mask.store(mask, std::memory_order_relaxed);
+			}
+
+			return count;
+		}
+
+		template <typename _Rep, typename _Period>
+		bool _wait_not_empty(const std::chrono::duration<_Rep, _Period>& time) {
+			std::unique_lock<std::mutex> locker(m_wait_mutex);
+			++m_waiters;
+			bool not_empty = m_changed.wait_for(locker, time, [this]() { return !this->empty(); });
+			--m_waiters;
+			return not_empty;
+		}
+
+		/*
+		 * @note  waiters for room and for items share one condition, they
+		 *        are all woken, which is fine for the few threads here. The
+		 *        wait mutex is taken so the change is not missed by a
+		 *        waiter between its check and its wait, and the counters
+		 *        are sequentially consistent so a waiter which registered
+		 *        too late to be seen has seen the change instead.
+		 */
+		void _notify_waiters() {
+			if (0 == m_waiters.load()) { return; }
+			std::lock_guard<std::mutex> locker(m_wait_mutex);
+			m_changed.notify_all();
+		}
+
+	private:
+		const size_t             m_capacity;
+		const size_t             m_levels;
+		const ranker_type        m_rank;
+
+		std::vector<shard>       m_shards;
+		/* slots taken by pushes, counted before the items are in */
+		std::atomic<size_t>      m_reserved;
+		std::atomic<size_t>      m_size;
+		std::atomic<size_t>      m_next_shard;
+
+		std::mutex               m_wait_mutex;
+		std::condition_variable  m_changed;
+		std::atomic<size_t>      m_waiters;
+	};
+}
+
+#endif
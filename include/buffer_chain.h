@@ -0,0 +1,158 @@
+#ifndef _CRAWLER_BUFFER_CHAIN_H_
+#define _CRAWLER_BUFFER_CHAIN_H_
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <string_view>
+
+namespace tools {
+
+	/*
+	 * A byte sequence kept in refcounted blocks. Readers write straight
+	 * into the free space of the tail block (prepare/commit), so bytes are
+	 * never copied from one buffer to another while the sequence grows.
+	 */
+	class buffer_chain {
+
+		typedef buffer_chain self_type;
+
+	public:
+		typedef std::shared_ptr<char[]>    block_ptr;
+		typedef std::pair<char*, size_t>   mutable_buffer;
+
+		static const size_t default_block_size = 16384u;
+
+		buffer_chain() : m_size(0) { }
+
+		buffer_chain(self_type&& other) noexcept :
+			m_blocks(std::move(other.m_blocks)), m_size(other.m_size) {
+			other.m_size = 0;
+		}
+
+		self_type& operator=(self_type&& other) noexcept {
+			if (this == &other) { return *this; }
+			m_blocks = std::move(other.m_blocks);
+			m_size = other.m_size;
+			other.m_size = 0;
+			return *this;
+		}
+
+		/* uncopyable */
+		buffer_chain(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @note  makes sure the tail block has at least n free bytes in a
+		 *        row, a new block of exactly n bytes is added otherwise.
+		 */
+		void reserve(size_t n) {
+			if (n <= this->_free()) { return; }
+			if (!m_blocks.empty() && 0 == m_blocks.back().size) { m_blocks.pop_back(); }
+			m_blocks.push_back({ block_ptr(new char[n]), 0, n });
+		}
+
+		/*
+		 * @param block_size  the capacity of the new block if the tail block
+		 *                    is full.
+		 * @ret               the free space at the end of the tail block.
+		 */
+		mutable_buffer prepare(size_t block_size = default_block_size) {
+			if (0 == this->_free()) { this->reserve(0 == block_size ? 1 : block_size); }
+			auto& tail = m_blocks.back();
+			return mutable_buffer(tail.data.get() + tail.size, tail.capacity - tail.size);
+		}
+
+		/*
+		 * @note  the first n bytes of the space returned by the last
+		 *        prepare() become part of the sequence.
+		 */
+		void commit(size_t n) {
+			m_blocks.back().size += n;
+			m_size += n;
+		}
+
+		void append(const char* data, size_t len) {
+			size_t block_size = default_block_size;
+			while (0 < len) {
+				auto space = this->prepare(len < block_size ? block_size : len);
+				size_t n = len < space.second ? len : space.second;
+				memcpy(space.first, data, n);
+				this->commit(n);
+				data += n;
+				len -= n;
+			}
+		}
+
+		/*
+		 * @note  merges the blocks into one, the sequence is copied once and
+		 *        the old blocks are released.
+		 */
+		void linearize() {
+			if (this->contiguous()) { return; }
+
+			block_ptr merged(new char[m_size]);
+			size_t offset = 0;
+			for (const auto& each : m_blocks) {
+				memcpy(merged.get() + offset, each.data.get(), each.size);
+				offset += each.size;
+			}
+
+			m_blocks.clear();
+			m_blocks.push_back({ std::move(merged), m_size, m_size });
+		}
+
+		bool contiguous() const {
+			size_t used = 0;
+			for (const auto& each : m_blocks) { used += 0 == each.size ? 0 : 1; }
+			return used <= 1;
+		}
+
+		/*
+		 * @note  the whole sequence, only valid when contiguous().
+		 */
+		std::string_view view() const {
+			for (const auto& each : m_blocks) {
+				if (0 != each.size) { return std::string_view(each.data.get(), each.size); }
+			}
+			return std::string_view();
+		}
+
+		/*
+		 * @note  calls fn(std::string_view) for every non-empty block.
+		 */
+		template <typename _Function>
+		void for_each(_Function&& fn) const {
+			for (const auto& each : m_blocks) {
+				if (0 != each.size) { fn(std::string_view(each.data.get(), each.size)); }
+			}
+		}
+
+		size_t size() const { return m_size; }
+		bool empty() const { return 0 == m_size; }
+		size_t blocks() const { return m_blocks.size(); }
+
+		void clear() {
+			m_blocks.clear();
+			m_size = 0;
+		}
+
+	private:
+		struct block {
+			block_ptr data;
+			size_t    size;
+			size_t    capacity;
+		};
+
+		size_t _free() const {
+			return m_blocks.empty() ? 0 : m_blocks.back().capacity - m_blocks.back().size;
+		}
+
+	private:
+		std::vector<block> m_blocks;
+		size_t             m_size;
+	};
+}
+
+#endif
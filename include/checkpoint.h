@@ -0,0 +1,446 @@
+#ifndef _CRAWLER_CHECKPOINT_H_
+#define _CRAWLER_CHECKPOINT_H_
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#include <filter.h>
+#include <frontier.h>
+#include <messages.h>
+#include <debug.h>
+
+namespace crawler {
+
+	/*
+	 * The urls taken from the frontier which are not done yet: waiting in
+	 * the seeds queue, scheduled, requested or being analyzed. An url is
+	 * done once its links are in the candidates queue, or it failed. A
+	 * checkpoint stores them with the frontier, so a crash loses no url
+	 * which was in flight. An url queued twice is held twice.
+	 */
+	class pending_urls {
+
+		typedef pending_urls self_type;
+
+	public:
+		pending_urls() : m_frozen(false) { }
+
+		/* uncopyable */
+		pending_urls(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		static uint64_t key(const url_message& msg) { return msg.location().fingerprint().low; }
+
+		void acquire(const url_message& msg) {
+			auto& target = this->_shard(key(msg));
+			std::lock_guard<std::mutex> locker(target.mutex);
+
+			auto result = target.urls.emplace(key(msg), entry());
+			if (result.second) {
+				result.first->second.url   = msg.url();
+				result.first->second.depth = msg.depth();
+			}
+			++result.first->second.holders;
+		}
+
+		/* one more holder of an url acquired */
+		void retain(uint64_t key) {
+			auto& target = this->_shard(key);
+			std::lock_guard<std::mutex> locker(target.mutex);
+
+			auto itr = target.urls.find(key);
+			if (target.urls.end() != itr) { ++itr->second.holders; }
+		}
+
+		void release(uint64_t key) {
+			if (m_frozen.load()) { return; }
+
+			auto& target = this->_shard(key);
+			std::lock_guard<std::mutex> locker(target.mutex);
+
+			auto itr = target.urls.find(key);
+			if (target.urls.end() != itr && 0 == --itr->second.holders) { target.urls.erase(itr); }
+		}
+
+		/*
+		 * @note  on shutdown, the urls dropped from then on are not done,
+		 *        they are kept for the last checkpoint.
+		 */
+		void freeze() { m_frozen.store(true); }
+
+		size_t size() const {
+			size_t result = 0;
+			for (const auto& each : m_shards) {
+				std::lock_guard<std::mutex> locker(each.mutex);
+				result += each.urls.size();
+			}
+			return result;
+		}
+
+		/*
+		 * @note  a line is "pending <depth> <url>".
+		 */
+		void save(std::ostream& out) const {
+			for (const auto& each : m_shards) {
+				std::lock_guard<std::mutex> locker(each.mutex);
+				for (const auto& url : each.urls) {
+					out << "pending " << url.second.depth << ' ' << url.second.url << '\n';
+				}
+			}
+		}
+
+	private:
+		static const size_t shards = 16u;
+
+		struct entry {
+			entry() : depth(0), holders(0) { }
+
+			std::string url;
+			uint32_t    depth;
+			size_t      holders;
+		};
+
+		struct shard {
+			mutable std::mutex                     mutex;
+			std::unordered_map<uint64_t, entry>    urls;
+		};
+
+		shard& _shard(uint64_t key) { return m_shards[(key >> 56) % shards]; }
+
+	private:
+		shard             m_shards[shards];
+		std::atomic<bool> m_frozen;
+	};
+
+	/*
+	 * The urls requested lately, so that an url queued twice (promoted by
+	 * the priority) is requested once. The memory is fixed: a table of
+	 * fingerprints, ways to a bucket, a full bucket forgets its oldest. An
+	 * url forgotten is requested again if a copy of it comes up later, no
+	 * url is skipped which was not requested. The table is made on the
+	 * first insert.
+	 */
+	class requested_urls {
+
+		typedef requested_urls self_type;
+
+	public:
+		static const size_t default_capacity = 1u << 16;
+
+		/* @param capacity  the urls remembered, rounded up to whole buckets */
+		explicit requested_urls(size_t capacity = default_capacity) :
+			m_buckets((capacity + ways - 1) / ways), m_size(0) { }
+
+		/* uncopyable */
+		requested_urls(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @param key  pending_urls::key() of the url.
+		 * @ret        false if the url was requested, else it is remembered.
+		 */
+		bool insert(uint64_t key) {
+			key = _stored(key);
+
+			std::lock_guard<std::mutex> locker(m_mutex);
+			if (m_keys.empty()) { m_keys.assign(m_buckets * ways, 0); }
+
+			uint64_t* bucket = &m_keys[(key % m_buckets) * ways];
+			size_t i = 0;
+			for (; i < ways && 0 != bucket[i]; ++i) {
+				if (key == bucket[i]) { return false; }
+			}
+
+			if (ways == i) {
+				/* in the order inserted, the first is the oldest */
+				std::move(bucket + 1, bucket + ways, bucket);
+				i = ways - 1;
+			}
+			else {
+				++m_size;
+			}
+
+			bucket[i] = key;
+			return true;
+		}
+
+		size_t size() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_size;
+		}
+
+		size_t memory() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_keys.size() * sizeof (uint64_t);
+		}
+
+		/*
+		 * @note  a line is "requested_url <key>".
+		 */
+		void save(std::ostream& out) const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			for (auto key : m_keys) {
+				if (0 != key) { out << "requested_url " << key << '\n'; }
+			}
+		}
+
+	private:
+		static const size_t ways = 4u;
+
+		/* 0 marks a free slot */
+		static uint64_t _stored(uint64_t key) { return 0 == key ? 1 : key; }
+
+	private:
+		mutable std::mutex    m_mutex;
+		const size_t          m_buckets;
+		std::vector<uint64_t> m_keys;
+		size_t                m_size;
+	};
+
+	/*
+	 * Stores checkpoints of the crawl in a directory, in the background.
+	 * take() copies what changed in the filter, lists the frontier and
+	 * returns, a thread writes it out while the crawl goes on.
+	 *
+	 * The filter image is double buffered: a checkpoint updates the image
+	 * file the one before did not use, with the pages changed since that
+	 * file was written, then replaces the manifest (written to a temporary
+	 * file and renamed over it). The manifest names the image and lists the
+	 * frontier segments, so until the rename the last checkpoint stays
+	 * whole. The first write of each file in a session is a full image.
+	 *
+	 * @note  the files are flushed, not synced: a checkpoint survives the
+	 *        crash of the process, not the loss of power.
+	 */
+	class checkpointer {
+
+		typedef checkpointer self_type;
+
+	public:
+		static const std::string manifest_name;
+		static const std::string magic;
+		static const unsigned    version = 1u;
+
+		/*
+		 * @param dir      where the checkpoints are stored.
+		 * @param session  names the image files, one more than the session
+		 *                 resumed. The images of the session before are
+		 *                 removed once a checkpoint is stored.
+		 */
+		checkpointer(const std::string& dir, size_t session) :
+			m_dir(dir),
+			m_session(session),
+			m_next_image(0),
+			m_written_epoch(0),
+			m_busy(false),
+			m_succeeded(false),
+			m_stored(0)
+		{
+			m_image_epoch[0] = m_image_epoch[1] = 0;
+		}
+
+		~checkpointer() {
+			if (m_thread.joinable()) { m_thread.join(); }
+		}
+
+		/* uncopyable */
+		checkpointer(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/* the file names of the two images of a session */
+		static std::string image_name(size_t session, size_t image) {
+			return "bloom-" + std::to_string(session) + "-" + std::to_string(image) + ".bin";
+		}
+
+		/* whether a checkpoint is being written */
+		bool busy() const { return m_busy.load(); }
+
+		/* the number of checkpoints stored */
+		size_t stored() const { return m_stored.load(); }
+
+		/* blocks until the checkpoint being written is stored (or failed) */
+		void wait() { this->_finish(); }
+
+		/*
+		 * @param filter     checkpointable, see tools::filter.
+		 * @param pending    the lines of the urls in flight, saved before
+		 *                   the filter and the frontier were last changed,
+		 *                   and those of the urls requested lately.
+		 * @param requested  the number of pages requested.
+		 * @note             waits for the checkpoint before to be written.
+		 *                   false if the image of the filter could not be
+		 *                   read, nothing is written then.
+		 */
+		bool take(tools::filter<url_message>& filter, frontier& urls, const std::string& pending, size_t requested) {
+			this->_finish();
+
+			std::unique_ptr<job> next(new job());
+			next->path       = this->_image_path(m_next_image);
+			next->full       = 0 == m_image_epoch[m_next_image];
+			next->image_size = filter.image_size();
+
+			auto copy = [&next](uint64_t offset, const char* data, size_t bytes) {
+				next->offsets.emplace_back(offset, bytes);
+				next->pages.append(data, bytes);
+			};
+
+			bool copied = next->full ?
+				filter.for_each_page(copy) : filter.for_each_page_since(m_image_epoch[m_next_image], copy);
+			if (!copied) { return false; }
+
+			/* the changes from now on go to the next checkpoints */
+			m_written_epoch = filter.epoch();
+			filter.advance_epoch();
+
+			std::ostringstream manifest;
+			manifest << magic << ' ' << version << '\n'
+			         << "session " << m_session << '\n'
+			         << "requested " << requested << '\n'
+			         << "image " << image_name(m_session, m_next_image) << '\n';
+			filter.save(manifest);
+			urls.checkpoint(manifest);
+			manifest << pending;
+
+			next->manifest = manifest.str();
+			next->urls     = &urls;
+
+			m_busy.store(true);
+			m_thread = std::thread(&self_type::_write, this, std::move(next));
+			return true;
+		}
+
+	private:
+		struct job {
+			std::string                              path;
+			bool                                     full;
+			uint64_t                                 image_size;
+			std::string                              pages;
+			std::vector<std::pair<uint64_t, size_t>> offsets;
+			std::string                              manifest;
+			frontier*                                urls;
+		};
+
+		std::string _image_path(size_t image) const {
+			return m_dir + "/" + image_name(m_session, image);
+		}
+
+		/*
+		 * @note  joins the last write and notes which image it brought up
+		 *        to date, an image which failed is written in full again.
+		 */
+		void _finish() {
+			if (!m_thread.joinable()) { return; }
+
+			m_thread.join();
+
+			size_t last = m_next_image;
+			if (m_succeeded) {
+				m_image_epoch[last] = m_written_epoch;
+				m_next_image = 1 - last;
+			}
+			else {
+				m_image_epoch[0] = m_image_epoch[1] = 0;
+			}
+		}
+
+		void _write(std::unique_ptr<job> current) {
+			m_succeeded = this->_store(*current);
+
+			if (m_succeeded) {
+				current->urls->commit();
+
+				if (0 == m_stored++ && 0 != m_session) {
+					/* the image resumed from may still be mapped, the filter keeps its pages */
+					std::error_code ignored;
+					std::filesystem::remove(m_dir + "/" + image_name(m_session - 1, 0), ignored);
+					std::filesystem::remove(m_dir + "/" + image_name(m_session - 1, 1), ignored);
+				}
+			}
+
+			m_busy.store(false);
+		}
+
+		bool _store(const job& current) {
+			std::error_code error;
+
+			{
+				auto mode = std::ios::binary | std::ios::out | (current.full ? std::ios::trunc : std::ios::in);
+				std::fstream image(current.path, mode);
+
+				size_t from = 0;
+				for (const auto& each : current.offsets) {
+					image.seekp(static_cast<std::streamoff>(each.first));
+					image.write(current.pages.data() + from, each.second);
+					from += each.second;
+				}
+				image.flush();
+
+				if (!image) {
+					CRAWLER_LOG(tools::debug_type::FATAL, "checkpointer", "Failed to write ", current.path);
+					return false;
+				}
+			}
+
+			/* the pages never set are not written, they are holes */
+			std::filesystem::resize_file(current.path, current.image_size, error);
+			if (error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "checkpointer", error.message(), ": ", current.path);
+				return false;
+			}
+
+			const std::string manifest = m_dir + "/" + manifest_name;
+			const std::string temp     = manifest + ".tmp";
+			{
+				std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+				out.write(current.manifest.data(), current.manifest.length());
+				out.flush();
+
+				if (!out) {
+					CRAWLER_LOG(tools::debug_type::FATAL, "checkpointer", "Failed to write ", temp);
+					return false;
+				}
+			}
+
+			std::filesystem::rename(temp, manifest, error);
+			if (error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "checkpointer", error.message(), ": ", manifest);
+				return false;
+			}
+
+			return true;
+		}
+
+	private:
+		std::string         m_dir;
+		size_t              m_session;
+
+		/* the image the next checkpoint updates */
+		size_t              m_next_image;
+		/* the epoch of the filter each image is up to, 0 if not written */
+		uint32_t            m_image_epoch[2];
+		uint32_t            m_written_epoch;
+
+		std::thread         m_thread;
+		std::atomic<bool>   m_busy;
+		bool                m_succeeded;
+		std::atomic<size_t> m_stored;
+	};
+
+	const std::string checkpointer::manifest_name("crawl.manifest");
+	const std::string checkpointer::magic("crawler-checkpoint");
+}
+
+#endif
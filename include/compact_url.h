@@ -0,0 +1,248 @@
+#ifndef _CRAWLER_COMPACT_URL_H_
+#define _CRAWLER_COMPACT_URL_H_
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <hash.h>
+
+namespace crawler {
+
+	/*
+	 * Every host seen by the crawler, stored once and named by a 32-bit id.
+	 * Hosts are never removed, so the views handed out stay valid.
+	 */
+	class host_table {
+
+		typedef host_table self_type;
+
+	public:
+		host_table() = default;
+
+		/* uncopyable */
+		host_table(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		uint32_t intern(std::string_view host) {
+			{
+				std::shared_lock<std::shared_mutex> locker(m_mutex);
+				auto itr = m_ids.find(host);
+				if (m_ids.end() != itr) { return itr->second; }
+			}
+
+			std::unique_lock<std::shared_mutex> locker(m_mutex);
+			auto itr = m_ids.find(host);
+			if (m_ids.end() != itr) { return itr->second; }
+
+			auto id = static_cast<uint32_t>(m_hosts.size());
+			m_hosts.emplace_back(host);
+			m_ids.emplace(m_hosts.back(), id);
+
+			return id;
+		}
+
+		std::string_view host(uint32_t id) const {
+			std::shared_lock<std::shared_mutex> locker(m_mutex);
+			return m_hosts[id];
+		}
+
+		size_t size() const {
+			std::shared_lock<std::shared_mutex> locker(m_mutex);
+			return m_hosts.size();
+		}
+
+		static host_table& global() {
+			static host_table table;
+			return table;
+		}
+
+	private:
+		mutable std::shared_mutex                      m_mutex;
+		std::deque<std::string>                        m_hosts;
+		std::unordered_map<std::string_view, uint32_t> m_ids;
+	};
+
+	/*
+	 * Append only storage for url paths: the bytes are packed into large
+	 * blocks, without the header and rounding of a heap allocation per
+	 * path. Paths live as long as the arena, which is as long as the crawl.
+	 */
+	class path_arena {
+
+		typedef path_arena self_type;
+
+	public:
+		static const size_t default_block_size = 1u << 20;
+
+		explicit path_arena(size_t block_size = default_block_size) :
+			m_block_size(block_size), m_used(0), m_capacity(0), m_memory(0) { }
+
+		/* uncopyable */
+		path_arena(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		std::string_view store(std::string_view path) {
+			if (path.empty()) { return std::string_view(); }
+
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			if (m_capacity - m_used < path.length()) {
+				size_t capacity = path.length() < m_block_size ? m_block_size : path.length();
+
+				m_blocks.emplace_back(new char[capacity]);
+				m_used     = 0;
+				m_capacity = capacity;
+				m_memory  += capacity;
+			}
+
+			char* dst = m_blocks.back().get() + m_used;
+			memcpy(dst, path.data(), path.length());
+			m_used += path.length();
+
+			return std::string_view(dst, path.length());
+		}
+
+		/* the bytes held by the blocks */
+		size_t memory() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_memory;
+		}
+
+		static path_arena& global() {
+			static path_arena arena;
+			return arena;
+		}
+
+	private:
+		mutable std::mutex                   m_mutex;
+		std::vector<std::unique_ptr<char[]>> m_blocks;
+		size_t                               m_block_size;
+		size_t                               m_used;
+		size_t                               m_capacity;
+		size_t                               m_memory;
+	};
+
+	/*
+	 * An url (host/path?query) in 32 bytes: the id of its host in the
+	 * host_table, its path in the path_arena and its murmur3_128, computed
+	 * once here and used by the filters and hash tables afterwards. It is
+	 * trivially copyable, so moving it around the pipeline is a memcpy.
+	 * The path may also be kept by the owner of the compact_url (see
+	 * url_message), so that it is released with it.
+	 */
+	class compact_url {
+
+		typedef compact_url self_type;
+
+	public:
+		compact_url() : m_host(0), m_length(0), m_path(nullptr), m_hash{ 0, 0 } { }
+
+		explicit compact_url(
+			std::string_view url,
+			host_table&      hosts = host_table::global(),
+			path_arena&      paths = path_arena::global()
+		) :
+			m_hash(tools::murmur3_128(url))
+		{
+			size_t host_end = url.find_first_of("/?");
+			if (std::string_view::npos == host_end) { host_end = url.length(); }
+
+			std::string_view path = paths.store(url.substr(host_end));
+
+			m_host   = hosts.intern(url.substr(0, host_end));
+			m_length = static_cast<uint32_t>(path.length());
+			m_path   = path.data();
+		}
+
+		/*
+		 * @param path_buffer  where the path is copied instead of the arena,
+		 *                     path_length(url) bytes kept by the caller as
+		 *                     long as the compact_url is used.
+		 */
+		compact_url(std::string_view url, char* path_buffer, host_table& hosts = host_table::global()) :
+			m_hash(tools::murmur3_128(url))
+		{
+			size_t host_end = url.length() - path_length(url);
+
+			m_host   = hosts.intern(url.substr(0, host_end));
+			m_length = static_cast<uint32_t>(url.length() - host_end);
+			m_path   = path_buffer;
+
+			if (0 != m_length) { memcpy(path_buffer, url.data() + host_end, m_length); }
+		}
+
+		/* the number of bytes after the host */
+		static size_t path_length(std::string_view url) {
+			size_t host_end = url.find_first_of("/?");
+			return std::string_view::npos == host_end ? 0 : url.length() - host_end;
+		}
+
+		/*
+		 * @ret  the same url with its path copied to path_buffer, which
+		 *       holds at least path().length() bytes.
+		 */
+		compact_url rebased(char* path_buffer) const {
+			compact_url result(*this);
+			if (0 != m_length) { memcpy(path_buffer, m_path, m_length); }
+			result.m_path = path_buffer;
+			return result;
+		}
+
+		uint32_t host_id() const { return m_host; }
+
+		std::string_view host(const host_table& hosts = host_table::global()) const {
+			return hosts.host(m_host);
+		}
+
+		/* the part after the host, empty or starting with '/' */
+		std::string_view path() const { return std::string_view(m_path, m_length); }
+
+		/* murmur3_128 of the whole url */
+		const tools::hash128& fingerprint() const { return m_hash; }
+
+		size_t hash() const { return static_cast<size_t>(m_hash.low); }
+
+		void append_to(std::string& out, const host_table& hosts = host_table::global()) const {
+			out.append(this->host(hosts));
+			out.append(m_path, m_length);
+		}
+
+		std::string str(const host_table& hosts = host_table::global()) const {
+			std::string result;
+			this->append_to(result, hosts);
+			return result;
+		}
+
+		bool operator==(const self_type& other) const {
+			return m_hash.low == other.m_hash.low && m_hash.high == other.m_hash.high &&
+				m_host == other.m_host && this->path() == other.path();
+		}
+
+		bool operator!=(const self_type& other) const { return !(*this == other); }
+
+	private:
+		uint32_t       m_host;
+		uint32_t       m_length;
+		const char*    m_path;
+		tools::hash128 m_hash;
+	};
+}
+
+namespace std {
+
+	template <>
+	struct hash<crawler::compact_url> {
+		size_t operator()(const crawler::compact_url& url) const { return url.hash(); }
+	};
+}
+
+#endif
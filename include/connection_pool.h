@@ -0,0 +1,161 @@
+#ifndef _CRAWLER_CONNECTION_POOL_H_
+#define _CRAWLER_CONNECTION_POOL_H_
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <boost/asio.hpp>
+
+namespace crawler {
+
+	/*
+	 * Idle keep-alive sockets, grouped by host. A socket is owned either by
+	 * a pending request or by the pool, never by both.
+	 */
+	class connection_pool {
+
+		typedef connection_pool self_type;
+
+	public:
+		typedef boost::asio::ip::tcp::socket    socket_type;
+		typedef std::shared_ptr<socket_type>    sock_ptr;
+		typedef std::chrono::steady_clock       clock_type;
+		typedef clock_type::time_point          time_point;
+
+		static const size_t               default_max_idle_per_host = 8u;
+		static const std::chrono::seconds default_max_idle_time;
+
+		explicit connection_pool(
+			size_t               max_idle_per_host = default_max_idle_per_host,
+			std::chrono::seconds max_idle_time     = default_max_idle_time
+		) :
+			m_max_idle_per_host(max_idle_per_host),
+			m_max_idle_time(max_idle_time),
+			m_releases(0) { }
+
+		~connection_pool() { clear(); }
+
+		/* uncopyable */
+		connection_pool(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @note  takes the most recently used idle socket of the host.
+		 * @ret   nullptr if there is no usable idle socket.
+		 */
+		sock_ptr acquire(const std::string& host) {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			auto itr = m_idle.find(host);
+			if (m_idle.end() == itr) { return sock_ptr(); }
+
+			auto& sockets = itr->second;
+			const auto now = clock_type::now();
+
+			while (!sockets.empty()) {
+				auto entry = std::move(sockets.back());
+				sockets.pop_back();
+
+				if (m_max_idle_time < now - entry.since || !entry.sock->is_open()) {
+					_close(entry.sock);
+					continue;
+				}
+
+				return entry.sock;
+			}
+
+			m_idle.erase(itr);
+			return sock_ptr();
+		}
+
+		/*
+		 * @note  gives a socket back after a complete keep-alive response,
+		 *        the socket is closed if the host already has enough idle
+		 *        sockets.
+		 */
+		void release(const std::string& host, sock_ptr sock) {
+			if (nullptr == sock || !sock->is_open()) { return; }
+
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			auto& sockets = m_idle[host];
+			if (m_max_idle_per_host <= sockets.size()) {
+				_close(sockets.front().sock);
+				sockets.pop_front();
+			}
+			sockets.push_back({ std::move(sock), clock_type::now() });
+
+			if (0 == ++m_releases % sweep_interval) { _evict_expired(); }
+		}
+
+		/*
+		 * @note  closes the sockets which have been idle for too long.
+		 */
+		void evict_expired() {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			_evict_expired();
+		}
+
+		void clear() {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			for (auto& each : m_idle) {
+				for (auto& entry : each.second) { _close(entry.sock); }
+			}
+			m_idle.clear();
+		}
+
+		size_t idle_count() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			size_t count = 0;
+			for (const auto& each : m_idle) { count += each.second.size(); }
+			return count;
+		}
+
+		size_t max_idle_per_host() const { return m_max_idle_per_host; }
+
+	private:
+		struct idle_entry {
+			sock_ptr   sock;
+			time_point since;
+		};
+
+		static void _close(const sock_ptr& sock) {
+			boost::system::error_code ignored;
+			sock->shutdown(boost::asio::socket_base::shutdown_both, ignored);
+			sock->close(ignored);
+		}
+
+		void _evict_expired() {
+			const auto now = clock_type::now();
+
+			for (auto itr = m_idle.begin(); m_idle.end() != itr; ) {
+				auto& sockets = itr->second;
+				/* the oldest sockets are at the front */
+				while (!sockets.empty() && m_max_idle_time < now - sockets.front().since) {
+					_close(sockets.front().sock);
+					sockets.pop_front();
+				}
+				itr = sockets.empty() ? m_idle.erase(itr) : std::next(itr);
+			}
+		}
+
+	private:
+		static const size_t sweep_interval = 256u;
+
+		mutable std::mutex m_mutex;
+
+		const size_t               m_max_idle_per_host;
+		const std::chrono::seconds m_max_idle_time;
+		size_t                     m_releases;
+
+		std::unordered_map<std::string, std::deque<idle_entry>> m_idle;
+	};
+
+	const std::chrono::seconds connection_pool::default_max_idle_time(15);
+}
+
+#endif
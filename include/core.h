@@ -1,12 +1,27 @@
 #ifndef _CRAWLER_CORE_H_
 #define _CRAWLER_CORE_H_
 
+#include <atomic>
 #include <thread>
+#include <vector>
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <iterator>
+#include <filesystem>
+#include <unordered_set>
 
-#include <threadsafe_ostream.h>
+#include <link_graph.h>
+#include <graph_format.h>
 #include <resovler.h>
+#include <url_canonicalizer.h>
+#include <frontier.h>
+#include <host_scheduler.h>
+#include <url_priority.h>
+#include <bucket_queue.h>
 #include <filter.h>
+#include <checkpoint.h>
+#include <metrics.h>
 #include <request.h>
 #include <message_queue.h>
 #include <messages.h>
@@ -19,7 +34,6 @@ namespace crawler {
 	class core {
 
 		typedef std::shared_ptr<tools::string_resovler>     resovler_ptr;
-		typedef std::shared_ptr<tools::ts_ofstream>         ofstream_ptr;
 		typedef std::shared_ptr<tools::filter<url_message>> filter_ptr;
 
 	public:
@@ -27,6 +41,10 @@ namespace crawler {
 
 		typedef crawler_msg_catagory                   message_catagory;
 		typedef tools::message_queue<message_catagory> queue_type;
+		/* the seeds are handed to the requests by priority */
+		typedef tools::bucket_queue<queue_type::pointer> seeds_queue_type;
+
+		typedef std::shared_ptr<url_priority> priority_ptr;
 
 		~core() {
 			shutdown();
@@ -34,16 +52,32 @@ namespace crawler {
 			if (m_thd_filter.joinable())  { m_thd_filter.join();  }
 		}
 
+		/*
+		 * @param max_total  the number of pages to request before stopping,
+		 *                   0 for no limit.
+		 */
 		explicit core(
 			const url_message& seed, 
-			const std::string& path = default_output_path
+			const std::string& path      = default_output_path,
+			size_t             max_total = default_max_total
 		) : 
-			m_seeds(max_seeds), 
+			m_priority(new depth_priority()),
+			m_seeds(max_seeds, url_priority::levels, std::bind(&core::_rank, this, std::placeholders::_1)), 
 			m_candidates(max_candidates), 
 			m_resps(max_resps),
-			m_output_path(path)
+			m_frontier(new priority_frontier(url_priority::levels, _make_dir(state_dir))),
+			m_filter(new scalable_bloom_filter(filter_capacity, filter_fp_rate)),
+			m_requested(0),
+			m_output_path(path),
+			m_max_total(max_total),
+			m_host_concurrency(default_host_concurrency),
+			m_host_delay(default_host_delay),
+			m_checkpoint_interval(default_checkpoint_interval),
+			m_session(0),
+			m_resumed(false),
+			m_stats_port(default_stats_port)
 		{
-			m_seeds.wait_and_push(new url_message(seed));
+			this->_add_seed(url_canonicalizer(), seed);
 			m_stat = status::READY;
 		}
 
@@ -51,15 +85,28 @@ namespace crawler {
 		core(
 			_ForwardItr        first, 
 			_ForwardItr        last, 
-			const std::string& path = default_output_path
+			const std::string& path      = default_output_path,
+			size_t             max_total = default_max_total
 		) :
-			m_seeds(max_seeds),
+			m_priority(new depth_priority()),
+			m_seeds(max_seeds, url_priority::levels, std::bind(&core::_rank, this, std::placeholders::_1)),
 			m_candidates(max_candidates),
 			m_resps(max_resps),
-			m_output_path(path)
+			m_frontier(new priority_frontier(url_priority::levels, _make_dir(state_dir))),
+			m_filter(new scalable_bloom_filter(filter_capacity, filter_fp_rate)),
+			m_requested(0),
+			m_output_path(path),
+			m_max_total(max_total),
+			m_host_concurrency(default_host_concurrency),
+			m_host_delay(default_host_delay),
+			m_checkpoint_interval(default_checkpoint_interval),
+			m_session(0),
+			m_resumed(false),
+			m_stats_port(default_stats_port)
 		{
+			url_canonicalizer canonicalizer;
 			while (first != last) {
-				m_seeds.wait_and_push(new url_message(*first));
+				this->_add_seed(canonicalizer, *first);
 				++first;
 			}
 			m_stat = status::READY;
@@ -70,12 +117,33 @@ namespace crawler {
 				return false;
 			}
 
+			if (!m_resumed) {
+				/* a new crawl, the checkpoint of the one before is gone */
+				this->_clear_state();
+				for (const auto& each : m_seed_urls) { m_frontier->push(each, 0, url_priority::levels - 1); }
+			}
+			m_seed_urls.clear();
+
+			if (0 != m_checkpoint_interval.count()) { m_frontier->retain(); }
+
+			m_graph.reset(new link_graph(m_output_path, m_resumed));
+
 			m_stat = status::RUNNING;
 
 			m_thd_analyze = std::thread(&core::_analyze_loop, this);
 			m_thd_filter  = std::thread(&core::_filter_loop,  this);
 
-			this->_request_loop();
+			{
+				m_last_stats = stats_mark();
+				tools::stats_service stats(
+					m_stats_port, 
+					stats_interval, 
+					std::bind(&core::_stats_line, this), 
+					std::bind(&core::_stats_page, this)
+				);
+
+				this->_request_loop();
+			}
 
 			return true;
 		}
@@ -85,67 +153,327 @@ namespace crawler {
 
 			m_stat = status::UNAVAILABLE;
 
+			/* what is in flight now goes to the last checkpoint */
+			m_pending.freeze();
+
 			m_seeds.clear();
-			m_candidates.clear();
 			m_resps.clear();
 
-			m_seeds.wait_and_push(new stop_signal());
-			m_candidates.wait_and_push(new stop_signal());
-			m_resps.wait_and_push(new stop_signal());
+			m_seeds.wait_and_push(tools::make_message<stop_signal>());
+			m_resps.wait_and_push(tools::make_message<stop_signal>());
+
+			/*
+			 * the links found are kept for the last checkpoint, if there is no
+			 * room the filter thread stops on the status anyway.
+			 */
+			m_candidates.try_push(tools::make_message<stop_signal>());
+		}
+
+		/*
+		 * @note  continues the crawl from the last checkpoint in state_dir,
+		 *        the seeds given are not used then. The image of the
+		 *        scalable Bloom filter is mapped, the other filters read
+		 *        theirs. Call it before run().
+		 * @ret   false if there is no checkpoint which can be read, or a
+		 *        file it needs is missing, the crawl starts from the seeds
+		 *        then.
+		 */
+		bool resume() {
+			if (status::READY != m_stat || m_resumed) { return false; }
+
+			const std::string path = state_dir + "/" + checkpointer::manifest_name;
+			std::ifstream in(path, std::ios::binary);
+
+			std::string tag, image;
+			unsigned    version   = 0;
+			size_t      session   = 0;
+			size_t      requested = 0;
+
+			if (!(in >> tag >> version) || checkpointer::magic != tag || checkpointer::version != version ||
+			    !(in >> tag >> session) || "session" != tag ||
+			    !(in >> tag >> requested) || "requested" != tag ||
+			    !(in >> tag >> image) || "image" != tag
+			) {
+				CRAWLER_LOG(tools::debug_type::WARNING, "resume", "No checkpoint in ", path);
+				return false;
+			}
+
+			auto filter = restore_filter(in, state_dir + "/" + image);
+			if (nullptr == filter) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "resume", "Failed to restore the filter image ", image);
+				return false;
+			}
+
+			std::vector<std::pair<uint32_t, std::string>> pending;
+			std::vector<uint64_t> requested_keys;
+			std::string line;
+
+			while (std::getline(in, line)) {
+				if (line.empty()) { continue; }
+
+				if (0 == line.compare(0, 8, "pending ")) {
+					char* end = nullptr;
+					auto depth = std::strtoul(line.c_str() + 8, &end, 10);
+					if (' ' == *end) { pending.emplace_back(static_cast<uint32_t>(depth), std::string(end + 1)); }
+				}
+				else if (0 == line.compare(0, 14, "requested_url ")) {
+					requested_keys.push_back(std::strtoull(line.c_str() + 14, nullptr, 10));
+				}
+				else {
+					auto result = m_frontier->restore(line);
+					if (frontier::restore_result::FAILED == result) {
+						/* the segments restored before are dropped with the frontier, run() clears the files */
+						CRAWLER_LOG(tools::debug_type::FATAL, "resume", "Checkpoint in ", path, " is broken, starting over.");
+						m_frontier.reset(new priority_frontier(url_priority::levels, state_dir));
+						return false;
+					}
+					if (frontier::restore_result::UNKNOWN == result) {
+						CRAWLER_LOG(tools::debug_type::WARNING, "resume", "Unknown line in checkpoint: ", line);
+					}
+				}
+			}
+
+			/* the urls in flight go first, after the segments restored */
+			std::unordered_set<uint64_t> in_flight;
+			for (const auto& each : pending) {
+				m_frontier->push(each.second, each.first, url_priority::levels - 1);
+				in_flight.insert(pending_urls::key(url_message(each.second)));
+			}
+
+			/* those are requested again, the copies of the others are skipped */
+			for (auto key : requested_keys) {
+				if (0 == in_flight.count(key)) { m_requested_urls.insert(key); }
+			}
+
+			m_filter    = std::move(filter);
+			m_requested = requested;
+			m_session   = session + 1;
+			m_resumed   = true;
+
+			CRAWLER_LOG(
+				tools::debug_type::INFO,
+				"resume",
+				"Session: ", session,
+				", urls seen: ", m_filter->size(),
+				", frontier urls: ", m_frontier->size(),
+				", in flight: ", pending.size(),
+				", requested: ", requested,
+				", requested urls remembered: ", m_requested_urls.size()
+			);
+
+			return true;
+		}
+
+		/*
+		 * @param interval  the time between two checkpoints, one more is
+		 *                  taken on shutdown. 0 for none.
+		 * @note            call it before run().
+		 */
+		void checkpoint_every(std::chrono::seconds interval) {
+			if (status::RUNNING != m_stat) { m_checkpoint_interval = interval; }
+		}
+
+		/*
+		 * @param port  the stats page is served on 127.0.0.1:port while
+		 *              running, 0 for none. The stats line is logged
+		 *              every stats_interval anyway.
+		 * @note        call it before run().
+		 */
+		void serve_stats(unsigned short port) {
+			if (status::RUNNING != m_stat) { m_stats_port = port; }
+		}
+
+		/*
+		 * @param per_host  the number of requests to one host in flight.
+		 * @param delay     the least time between two requests to one host.
+		 * @note            takes effect on the next run().
+		 */
+		void politeness(size_t per_host, std::chrono::milliseconds delay) {
+			m_host_concurrency = per_host;
+			m_host_delay       = delay;
+		}
+
+		/*
+		 * @param priority  decides which urls are requested first, the
+		 *                  seeds always go first. depth_priority (breadth
+		 *                  first) by default.
+		 * @note            call it before run().
+		 */
+		void prioritize(priority_ptr priority) {
+			if (status::RUNNING != m_stat && nullptr != priority) { m_priority = std::move(priority); }
+		}
+
+		/*
+		 * @param filter  decides which urls are new, a scalable_bloom_filter
+		 *                by default. A crawl resumed goes on with the filter
+		 *                of its checkpoint.
+		 * @note          call it before run().
+		 */
+		void use_filter(filter_ptr filter) {
+			if (status::RUNNING != m_stat && !m_resumed && nullptr != filter) { m_filter = std::move(filter); }
 		}
 
+		/* the graph is written to output_path().nodes and .edges while running */
 		const std::string& output_path() const { return m_output_path; }
 
+		/*
+		 * @param binary  a graph file (graph_format.h) rather than the text
+		 *                of url.txt.
+		 * @note          after run(), waits for the pages being analyzed.
+		 */
+		bool export_graph(const std::string& path, bool binary = false) {
+			if (status::RUNNING == m_stat || nullptr == m_graph) { return false; }
+
+			if (m_thd_analyze.joinable()) { m_thd_analyze.join(); }
+
+			if (!binary) { return m_graph->export_text(path); }
+
+			m_graph->close();
+			return encode_graph(m_graph->nodes_path(), m_graph->edges_path(), path);
+		}
+
 	private:
+		/*
+		 * @note  a seed which is not a http(s) url is left out.
+		 */
+		void _add_seed(const url_canonicalizer& canonicalizer, const url_message& seed) {
+			std::string url;
+			if (canonicalizer.canonicalize(seed.url(), url)) { m_seed_urls.push_back(std::move(url)); }
+			else { CRAWLER_LOG(tools::debug_type::WARNING, "core", "Not a http(s) url, seed left out: ", seed.url()); }
+		}
+
 		/*
 		 * @note  main logic function
 		 */
 		void _request_loop() {
 
-			http_req_executor executor(max_threads);
+			/* destroyed after the executor, the requests left release their hosts */
+			host_scheduler<queue_type::pointer> scheduler(m_host_concurrency, m_host_delay, max_host_backlog);
 
-			size_t count = 0;
+			http_req_executor executor(std::thread::hardware_concurrency(), max_in_flight);
 
-			while (status::RUNNING == m_stat) {
+			std::vector<queue_type::pointer> msgs;
+			std::string url;
 
-				auto msg = m_seeds.wait_and_pop_for(timeout_20s);
+			bool   stopped = false;
+			auto   last_active = std::chrono::steady_clock::now();
 
-				if (nullptr == msg) { this->shutdown(); break; }
-				if (message_catagory::STOP == msg->catagory()) { break; }
+			while (status::RUNNING == m_stat && !stopped) {
+				msgs.clear();
 
-				if (message_catagory::URL == msg->catagory()) {
-					auto url_msg = dynamic_cast<url_message*>(msg.get());
-					assert(nullptr != url_msg);
+				/*
+				 * only blocks on the seeds queue while there is nothing to schedule.
+				 * Nothing is taken while every host queued is full, their urls would
+				 * only go back to the frontier (a crawl of one host, mostly).
+				 */
+				if (scheduler.size() < max_scheduled && !scheduler.saturated()) {
+					tools::scoped_timer waiting(_metrics().seeds_pop);
+					m_seeds.pop_bulk(
+						std::back_inserter(msgs), filter_batch, scheduler.empty() ? timeout_1s : timeout_0s
+					);
+				}
+
+				for (auto& msg : msgs) {
+					if (message_catagory::STOP == msg->catagory()) { stopped = true; break; }
+
+					if (message_catagory::URL == msg->catagory()) {
+						auto url_msg = static_cast<url_message*>(msg.get());
+						assert(nullptr != dynamic_cast<url_message*>(msg.get()));
+
+						if (!scheduler.push(url_msg->location().host_id(), msg)) {
+							/* the host has enough queued, its url goes to the back of the frontier */
+							url.clear();
+							url_msg->location().append_to(url);
+							m_frontier->push(url, url_msg->depth(), m_priority->level(*url_msg));
+							m_pending.release(pending_urls::key(*url_msg));
+						}
+					}
+#ifdef _DEBUG_OUTPUT_ERROR_INFO_
+					else {
+						CRAWLER_LOG(tools::debug_type::WARNING, "_request_loop", "Unknown type of message.");
+					}
+#endif
+				}
+
+				if (stopped) { break; }
 
-					std::shared_ptr<http_req> req(new http_req(url_msg->url()));
+				queue_type::pointer msg;
+				uint32_t            host;
+				bool                dispatched = false;
+
+				/*
+				 * a request in flight keeps a place in the responses queue, so the
+				 * handler on the event loop never waits for one.
+				 */
+				while (scheduler.in_flight() + m_resps.size() < max_resps && scheduler.pop(msg, host)) {
+					dispatched = true;
+
+					auto url_msg = static_cast<url_message*>(msg.get());
+					auto key     = pending_urls::key(*url_msg);
+
+					/* an url promoted by the priority is queued twice, only one is requested */
+					if (m_priority->promotes() && !m_requested_urls.insert(key)) {
+						scheduler.release(host);
+						m_pending.release(key);
+						continue;
+					}
+
+					std::shared_ptr<http_req> req(
+						new http_req(url_msg->location()),
+						[this, &scheduler, host, key](http_req* finished) {
+							delete finished;
+							m_pending.release(key);
+							scheduler.release(host);
+						}
+					);
 
 					req->add_handler(
-						std::bind(&_handle_resp, std::ref(m_resps), url_msg->url(), std::placeholders::_1)
+						std::bind(
+							&_handle_resp, std::ref(m_resps), std::ref(m_pending), url_msg->depth(), key, std::placeholders::_1
+						)
 					);
 
 					executor.commit(req);
+					_metrics().requested.add();
 
-					if (max_total_seeds < ++count) { this->shutdown(); break; }
+					if (0 != m_max_total && m_max_total <= ++m_requested) { this->shutdown(); break; }
 				}
 
-#ifdef _DEBUG_OUTPUT_ERROR_INFO_
-				else {
-					tools::log(tools::debug_type::WARNING, "_request_loop", "Unknown type of message.");
-				}
-#endif
+				/*
+				 * idle while no url comes in and none goes out: the urls of a host
+				 * whose requests hang are not activity, they would keep the crawl
+				 * alive as long as the host does not answer.
+				 */
+				auto now = std::chrono::steady_clock::now();
+				if (!msgs.empty() || dispatched) { last_active = now; }
+				else if (timeout_20s <= now - last_active) { this->shutdown(); break; }
+
+				if (!dispatched && !scheduler.empty()) { scheduler.wait_for(timeout_50ms); }
 			}
+
+			CRAWLER_LOG(
+				tools::debug_type::INFO,
+				"_request_loop",
+				"DNS cache hits: ", executor.dns().hits(),
+				", misses: ", executor.dns().misses(),
+				", coalesced: ", executor.dns().coalesced(),
+				", hosts scheduled: ", scheduler.hosts()
+			);
 		}
 
 		void _analyze_loop() {
 
 			boost::asio::thread_pool pool;
-			std::ofstream fstream(m_output_path, std::ios::app | std::ios::out);
 
-			resovler_ptr resovler(new response_resovler());
-			ofstream_ptr stream(new tools::ts_ofstream(std::move(fstream)));
+			resovler_ptr resovler(new link_resovler());
 
 			while (status::RUNNING == m_stat) {
-				auto msg = m_resps.wait_and_pop();
+				queue_type::pointer msg;
+				{
+					tools::scoped_timer waiting(_metrics().resps_pop);
+					msg = m_resps.wait_and_pop();
+				}
+
 				if (message_catagory::STOP == msg->catagory()) {
 					break;
 				}
@@ -156,129 +484,507 @@ namespace crawler {
 						std::bind(
 							&_analyze_task, 
 							std::ref(m_candidates), 
+							std::ref(m_pending), 
 							resovler, 
-							stream, 
+							std::ref(*m_graph), 
 							msg
 						)
 					);
 				}
 #ifdef _DEBUG_OUTPUT_ERROR_INFO_
 				else {
-					tools::log(tools::debug_type::WARNING, "_analyze_loop", "Unknown type of message.");
+					CRAWLER_LOG(tools::debug_type::WARNING, "_analyze_loop", "Unknown type of message.");
 				}
 #endif
 			}
 
 			pool.stop();
+			pool.join();
+			m_graph->close();
 		}
 
 		void _filter_loop() {
-			filter_ptr filter(new bloom_filter<1600000, 110000>());
+			std::vector<queue_type::pointer> msgs;
+			std::vector<queue_type::pointer> passed;
+			/* taken from the frontier, waiting for room in the seeds queue */
+			std::vector<queue_type::pointer> ready;
+			std::string                      url;
+
+			std::unique_ptr<checkpointer> saver;
+			if (0 != m_checkpoint_interval.count()) {
+				if (m_filter->checkpointable()) { saver.reset(new checkpointer(state_dir, m_session)); }
+				else { CRAWLER_LOG(tools::debug_type::WARNING, "_filter_loop", "The filter can not be checkpointed."); }
+			}
 
-			while (status::RUNNING == m_stat) {
-				auto msg = m_candidates.wait_and_pop();
+			auto last_checkpoint = std::chrono::steady_clock::now();
+			bool stop            = false;
+
+			this->_refill_seeds(ready, url);
+
+			while (status::RUNNING == m_stat && !stop) {
+				msgs.clear();
+
+				/* poll more often while urls are waiting for the seeds queue */
+				bool waiting = !ready.empty() || !m_frontier->empty();
+
+				size_t popped = 0;
+				{
+					tools::scoped_timer timer(_metrics().candidates_pop);
+					popped = m_candidates.pop_bulk(
+						std::back_inserter(msgs), filter_batch, waiting ? timeout_50ms : timeout_1s
+					);
+				}
+
+				if (0 != popped) {
+					/* the urls go straight to the seeds queue while nothing is waiting before them */
+					stop = this->_filter_urls(msgs, passed, !waiting, url);
+				}
+
+				this->_refill_seeds(ready, url);
+
+				auto now = std::chrono::steady_clock::now();
+				if (nullptr != saver && !stop && !saver->busy() && m_checkpoint_interval <= now - last_checkpoint) {
+					stop = this->_checkpoint(*saver, msgs, passed, url);
+					last_checkpoint = now;
+				}
+			}
+
+			size_t checkpoints = 0;
+			if (nullptr != saver) {
+				/* the last one, nothing in flight is done from here */
+				m_pending.freeze();
+				this->_checkpoint(*saver, msgs, passed, url);
+				saver->wait();
+				checkpoints = saver->stored();
+			}
+
+			CRAWLER_LOG(
+				tools::debug_type::INFO,
+				"_filter_loop",
+				"Filter urls: ", m_filter->size(),
+				", bytes: ", m_filter->memory(),
+				", estimated fp rate: ", m_filter->false_positive_rate(),
+				", frontier urls left: ", m_frontier->size(),
+				", checkpoints: ", checkpoints
+			);
+		}
+
+		/*
+		 * @param direct  whether the urls passed may go straight to the seeds
+		 *                queue, the rest go to the frontier.
+		 * @ret           whether the stop signal was among the messages.
+		 */
+		bool _filter_urls(
+			std::vector<queue_type::pointer>& msgs,
+			std::vector<queue_type::pointer>& passed,
+			bool                              direct,
+			std::string&                      url
+		) {
+			bool stop = false;
+			passed.clear();
+
+			for (auto& msg : msgs) {
 				if (message_catagory::STOP == msg->catagory()) {
-					break;
+					stop = true;
+					continue;
 				}
 
 				if (message_catagory::URL == msg->catagory()) {
-					auto url_msg = dynamic_cast<url_message*>(msg.get());
-					assert(nullptr != url_msg);
+					auto url_msg = static_cast<url_message*>(msg.get());
+					assert(nullptr != dynamic_cast<url_message*>(msg.get()));
 
-					if (filter->test(*url_msg)) {
-						if (!m_seeds.wait_and_push_for(std::move(msg), timeout_1s)) {
-							tools::log(tools::debug_type::FATAL, "_filter_loop", "Seeds queue is too small.");
-						}
+					/* a link to a known url may raise its priority, it is queued again */
+					bool promoted = m_priority->observe(*url_msg);
+
+					if (m_filter->test(*url_msg) || promoted) {
+						passed.push_back(std::move(msg));
 					}
 				}
 #ifdef _DEBUG_OUTPUT_ERROR_INFO_
 				else {
-					tools::log(tools::debug_type::WARNING, "_filter_loop", "Unknown type of message.");
+					CRAWLER_LOG(tools::debug_type::WARNING, "_filter_loop", "Unknown type of message.");
 				}
 #endif
 			}
+
+			_metrics().passed.add(passed.size());
+			_metrics().rejected.add(msgs.size() - passed.size());
+
+			auto first = passed.begin();
+			if (direct) {
+				/* in flight from here, those left over are held by the frontier instead */
+				for (const auto& each : passed) { m_pending.acquire(*static_cast<url_message*>(each.get())); }
+				first += m_seeds.push_bulk_for(passed.begin(), passed.end(), timeout_0s);
+			}
+
+			for (; first != passed.end(); ++first) {
+				auto url_msg = static_cast<url_message*>(first->get());
+
+				url.clear();
+				url_msg->location().append_to(url);
+				m_frontier->push(url, url_msg->depth(), m_priority->level(*url_msg));
+
+				if (direct) { m_pending.release(pending_urls::key(*url_msg)); }
+			}
+
+			return stop;
 		}
 
+		/*
+		 * @note  the urls in flight are listed first, then the links found
+		 *        until now go to the frontier, so an url done meanwhile has
+		 *        its links in the checkpoint, and one not done is listed.
+		 * @ret   whether the stop signal was among the links.
+		 */
+		bool _checkpoint(
+			checkpointer&                     saver,
+			std::vector<queue_type::pointer>& msgs,
+			std::vector<queue_type::pointer>& passed,
+			std::string&                      url
+		) {
+			/* an url requested and not done yet is listed in flight as well */
+			std::ostringstream pending;
+			m_requested_urls.save(pending);
+			m_pending.save(pending);
+
+			bool stop = false;
+
+			/* a fifo, the links queued before are out after max_candidates */
+			for (size_t drained = 0; drained < max_candidates; drained += msgs.size()) {
+				msgs.clear();
+				if (0 == m_candidates.pop_bulk(std::back_inserter(msgs), filter_batch, timeout_0s)) { break; }
+				stop = this->_filter_urls(msgs, passed, false, url) || stop;
+			}
+
+			if (!saver.take(*m_filter, *m_frontier, pending.str(), m_requested.load())) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "_checkpoint", "Skipped, the filter image could not be read.");
+			}
+
+			return stop;
+		}
+
+		/*
+		 * @note  moves urls from the frontier to the seeds queue until the
+		 *        queue is full, never waits.
+		 */
+		void _refill_seeds(std::vector<queue_type::pointer>& ready, std::string& url) {
+			uint32_t depth;
+
+			while (true) {
+				while (ready.size() < filter_batch && m_frontier->pop(url, depth)) {
+					ready.push_back(tools::make_message<url_message>(url, depth));
+					m_pending.acquire(*static_cast<url_message*>(ready.back().get()));
+				}
+
+				if (ready.empty()) { return; }
+
+				size_t pushed = m_seeds.push_bulk_for(ready.begin(), ready.end(), timeout_0s);
+				ready.erase(ready.begin(), ready.begin() + pushed);
+
+				if (!ready.empty()) { return; }
+			}
+		}
+
+		/*
+		 * @ret  the level of a message in the seeds queue.
+		 */
+		size_t _rank(const queue_type::pointer& msg) const {
+			if (message_catagory::URL != msg->catagory()) { return url_priority::levels - 1; }
+			return m_priority->level(*static_cast<const url_message*>(msg.get()));
+		}
+
+		/*
+		 * @param key  the pending url requested, it is held until its links
+		 *             are found.
+		 * @note       runs on the event loop, never blocks: the request loop
+		 *             keeps room in the queue for every request in flight.
+		 */
 		static void _handle_resp(
-			queue_type& queue, const std::string& url, const std::string& resp
+			queue_type&              queue, 
+			pending_urls&            pending, 
+			uint32_t                 depth, 
+			uint64_t                 key, 
+			const http_response_ptr& resp
 		) {
-			static const std::string ok_code("200");
-			if (ok_code != resp.substr(9, 3)) {
+			static const int ok_code = 200;
+			if (ok_code != resp->status_code()) {
 #ifdef _DEBUG_OUTPUT_ERROR_INFO_
-				tools::log(
+				CRAWLER_LOG(
 					tools::debug_type::WARNING, 
 					"_handle_resp", 
-					std::string("Bad response: ") + resp.substr(0, 16) + "..."
+					"Bad response: ", std::string_view(resp->header()).substr(0, 16), "..."
 				);
 #endif
+				_metrics().bad_responses.add();
 				return;
 			}
 
-			std::string& ref_resp = const_cast<std::string&>(resp);
-			std::string& ref_url  = const_cast<std::string&>(url);
+			pending.retain(key);
 
-			// todo should do pre-process
-			if(
-				!queue.wait_and_push_for(
-					new http_resp_message(std::move(ref_url), std::move(ref_resp)), 
-					timeout_1s
-				)
-			) {
-				tools::log(tools::debug_type::FATAL, "_handle_resp", "Response queue is too small.");
+			bool pushed = false;
+			{
+				tools::scoped_timer blocked(_metrics().resps_push);
+				pushed = queue.try_push(tools::make_message<http_resp_message>(resp, depth, key));
+			}
+
+			if (!pushed) {
+				CRAWLER_LOG(tools::debug_type::WARNING, "_handle_resp", "Response queue is full, dropped: ", resp->request_url());
+				_metrics().dropped_responses.add();
+				pending.release(key);
 			}
 		}
 
-		static void _handle_url_analyzed(
-			queue_type&        candidates, 
-			ofstream_ptr       stream,
-			const std::string& request_url,
-			const std::string& source, 
-			size_t             offset, 
-			const std::string& result
-		) {
+		/*
+		 * links found on one page, they are pushed to the candidates queue
+		 * together once the page has been resovled.
+		 */
+		struct link_batch {
+			std::vector<queue_type::pointer> urls;
+			std::string                      links;
+			std::vector<size_t>              link_ends;
+			/* the depth of the links */
+			uint32_t                         depth;
+		};
+
+		static void _handle_url_analyzed(link_batch& batch, const std::string& result) {
 			std::string tmp(result);
 			boost::trim(tmp);
 			if (tmp.empty() || !_valid_url(tmp)) { return; }
 
-			if (
-				!candidates.wait_and_push_for(new url_message(result), timeout_1s)
-			) {
-				tools::log(tools::debug_type::FATAL, "_handle_url_analyzed", "Candidates queue is too small.");
-				return;
-			}
+			batch.urls.emplace_back(tools::make_message<url_message>(result, batch.depth));
 
-			*stream << request_url + "\t" + result + "\n";
+			batch.links.append(result);
+			batch.link_ends.push_back(batch.links.length());
 
 #ifdef _DEBUG_OUTPUT_ERROR_INFO_
-			tools::log(
+			CRAWLER_LOG(
 				tools::debug_type::INFO, 
 				"_handle_url_analyzed", 
-				std::string("Resovled url: ") + result
+				"Resovled url: ", result
 			);
 #endif
 		}
 
+		/*
+		 * @note  the page requested is done once its links are all in the
+		 *        candidates queue, one which lost links stays pending.
+		 */
 		static void _analyze_task(
 			queue_type&         candidates, 
+			pending_urls&       pending, 
 			resovler_ptr        resovler, 
-			ofstream_ptr        stream,
+			link_graph&         graph,
 			queue_type::pointer msg
 		) {
-			const auto resp_msg = dynamic_cast<http_resp_message*>(msg.get());
-			assert(nullptr != resp_msg);
+			/* posted by _analyze_loop for HTTP_RESP messages only */
+			const auto resp_msg = static_cast<http_resp_message*>(msg.get());
+			assert(nullptr != dynamic_cast<http_resp_message*>(msg.get()));
+
+			link_batch batch;
+			batch.depth = resp_msg->depth() + 1;
+
+			auto parsing = std::chrono::steady_clock::now();
 
 			resovler->resovle(
-				resp_msg->response(),
-				std::bind(
-					&_handle_url_analyzed,
-					std::ref(candidates),
-					stream,
-					resp_msg->request_url(),
-					std::placeholders::_1,
-					std::placeholders::_2,
-					std::placeholders::_3
-				)
+				resp_msg->response().body(),
+				resp_msg->request_url(),
+				/* the source and the offset of the link are not needed */
+				std::bind(&_handle_url_analyzed, std::ref(batch), std::placeholders::_3)
 			);
+
+			auto parsed = std::chrono::steady_clock::now() - parsing;
+			auto bytes  = resp_msg->response().body().length();
+			_metrics().parse_per_kb.record(parsed * 1024 / (0 == bytes ? 1 : bytes));
+			_metrics().links.add(batch.urls.size());
+
+			if (batch.urls.empty()) {
+				pending.release(resp_msg->source());
+				return;
+			}
+
+			size_t pushed = 0;
+			{
+				tools::scoped_timer blocked(_metrics().candidates_push);
+				pushed = candidates.push_bulk_for(batch.urls.begin(), batch.urls.end(), timeout_1s);
+			}
+			if (pushed < batch.urls.size()) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "_analyze_task", "Candidates queue is too small.");
+				if (0 == pushed) { return; }
+			}
+			else {
+				pending.release(resp_msg->source());
+			}
+
+			/* only the links which got into the queue are written */
+			std::vector<std::string_view> links;
+			links.reserve(pushed);
+			for (size_t i = 0, from = 0; i < pushed; from = batch.link_ends[i++]) {
+				links.emplace_back(batch.links.data() + from, batch.link_ends[i] - from);
+			}
+
+			graph.add(resp_msg->request_url(), links.begin(), links.end());
+		}
+
+		/*
+		 * the instruments of the stages, in tools::metrics::global(). The
+		 * *_pop ones time the waits for work, the *_push ones the waits for
+		 * room, so their sums per second tell which stage holds the rest up.
+		 */
+		struct stage_metrics {
+			stage_metrics() :
+				seeds_pop(tools::metrics::global().histogram("seeds_pop_ns")),
+				candidates_pop(tools::metrics::global().histogram("candidates_pop_ns")),
+				resps_pop(tools::metrics::global().histogram("resps_pop_ns")),
+				candidates_push(tools::metrics::global().histogram("candidates_push_ns")),
+				resps_push(tools::metrics::global().histogram("resps_push_ns")),
+				parse_per_kb(tools::metrics::global().histogram("parse_per_kb_ns")),
+				requested(tools::metrics::global().counter("requested")),
+				bad_responses(tools::metrics::global().counter("bad_responses")),
+				dropped_responses(tools::metrics::global().counter("dropped_responses")),
+				links(tools::metrics::global().counter("links_found")),
+				passed(tools::metrics::global().counter("filter_passed")),
+				rejected(tools::metrics::global().counter("filter_rejected")) { }
+
+			tools::histogram& seeds_pop;
+			tools::histogram& candidates_pop;
+			tools::histogram& resps_pop;
+			tools::histogram& candidates_push;
+			tools::histogram& resps_push;
+			tools::histogram& parse_per_kb;
+			tools::counter&   requested;
+			tools::counter&   bad_responses;
+			tools::counter&   dropped_responses;
+			tools::counter&   links;
+			tools::counter&   passed;
+			tools::counter&   rejected;
+		};
+
+		static stage_metrics& _metrics() {
+			static stage_metrics instance;
+			return instance;
+		}
+
+		/*
+		 * the values the rates of a stats line are taken against.
+		 */
+		struct stats_mark {
+			stats_mark() :
+				time(std::chrono::steady_clock::now()),
+				requested(_metrics().requested.value()),
+				completed(tools::metrics::global().counter("http_completed").value()),
+				bytes(tools::metrics::global().counter("http_read_bytes").value()),
+				passed(_metrics().passed.value()),
+				rejected(_metrics().rejected.value())
+			{
+				const char* names[] = {
+					"seeds_pop_ns", "candidates_pop_ns", "resps_pop_ns", "candidates_push_ns", "resps_push_ns",
+					"http_dns_ns", "http_connect_ns", "http_ttfb_ns", "http_download_ns", "parse_per_kb_ns"
+				};
+				for (size_t i = 0; i < timed; ++i) { times[i] = tools::metrics::global().histogram(names[i]).read(); }
+			}
+
+			static const size_t timed = 10u;
+
+			std::chrono::steady_clock::time_point time;
+			uint64_t                              requested;
+			uint64_t                              completed;
+			uint64_t                              bytes;
+			uint64_t                              passed;
+			uint64_t                              rejected;
+			tools::histogram::snapshot            times[timed];
+		};
+
+		/*
+		 * @note  the queues, then the rates since the line before, the
+		 *        seconds per second spent waiting on each queue, and the
+		 *        p50/p99 of the network steps in ms.
+		 */
+		std::string _stats_line() {
+			stats_mark now;
+			const stats_mark& last = m_last_stats;
+
+			double seconds = std::chrono::duration<double>(now.time - last.time).count();
+			if (!(0.0 < seconds)) { seconds = 1.0; }
+
+			tools::histogram::snapshot times[stats_mark::timed];
+			for (size_t i = 0; i < stats_mark::timed; ++i) { times[i] = now.times[i].since(last.times[i]); }
+
+			uint64_t filtered = (now.passed - last.passed) + (now.rejected - last.rejected);
+
+			auto busy = [seconds](const tools::histogram::snapshot& values) {
+				return _format(values.sum / 1e9 / seconds, 2);
+			};
+			auto ms = [](const tools::histogram::snapshot& values) {
+				return _format(values.percentile(0.5) / 1e6, 1) + "/" + _format(values.percentile(0.99) / 1e6, 1);
+			};
+
+			std::string line =
+				"queues seeds " + std::to_string(m_seeds.size()) + 
+				", candidates " + std::to_string(m_candidates.size()) + 
+				", resps " + std::to_string(m_resps.size()) + 
+				", frontier " + std::to_string(m_frontier->size()) + 
+				", in flight " + std::to_string(m_pending.size()) + 
+				" | pages/s " + _format((now.completed - last.completed) / seconds, 1) + 
+				", requests/s " + _format((now.requested - last.requested) / seconds, 1) + 
+				", MB/s " + _format((now.bytes - last.bytes) / seconds / (1 << 20), 2) + 
+				", filter pass " + _format(0 == filtered ? 0.0 : 100.0 * (now.passed - last.passed) / filtered, 1) + "%" +
+				" | waiting s/s seeds " + busy(times[0]) + 
+				", candidates " + busy(times[1]) + 
+				", resps " + busy(times[2]) + 
+				", blocked s/s candidates " + busy(times[3]) + 
+				", resps " + busy(times[4]) + 
+				" | ms p50/p99 dns " + ms(times[5]) + 
+				", connect " + ms(times[6]) + 
+				", ttfb " + ms(times[7]) + 
+				", download " + ms(times[8]) + 
+				", parse us/KB " + _format(times[9].percentile(0.5) / 1e3, 1);
+
+			m_last_stats = now;
+			return line;
+		}
+
+		std::string _stats_page() {
+			std::ostringstream page;
+			page << "queue_seeds " << m_seeds.size() << '\n'
+			     << "queue_candidates " << m_candidates.size() << '\n'
+			     << "queue_resps " << m_resps.size() << '\n'
+			     << "frontier_urls " << m_frontier->size() << '\n'
+			     << "pending_urls " << m_pending.size() << '\n';
+			tools::metrics::global().render(page);
+			return page.str();
+		}
+
+		static std::string _format(double value, int precision) {
+			std::ostringstream out;
+			out.setf(std::ios::fixed);
+			out.precision(precision);
+			out << value;
+			return out.str();
+		}
+
+		static const std::string& _make_dir(const std::string& dir) {
+			std::error_code ignored;
+			std::filesystem::create_directories(dir, ignored);
+			return dir;
+		}
+
+		/*
+		 * @note  removes the checkpoint, the images, the segments and the
+		 *        spilled partitions of an exact_filter in state_dir.
+		 */
+		static void _clear_state() {
+			std::error_code ignored;
+			std::filesystem::remove(state_dir + "/" + checkpointer::manifest_name, ignored);
+
+			for (std::filesystem::directory_iterator itr(state_dir, ignored), end; itr != end; itr.increment(ignored)) {
+				const auto name = itr->path().filename().string();
+				if ((0 == name.compare(0, 6, "bloom-") && name.size() > 4 && 0 == name.compare(name.size() - 4, 4, ".bin")) ||
+				    (0 == name.compare(0, 9, "frontier-") && name.size() > 4 && 0 == name.compare(name.size() - 4, 4, ".seg")) ||
+				    (0 == name.compare(0, 5, "seen-") && name.size() > 4 && 0 == name.compare(name.size() - 4, 4, ".bin"))
+				) {
+					std::filesystem::remove(itr->path(), ignored);
+				}
+			}
 		}
 
 		static bool _valid_url(const std::string& url) {
@@ -292,24 +998,71 @@ namespace crawler {
 
 	public:
 		static const std::string default_output_path;
+		/* the frontier segments and the checkpoints */
+		static const std::string state_dir;
+
+		static const std::chrono::seconds default_checkpoint_interval;
+
+		static const unsigned short            default_stats_port = 9188u;
+		static const std::chrono::milliseconds stats_interval;
+
+		static const size_t default_max_total = 10000u;
+
+		static const size_t                    default_host_concurrency = 2u;
+		static const std::chrono::milliseconds default_host_delay;
 
 	private:
-		static const size_t max_total_seeds = 10000u;
+		static const size_t max_in_flight = 1024u;
 
 		static const size_t max_seeds      = 1024u;
 		static const size_t max_candidates = 4096u;
-		static const size_t max_resps      = 256u;
+		/* the requests in flight and the responses queued, see _handle_resp */
+		static const size_t max_resps      = max_in_flight;
 
-		static const size_t max_threads = 32u;
+		static const size_t max_scheduled    = 4096u;
+		static const size_t max_host_backlog = 64u;
+
+		static const size_t filter_batch    = 256u;
+		static const size_t filter_capacity = 1u << 20;
+		static const double filter_fp_rate;
 
 		static const std::chrono::seconds timeout_20s;
 		static const std::chrono::seconds timeout_1s;
+		static const std::chrono::seconds timeout_0s;
+
+		static const std::chrono::milliseconds timeout_50ms;
+
+		priority_ptr     m_priority;
+
+		seeds_queue_type m_seeds;
+		queue_type       m_candidates;
+		queue_type       m_resps;
 
-		queue_type  m_seeds;
-		queue_type  m_candidates;
-		queue_type  m_resps;
+		std::unique_ptr<frontier>              m_frontier;
+		filter_ptr                             m_filter;
+		pending_urls                           m_pending;
+		requested_urls                         m_requested_urls;
+		std::atomic<size_t>                    m_requested;
+
+		/* pushed to the frontier on run() unless resumed */
+		std::vector<std::string> m_seed_urls;
 
 		std::string m_output_path;
+		size_t      m_max_total;
+
+		size_t                    m_host_concurrency;
+		std::chrono::milliseconds m_host_delay;
+
+		std::chrono::seconds m_checkpoint_interval;
+		size_t               m_session;
+		bool                 m_resumed;
+
+		unsigned short       m_stats_port;
+		/* used by the stats thread only */
+		stats_mark           m_last_stats;
+
+		/* made by run(), written by the analyze tasks */
+		std::unique_ptr<link_graph> m_graph;
 
 		std::thread m_thd_analyze;
 		std::thread m_thd_filter;
@@ -318,9 +1071,21 @@ namespace crawler {
 	};
 
 	const std::string core::default_output_path("out.txt");
+	const std::string core::state_dir("crawl_state");
+
+	const std::chrono::seconds core::default_checkpoint_interval(60);
+
+	const std::chrono::milliseconds core::stats_interval(10000);
 
 	const std::chrono::seconds core::timeout_20s(20);
 	const std::chrono::seconds core::timeout_1s(1);
+	const std::chrono::seconds core::timeout_0s(0);
+
+	const std::chrono::milliseconds core::timeout_50ms(50);
+
+	const std::chrono::milliseconds core::default_host_delay(100);
+
+	const double core::filter_fp_rate(0.0001);
 }
 
 #endif
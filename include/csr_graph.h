@@ -0,0 +1,337 @@
+#ifndef _CRAWLER_CSR_GRAPH_H_
+#define _CRAWLER_CSR_GRAPH_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <string_view>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <debug.h>
+
+namespace crawler {
+
+	/*
+	 * The link graph in compressed sparse row form, mapped from a file and
+	 * used in place: nothing is parsed or copied on open. The out links of
+	 * url i are targets[out_offsets[i], out_offsets[i + 1]), sorted, the in
+	 * links the same with the sources, and its url is the bytes between
+	 * url_offsets[i] and url_offsets[i + 1].
+	 *
+	 *   header       magic "crawlcsr", version, nodes, edges, and the
+	 *                offset of each section in the file
+	 *   out_offsets  u64 * (nodes + 1)
+	 *   targets      u32 * edges
+	 *   in_offsets   u64 * (nodes + 1)
+	 *   sources      u32 * edges
+	 *   url_offsets  u64 * (nodes + 1)
+	 *   urls         the url bytes
+	 *
+	 * The sections are 8-byte aligned, the numbers in the byte order of the
+	 * machine which wrote the file (as for the filter image).
+	 */
+	class csr_graph {
+
+		typedef csr_graph self_type;
+
+	public:
+		static const uint32_t version = 1u;
+
+		/* the links of an url, a range of ids */
+		class neighbors {
+		public:
+			neighbors(const uint32_t* first, const uint32_t* last) : m_first(first), m_last(last) { }
+
+			const uint32_t* begin() const { return m_first; }
+			const uint32_t* end() const { return m_last; }
+			size_t size() const { return m_last - m_first; }
+			bool empty() const { return m_first == m_last; }
+			uint32_t operator[](size_t i) const { return m_first[i]; }
+
+		private:
+			const uint32_t* m_first;
+			const uint32_t* m_last;
+		};
+
+		/* uncopyable */
+		csr_graph(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @ret  nullptr if path is not a graph of this version, or is cut.
+		 */
+		static std::unique_ptr<self_type> open(const std::string& path) {
+			std::unique_ptr<boost::interprocess::mapped_region> region;
+			try {
+				boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+				region.reset(new boost::interprocess::mapped_region(file, boost::interprocess::read_only));
+			}
+			catch (const std::exception& error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "csr_graph", error.what(), ": ", path);
+				return nullptr;
+			}
+
+			const auto base = static_cast<const char*>(region->get_address());
+			const auto size = static_cast<uint64_t>(region->get_size());
+
+			header head;
+			if (size < sizeof (head)) { return _broken(path); }
+			memcpy(&head, base, sizeof (head));
+
+			if (0 != memcmp(head.magic, magic, sizeof (head.magic)) || version != head.version) { return _broken(path); }
+
+			const uint64_t offsets = (head.nodes + 1) * sizeof (uint64_t);
+			const uint64_t ids     = head.edges * sizeof (uint32_t);
+
+			if (!_fits(head.out_offsets, offsets, size) || !_fits(head.targets, ids, size) ||
+				!_fits(head.in_offsets, offsets, size) || !_fits(head.sources, ids, size) ||
+				!_fits(head.url_offsets, offsets, size) || !_fits(head.urls, 0, size)
+			) {
+				return _broken(path);
+			}
+
+			std::unique_ptr<self_type> result(new self_type());
+			result->m_nodes       = head.nodes;
+			result->m_edges       = head.edges;
+			result->m_out_offsets = reinterpret_cast<const uint64_t*>(base + head.out_offsets);
+			result->m_targets     = reinterpret_cast<const uint32_t*>(base + head.targets);
+			result->m_in_offsets  = reinterpret_cast<const uint64_t*>(base + head.in_offsets);
+			result->m_sources     = reinterpret_cast<const uint32_t*>(base + head.sources);
+			result->m_url_offsets = reinterpret_cast<const uint64_t*>(base + head.url_offsets);
+			result->m_urls        = base + head.urls;
+
+			/* the ends of the sections, the offsets in between are trusted */
+			if (head.edges != result->m_out_offsets[head.nodes] ||
+				head.edges != result->m_in_offsets[head.nodes] ||
+				size - head.urls < result->m_url_offsets[head.nodes]
+			) {
+				return _broken(path);
+			}
+
+			result->m_region = std::move(region);
+			return result;
+		}
+
+		/*
+		 * @param text_path  url.txt: "<id> <url>" lines, an empty line, then
+		 *                   "<src> <dst>" lines. A '\r' ending a line is
+		 *                   dropped, an id without url line has an empty
+		 *                   url. An id which does not fit in 32 bits fails
+		 *                   the conversion.
+		 * @param csr_path   the graph file.
+		 */
+		static bool convert(const std::string& text_path, const std::string& csr_path) {
+			std::ifstream in(text_path, std::ios::binary);
+			if (!in) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "csr_graph", "Failed to open ", text_path);
+				return false;
+			}
+
+			std::vector<std::pair<uint32_t, std::string>> urls;
+			std::vector<std::pair<uint32_t, uint32_t>>    links;
+			uint64_t nodes = 0;
+
+			std::string line;
+			bool in_edges = false;
+
+			while (std::getline(in, line)) {
+				if (!line.empty() && '\r' == line.back()) { line.pop_back(); }
+				if (line.empty()) { in_edges = true; continue; }
+
+				char* end = nullptr;
+				uint32_t first;
+				if (!_id(line.c_str(), end, first)) { return _bad_id(text_path, line); }
+				if (' ' != *end) { continue; }
+
+				if (!in_edges) {
+					urls.emplace_back(first, std::string(end + 1));
+					nodes = std::max<uint64_t>(nodes, uint64_t(first) + 1);
+					continue;
+				}
+
+				uint32_t second;
+				if (!_id(end + 1, end, second)) { return _bad_id(text_path, line); }
+				links.emplace_back(first, second);
+				nodes = std::max<uint64_t>(nodes, uint64_t(std::max(first, second)) + 1);
+			}
+
+			header head;
+			memset(&head, 0, sizeof (head));
+			memcpy(head.magic, magic, sizeof (head.magic));
+			head.version = version;
+			head.nodes   = nodes;
+
+			std::ofstream out(csr_path, std::ios::binary | std::ios::trunc);
+			uint64_t at = sizeof (head);
+			out.seekp(static_cast<std::streamoff>(at));
+
+			auto section = [&out, &at](const void* data, uint64_t bytes) {
+				out.write(static_cast<const char*>(data), bytes);
+				uint64_t start = at;
+				at += bytes;
+				while (0 != at % 8) { out.put('\0'); ++at; }
+				return start;
+			};
+
+			std::vector<uint64_t> offsets;
+			std::vector<uint32_t> ids;
+
+			/* by source, then by target: the out links */
+			std::sort(links.begin(), links.end());
+			links.erase(std::unique(links.begin(), links.end()), links.end());
+			head.edges = links.size();
+			_rows(links, nodes, offsets, ids, false);
+			head.out_offsets = section(offsets.data(), offsets.size() * sizeof (uint64_t));
+			head.targets     = section(ids.data(), ids.size() * sizeof (uint32_t));
+
+			std::sort(links.begin(), links.end(), [](const auto& a, const auto& b) {
+				return a.second != b.second ? a.second < b.second : a.first < b.first;
+			});
+			_rows(links, nodes, offsets, ids, true);
+			head.in_offsets = section(offsets.data(), offsets.size() * sizeof (uint64_t));
+			head.sources    = section(ids.data(), ids.size() * sizeof (uint32_t));
+
+			std::vector<std::pair<uint32_t, uint32_t>>().swap(links);
+			std::vector<uint32_t>().swap(ids);
+
+			std::stable_sort(urls.begin(), urls.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+			offsets.assign(nodes + 1, 0);
+			std::string bytes;
+			for (uint64_t id = 0, next = 0; id < nodes; ++id) {
+				/* an id listed twice keeps its first url */
+				while (next < urls.size() && urls[next].first < id) { ++next; }
+				if (next < urls.size() && urls[next].first == id) { bytes.append(urls[next].second); }
+				offsets[id + 1] = bytes.size();
+			}
+			head.url_offsets = section(offsets.data(), offsets.size() * sizeof (uint64_t));
+			head.urls        = section(bytes.data(), bytes.size());
+
+			out.seekp(0);
+			out.write(reinterpret_cast<const char*>(&head), sizeof (head));
+			out.flush();
+
+			if (!out) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "csr_graph", "Failed to write ", csr_path);
+				return false;
+			}
+			return true;
+		}
+
+		uint64_t nodes() const { return m_nodes; }
+		uint64_t edges() const { return m_edges; }
+
+		std::string_view url(uint32_t id) const {
+			return std::string_view(m_urls + m_url_offsets[id], m_url_offsets[id + 1] - m_url_offsets[id]);
+		}
+
+		/* the urls id links to, sorted */
+		neighbors out(uint32_t id) const {
+			return neighbors(m_targets + m_out_offsets[id], m_targets + m_out_offsets[id + 1]);
+		}
+
+		/* the urls linking to id, sorted */
+		neighbors in(uint32_t id) const {
+			return neighbors(m_sources + m_in_offsets[id], m_sources + m_in_offsets[id + 1]);
+		}
+
+		bool has_edge(uint32_t src, uint32_t dst) const {
+			auto links = this->out(src);
+			return std::binary_search(links.begin(), links.end(), dst);
+		}
+
+	private:
+		static inline constexpr char magic[8] = { 'c', 'r', 'a', 'w', 'l', 'c', 's', 'r' };
+
+		struct header {
+			char     magic[8];
+			uint32_t version;
+			uint32_t reserved;
+			uint64_t nodes;
+			uint64_t edges;
+			uint64_t out_offsets;
+			uint64_t targets;
+			uint64_t in_offsets;
+			uint64_t sources;
+			uint64_t url_offsets;
+			uint64_t urls;
+		};
+
+		csr_graph() :
+			m_nodes(0), m_edges(0),
+			m_out_offsets(nullptr), m_targets(nullptr),
+			m_in_offsets(nullptr), m_sources(nullptr),
+			m_url_offsets(nullptr), m_urls(nullptr) { }
+
+		static bool _fits(uint64_t offset, uint64_t bytes, uint64_t size) {
+			return 0 == offset % 8 && offset <= size && bytes <= size - offset;
+		}
+
+		static std::unique_ptr<self_type> _broken(const std::string& path) {
+			CRAWLER_LOG(tools::debug_type::FATAL, "csr_graph", "Not a graph or cut: ", path);
+			return nullptr;
+		}
+
+		/*
+		 * @param end  set to the first char after the number.
+		 * @note       false if the number is not in [0, 2^32).
+		 */
+		static bool _id(const char* text, char*& end, uint32_t& id) {
+			errno = 0;
+			auto value = std::strtoul(text, &end, 10);
+			if (ERANGE == errno || std::numeric_limits<uint32_t>::max() < value || '-' == *text) { return false; }
+			id = static_cast<uint32_t>(value);
+			return true;
+		}
+
+		static bool _bad_id(const std::string& path, const std::string& line) {
+			CRAWLER_LOG(tools::debug_type::FATAL, "csr_graph", "Id out of range in ", path, ": ", line);
+			return false;
+		}
+
+		/*
+		 * @param links    sorted by the row (source, or target if reverse).
+		 * @note           the row offsets and the other ends, in order.
+		 */
+		static void _rows(
+			const std::vector<std::pair<uint32_t, uint32_t>>& links,
+			uint64_t                                          nodes,
+			std::vector<uint64_t>&                            offsets,
+			std::vector<uint32_t>&                            ids,
+			bool                                              reverse
+		) {
+			offsets.assign(nodes + 1, 0);
+			ids.resize(links.size());
+
+			for (size_t i = 0; i < links.size(); ++i) {
+				const auto row = reverse ? links[i].second : links[i].first;
+				ids[i] = reverse ? links[i].first : links[i].second;
+				++offsets[row + 1];
+			}
+			for (uint64_t i = 0; i < nodes; ++i) { offsets[i + 1] += offsets[i]; }
+		}
+
+	private:
+		std::unique_ptr<boost::interprocess::mapped_region> m_region;
+
+		uint64_t        m_nodes;
+		uint64_t        m_edges;
+		const uint64_t* m_out_offsets;
+		const uint32_t* m_targets;
+		const uint64_t* m_in_offsets;
+		const uint32_t* m_sources;
+		const uint64_t* m_url_offsets;
+		const char*     m_urls;
+	};
+}
+
+#endif
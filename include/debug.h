@@ -1,60 +1,383 @@
 #ifndef _CRAWLER_DEBUG_H_
 #define _CRAWLER_DEBUG_H_
 
-#include <iostream>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+#include <condition_variable>
 
-#include <consoleapi2.h>
-#include <winbase.h>
+/*
+ * the lowest level compiled in: 0 for INFO, 1 for WARNING, 2 for FATAL.
+ * The CRAWLER_LOG calls below it are not compiled, their arguments are
+ * not evaluated either.
+ */
+#ifndef _CRAWLER_LOG_LEVEL_
+#define _CRAWLER_LOG_LEVEL_ 0
+#endif
 
 namespace tools {
-	
-	static std::mutex stdout_mutex;
 
 	enum class debug_type {
 		INFO, WARNING, FATAL
 	};
 
-	inline void log(
-		debug_type         type, 
-		const std::string& method, 
-		const std::string& message
-	) {
-		std::lock_guard<std::mutex> locker(stdout_mutex);
+	/* false if the level is below _CRAWLER_LOG_LEVEL_ */
+	constexpr bool log_compiled(debug_type type) {
+		return static_cast<int>(type) >= _CRAWLER_LOG_LEVEL_;
+	}
+
+	/*
+	 * An asynchronous logger. Every thread which logs gets a ring of
+	 * records of its own (single producer, single consumer, no lock), the
+	 * caller copies the pieces of its message into a record and returns.
+	 * A background thread takes the records of all the rings every
+	 * flush_interval, orders them by time, formats the time, level and
+	 * thread in front of them and writes them to stdout at once, so the
+	 * threads logging never wait for each other nor for a syscall.
+	 *
+	 * When the ring of a thread is full, its INFO and WARNING records are
+	 * dropped and counted, FATAL ones wait for room. A message longer
+	 * than a record is cut.
+	 */
+	class logger {
+
+		typedef logger self_type;
+
+	public:
+		typedef std::chrono::system_clock clock_type;
+
+		static const size_t record_bytes = 512u;
+		static const size_t ring_records = 256u;
+
+		static inline const std::chrono::milliseconds flush_interval{ 20 };
+
+		struct record {
+			clock_type::time_point time;
+			debug_type             type;
+			uint32_t               length;
+			char                   text[record_bytes - sizeof (clock_type::time_point) - 2 * sizeof (uint32_t)];
+		};
+
+		static self_type& instance() {
+			static self_type logger;
+			return logger;
+		}
+
+		~logger() {
+			{
+				std::lock_guard<std::mutex> locker(m_mutex);
+				m_stopped = true;
+			}
+			m_wake.notify_one();
+			if (m_writer.joinable()) { m_writer.join(); }
+		}
+
+		/* uncopyable */
+		logger(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/* the lowest level written from now on */
+		void level(debug_type type) { m_level.store(static_cast<int>(type), std::memory_order_relaxed); }
+
+		bool enabled(debug_type type) const {
+			return log_compiled(type) && static_cast<int>(type) >= m_level.load(std::memory_order_relaxed);
+		}
+
+		/*
+		 * @note  the record of the calling thread, to be filled and then
+		 *        committed, nullptr if the ring is full and type is not
+		 *        FATAL.
+		 */
+		record* prepare(debug_type type) {
+			auto& target = this->_ring();
+
+			size_t head = target.head.load(std::memory_order_relaxed);
+			while (ring_records <= head - target.tail.load(std::memory_order_acquire)) {
+				if (debug_type::FATAL != type) {
+					target.dropped.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				m_wake.notify_one();
+				std::this_thread::yield();
+			}
+
+			auto& result = target.records[head % ring_records];
+			result.time   = clock_type::now();
+			result.type   = type;
+			result.length = 0;
+			return &result;
+		}
+
+		void commit(record& filled) {
+			auto& target = this->_ring();
+			size_t head = target.head.load(std::memory_order_relaxed) + 1;
+			target.head.store(head, std::memory_order_release);
+
+			/* the writer is woken early only when the ring fills up, or for a fatal */
+			if (debug_type::FATAL == filled.type || ring_records / 2 == head - target.tail.load(std::memory_order_relaxed)) {
+				m_wake.notify_one();
+			}
+		}
+
+		/*
+		 * @note  blocks until what was logged before is written.
+		 */
+		void flush() {
+			std::unique_lock<std::mutex> locker(m_mutex);
+			size_t target = m_rounds + 2;
+			m_wake.notify_one();
+			m_written.wait(locker, [this, target]() { return target <= m_rounds || m_stopped; });
+		}
+
+	private:
+		struct alignas(64) ring {
+			ring() : head(0), tail(0), dropped(0), retired(false) { }
+
+			alignas(64) std::atomic<size_t> head;
+			alignas(64) std::atomic<size_t> tail;
+			std::atomic<size_t>             dropped;
+			std::atomic<bool>               retired;
+			std::string                     thread;
+			record                          records[ring_records];
+		};
+
+		typedef std::shared_ptr<ring> ring_ptr;
+
+		/* marks the ring of a thread retired when the thread ends */
+		struct ring_handle {
+			~ring_handle() { if (nullptr != target) { target->retired.store(true); } }
+			ring_ptr target;
+		};
+
+		logger() :
+			m_level(0),
+			m_stopped(false),
+			m_rounds(0),
+			m_writer(&self_type::_write_loop, this) { }
+
+		ring& _ring() {
+			thread_local ring_handle handle;
+
+			if (nullptr == handle.target) {
+				handle.target = std::make_shared<ring>();
+
+				std::ostringstream id;
+				id << std::this_thread::get_id();
+				handle.target->thread = id.str();
+
+				std::lock_guard<std::mutex> locker(m_mutex);
+				m_rings.push_back(handle.target);
+			}
+
+			return *handle.target;
+		}
+
+		void _write_loop() {
+			std::vector<ring_ptr> rings;
+			std::vector<std::pair<const record*, const ring*>> pending;
+			std::string out;
 
-		switch (type) {
-			case debug_type::INFO : {
-				SetConsoleTextAttribute(
-					GetStdHandle(STD_OUTPUT_HANDLE), 
-					FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE
-				);
-				break;
+			while (true) {
+				bool stopped;
+				{
+					std::unique_lock<std::mutex> locker(m_mutex);
+					m_wake.wait_for(locker, flush_interval);
+					stopped = m_stopped;
+
+					/* the rings of the threads gone are dropped once read */
+					rings.assign(m_rings.begin(), m_rings.end());
+					m_rings.erase(
+						std::remove_if(m_rings.begin(), m_rings.end(), [](const ring_ptr& each) {
+							return each->retired.load() && each->head.load() == each->tail.load();
+						}),
+						m_rings.end()
+					);
+				}
+
+				this->_write(rings, pending, out);
+
+				{
+					std::lock_guard<std::mutex> locker(m_mutex);
+					++m_rounds;
+				}
+				m_written.notify_all();
+
+				if (stopped) { break; }
+			}
+		}
+
+		void _write(
+			const std::vector<ring_ptr>&                        rings,
+			std::vector<std::pair<const record*, const ring*>>& pending,
+			std::string&                                        out
+		) {
+			pending.clear();
+			out.clear();
+
+			std::vector<size_t> heads(rings.size());
+			for (size_t i = 0; i < rings.size(); ++i) {
+				auto& each = *rings[i];
+				heads[i] = each.head.load(std::memory_order_acquire);
+				for (size_t at = each.tail.load(std::memory_order_relaxed); at != heads[i]; ++at) {
+					pending.emplace_back(&each.records[at % ring_records], &each);
+				}
+
+				size_t dropped = each.dropped.exchange(0, std::memory_order_relaxed);
+				if (0 != dropped) {
+					out.append("[").append(each.thread).append("]\tlogger: ")
+					   .append(std::to_string(dropped)).append(" messages dropped\n");
+				}
+			}
+
+			std::stable_sort(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+				return a.first->time < b.first->time;
+			});
+
+			for (const auto& each : pending) { _format(*each.first, each.second->thread, out); }
+
+			/* the records are free once formatted */
+			for (size_t i = 0; i < rings.size(); ++i) {
+				rings[i]->tail.store(heads[i], std::memory_order_release);
 			}
 
-			case debug_type::WARNING : {
-				SetConsoleTextAttribute(
-					GetStdHandle(STD_OUTPUT_HANDLE),
-					FOREGROUND_INTENSITY | FOREGROUND_BLUE
-				);
-				break;
+			if (!out.empty()) {
+				std::fwrite(out.data(), 1, out.length(), stdout);
+				std::fflush(stdout);
 			}
+		}
+
+		/*
+		 * @note  "<time> <level> [<thread>]\t<method>: <message>", the time
+		 *        in UTC. Called by the writer thread only.
+		 */
+		static void _format(const record& entry, const std::string& thread, std::string& out) {
+			static const char* names[] = { "INFO ", "WARN ", "FATAL" };
+
+			auto seconds = clock_type::to_time_t(entry.time);
+			auto millis  = std::chrono::duration_cast<std::chrono::milliseconds>(
+				entry.time.time_since_epoch()
+			).count() % 1000;
+
+			char stamp[32];
+			size_t length = std::strftime(stamp, sizeof (stamp), "%Y-%m-%d %H:%M:%S", std::gmtime(&seconds));
+			std::snprintf(stamp + length, sizeof (stamp) - length, ".%03d ", static_cast<int>(millis));
+
+			out.append(stamp)
+			   .append(names[static_cast<int>(entry.type)])
+			   .append(" [").append(thread).append("]\t")
+			   .append(entry.text, entry.length)
+			   .append("\n");
+		}
+
+	private:
+		std::atomic<int>        m_level;
 
-			case debug_type::FATAL: {
-				SetConsoleTextAttribute(
-					GetStdHandle(STD_OUTPUT_HANDLE),
-					FOREGROUND_INTENSITY | FOREGROUND_RED
-				);
-				break;
+		std::mutex              m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_written;
+		std::vector<ring_ptr>   m_rings;
+		bool                    m_stopped;
+		size_t                  m_rounds;
+
+		std::thread             m_writer;
+	};
+
+	/*
+	 * appends the pieces of a message to a record, the numbers are
+	 * formatted here, the rest (time, level, thread) by the writer.
+	 */
+	class log_builder {
+	public:
+		explicit log_builder(logger::record& target) : m_target(target) { }
+
+		log_builder& operator<<(std::string_view text) {
+			const size_t room = sizeof (m_target.text) - m_target.length;
+			if (text.length() <= room) {
+				memcpy(m_target.text + m_target.length, text.data(), text.length());
+				m_target.length += static_cast<uint32_t>(text.length());
+			}
+			else if (3 <= room) {
+				memcpy(m_target.text + m_target.length, text.data(), room - 3);
+				memcpy(m_target.text + sizeof (m_target.text) - 3, "...", 3);
+				m_target.length = static_cast<uint32_t>(sizeof (m_target.text));
 			}
+			return *this;
+		}
+
+		log_builder& operator<<(const std::string& text) { return *this << std::string_view(text); }
+		log_builder& operator<<(const char* text) { return *this << std::string_view(text); }
+
+		log_builder& operator<<(char each) { return *this << std::string_view(&each, 1); }
 
-			default : { }
+		log_builder& operator<<(bool value) { return *this << (value ? "true" : "false"); }
+
+		template <typename _Tp>
+		typename std::enable_if<std::is_arithmetic<_Tp>::value, log_builder&>::type operator<<(_Tp value) {
+			char digits[32];
+			int  length;
+			if (std::is_floating_point<_Tp>::value) {
+				length = std::snprintf(digits, sizeof (digits), "%g", static_cast<double>(value));
+			}
+			else if (std::is_signed<_Tp>::value) {
+				length = std::snprintf(digits, sizeof (digits), "%lld", static_cast<long long>(value));
+			}
+			else {
+				length = std::snprintf(digits, sizeof (digits), "%llu", static_cast<unsigned long long>(value));
+			}
+			return *this << std::string_view(digits, 0 < length ? length : 0);
 		}
 
-		std::cout << "[" << std::this_thread::get_id() << "]\t" 
-		          << method << ": " 
-		          << message << std::endl;
+	private:
+		logger::record& m_target;
+	};
+
+	/*
+	 * @param method  where the message comes from.
+	 * @param pieces  strings and numbers, written one after another. Pass
+	 *                them apart rather than concatenated, they are then
+	 *                only copied, and not at all below the level.
+	 * @note          called through CRAWLER_LOG, which drops the levels not
+	 *                compiled in.
+	 */
+	template <typename... _Pieces>
+	inline void log(debug_type type, std::string_view method, const _Pieces&... pieces) {
+		auto& target = logger::instance();
+		if (!target.enabled(type)) { return; }
+
+		auto entry = target.prepare(type);
+		if (nullptr == entry) { return; }
+
+		log_builder builder(*entry);
+		builder << method << ": ";
+		(void)std::initializer_list<int>{ ((void)(builder << pieces), 0)... };
+
+		target.commit(*entry);
 	}
+
+	/* the lowest level logged from now on */
+	inline void log_level(debug_type type) { logger::instance().level(type); }
+
+	/* blocks until everything logged before is written */
+	inline void flush_log() { logger::instance().flush(); }
 }
 
-#endif
\ No newline at end of file
+/*
+ * tools::log if type is compiled in (see _CRAWLER_LOG_LEVEL_), else
+ * nothing, the pieces are not built. type is a constant.
+ */
+#define CRAWLER_LOG(type, ...) \
+	do { if constexpr (tools::log_compiled(type)) { tools::log(type, __VA_ARGS__); } } while (false)
+
+#endif
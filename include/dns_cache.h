@@ -0,0 +1,196 @@
+#ifndef _CRAWLER_DNS_CACHE_H_
+#define _CRAWLER_DNS_CACHE_H_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/asio.hpp>
+
+namespace crawler {
+
+	/*
+	 * In-process cache of resolved hosts. Successful lookups are kept for
+	 * ttl and failed ones for negative_ttl (the system resolver does not
+	 * report the record ttl). Concurrent lookups of the same host share a
+	 * single asynchronous resolve.
+	 */
+	class dns_cache {
+
+		typedef dns_cache self_type;
+
+	public:
+		typedef boost::asio::ip::tcp::resolver                resolver_type;
+		typedef resolver_type::results_type                   results_type;
+		typedef std::function<
+			void(const boost::system::error_code&, const results_type&)
+		>                                                     handler_type;
+		typedef std::chrono::steady_clock                     clock_type;
+
+		static const std::chrono::seconds default_ttl;
+		static const std::chrono::seconds default_negative_ttl;
+
+		explicit dns_cache(
+			std::chrono::seconds ttl          = default_ttl,
+			std::chrono::seconds negative_ttl = default_negative_ttl
+		) :
+			m_ttl(ttl),
+			m_negative_ttl(negative_ttl),
+			m_inserts(0),
+			m_hits(0),
+			m_misses(0),
+			m_coalesced(0) { }
+
+		/* uncopyable */
+		dns_cache(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @param context  the handler is always invoked through this context.
+		 * @param host     the host name to resolve.
+		 * @param service  the service name or port number.
+		 * @param handler  void(const error_code&, const results_type&).
+		 */
+		void async_resolve(
+			boost::asio::io_context& context,
+			const std::string&       host,
+			const std::string&       service,
+			handler_type             handler
+		) {
+			auto key = host + ':' + service;
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+
+			auto& entry = m_entries[key];
+
+			if (entry.resolving) {
+				entry.waiters.push_back({ &context, std::move(handler) });
+				++m_coalesced;
+				return;
+			}
+
+			if (clock_type::now() < entry.expires) {
+				auto err     = entry.error;
+				auto results = entry.results;
+				locker.unlock();
+
+				++m_hits;
+				boost::asio::post(context, std::bind(std::move(handler), err, results));
+				return;
+			}
+
+			++m_misses;
+			entry.resolving = true;
+			entry.waiters.push_back({ &context, std::move(handler) });
+
+			if (0 == ++m_inserts % sweep_interval) { _evict_expired(); }
+			locker.unlock();
+
+			auto resolver = std::make_shared<resolver_type>(context);
+			resolver->async_resolve(
+				host,
+				service,
+				[this, key, resolver](
+					const boost::system::error_code& err, const results_type& results
+				) {
+					this->_handle_resolve(key, err, results);
+				}
+			);
+		}
+
+		size_t hits() const { return m_hits; }
+		size_t misses() const { return m_misses; }
+
+		/* lookups which waited for a resolve already in progress */
+		size_t coalesced() const { return m_coalesced; }
+
+		size_t size() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_entries.size();
+		}
+
+		void clear() {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			for (auto itr = m_entries.begin(); m_entries.end() != itr; ) {
+				itr = itr->second.resolving ? std::next(itr) : m_entries.erase(itr);
+			}
+		}
+
+	private:
+		struct waiter {
+			boost::asio::io_context* context;
+			handler_type             handler;
+		};
+
+		struct entry {
+			entry() : resolving(false) { }
+
+			bool                      resolving;
+			clock_type::time_point    expires;
+			boost::system::error_code error;
+			results_type              results;
+			std::vector<waiter>       waiters;
+		};
+
+		void _handle_resolve(
+			const std::string&               key,
+			const boost::system::error_code& err,
+			const results_type&              results
+		) {
+			std::vector<waiter>       waiters;
+			boost::system::error_code error;
+			{
+				std::lock_guard<std::mutex> locker(m_mutex);
+
+				auto& entry = m_entries[key];
+				bool failed = err || results.empty();
+
+				entry.resolving = false;
+				entry.error     = failed && !err ? boost::asio::error::host_not_found : err;
+				entry.results   = results;
+				entry.expires   = clock_type::now() + (failed ? m_negative_ttl : m_ttl);
+				error           = entry.error;
+				waiters.swap(entry.waiters);
+			}
+
+			for (auto& each : waiters) {
+				boost::asio::post(
+					*each.context, std::bind(std::move(each.handler), error, results)
+				);
+			}
+		}
+
+		void _evict_expired() {
+			const auto now = clock_type::now();
+			for (auto itr = m_entries.begin(); m_entries.end() != itr; ) {
+				bool expired = !itr->second.resolving && itr->second.expires <= now;
+				itr = expired ? m_entries.erase(itr) : std::next(itr);
+			}
+		}
+
+	private:
+		static const size_t sweep_interval = 1024u;
+
+		mutable std::mutex m_mutex;
+
+		const std::chrono::seconds m_ttl;
+		const std::chrono::seconds m_negative_ttl;
+
+		size_t                                 m_inserts;
+		std::unordered_map<std::string, entry> m_entries;
+
+		std::atomic<size_t> m_hits;
+		std::atomic<size_t> m_misses;
+		std::atomic<size_t> m_coalesced;
+	};
+
+	const std::chrono::seconds dns_cache::default_ttl(300);
+	const std::chrono::seconds dns_cache::default_negative_ttl(30);
+}
+
+#endif
@@ -6,9 +6,27 @@
 #ifndef _CRAWLER_FILTER_H_
 #define _CRAWLER_FILTER_H_
 
+#include <cmath>
 #include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <functional>
+#include <string_view>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <hash.h>
 #include <messages.h>
+#include <simd_scan.h>
+#include <fingerprint_set.h>
+#include <debug.h>
 
 namespace tools {
 
@@ -52,6 +70,51 @@ namespace tools {
 		 *        will pass the filter
 		 */
 		virtual bool test(const value_type&) = 0;
+
+		/* the number of items passed, 0 if not counted */
+		virtual size_t size() const { return 0; }
+
+		/* the bytes used in memory, 0 if not known */
+		virtual size_t memory() const { return 0; }
+
+		/* the estimated chance that a new item is rejected */
+		virtual double false_positive_rate() const { return 0.0; }
+
+		/*
+		 * Checkpoints. The state of a filter is an image of bytes and a line
+		 * of text (save()). The changes are counted in epochs, so a
+		 * checkpoint only rewrites the parts of the image changed since the
+		 * epoch it was last written in. A filter which does not override
+		 * these can not be checkpointed.
+		 *
+		 * @param offset, data, bytes  a part of the image.
+		 */
+		typedef std::function<void(uint64_t offset, const char* data, size_t bytes)> image_fn;
+
+		virtual bool checkpointable() const { return false; }
+
+		/* the bytes of the image */
+		virtual uint64_t image_size() const { return 0; }
+
+		virtual uint32_t epoch() const { return 0; }
+
+		/*
+		 * @ret  the epoch the changes from now on belong to.
+		 */
+		virtual uint32_t advance_epoch() { return 0; }
+
+		/*
+		 * @note  every part of the image, false if it could not be read.
+		 */
+		virtual bool for_each_page(const image_fn&) const { return false; }
+
+		/*
+		 * @note  at least the parts changed after epoch since.
+		 */
+		virtual bool for_each_page_since(uint32_t, const image_fn& fn) const { return this->for_each_page(fn); }
+
+		/* the sizes as text, restore_filter() reads them back */
+		virtual void save(std::ostream&) const { }
 	};
 }
 
@@ -74,10 +137,11 @@ namespace crawler {
 
 		bool test(const value_type& msg) override {
 			bool exist = true;
+			const std::string url = msg.url();
 
 			for (size_t i = 0; i < BF_k; ++i) {
 				auto key = 
-					tools::RSHash(msg.url().c_str(), tools::seeds[i]) % _M;
+					tools::RSHash(url.c_str(), tools::seeds[i]) % _M;
 
 				exist &= bit[key];
 				bit[key] = 1;
@@ -97,6 +161,781 @@ namespace crawler {
 		 */
 		std::bitset<_M>       bit;
 	};
+
+	/*
+	 * A Bloom filter which grows with the crawl (Almeida et al., Scalable
+	 * Bloom Filters). It is sized at runtime from a capacity and a target
+	 * false positive rate. Once the newest slice is half full, a slice twice
+	 * as large with half the error rate is added, so the compound rate stays
+	 * under the target however many urls come. An url is hashed once with
+	 * murmur3_128 and the k indices of every slice are derived from the two
+	 * halves (Kirsch-Mitzenmacher double hashing).
+	 *
+	 * For checkpoints the slices are laid out one after another in an
+	 * image, each at a multiple of page_bytes. Every page remembers the
+	 * epoch it was last changed in, so a checkpoint writes only the pages
+	 * changed since the one before, and a filter restored from an image
+	 * maps it copy-on-write instead of reading it.
+	 */
+	class scalable_bloom_filter : public tools::filter<url_message> {
+
+		typedef scalable_bloom_filter      self_type;
+		typedef tools::filter<url_message> base_type;
+
+		typedef std::shared_ptr<boost::interprocess::mapped_region> region_ptr;
+
+	public:
+		typedef base_type::value_type value_type;
+
+		static const size_t default_capacity = 1u << 20;
+		static const double default_fp_rate;
+
+		static const size_t page_bytes = 4096u;
+
+		/*
+		 * @param capacity  the number of urls the first slice is sized for.
+		 * @param fp_rate   the false positive rate of the whole filter.
+		 */
+		explicit scalable_bloom_filter(
+			size_t capacity = default_capacity, 
+			double fp_rate  = default_fp_rate
+		) :
+			m_capacity(0 == capacity ? 1 : capacity),
+			m_fp_rate(fp_rate),
+			m_count(0),
+			m_epoch(1)
+		{
+			assert(0.0 < fp_rate && fp_rate < 1.0);
+			this->_add_slice();
+		}
+
+		bool test(const value_type& msg) override {
+			return this->insert(msg.location().fingerprint());
+		}
+
+		/*
+		 * @ret  true if the key was not in the filter, it is added then.
+		 */
+		bool insert(std::string_view key) {
+			return this->insert(tools::murmur3_128(key));
+		}
+
+		/*
+		 * @param hash  murmur3_128 of the key.
+		 */
+		bool insert(const tools::hash128& hash) {
+			if (this->_contains(hash)) { return false; }
+
+			auto& tail = m_slices.back();
+			tail.add(hash, m_epoch);
+			++m_count;
+
+			if (max_fill_ratio <= tail.fill_ratio()) { this->_add_slice(); }
+
+			return true;
+		}
+
+		bool contains(std::string_view key) const {
+			return this->_contains(tools::murmur3_128(key));
+		}
+
+		/* the number of keys inserted */
+		size_t size() const override { return m_count; }
+
+		size_t slices() const { return m_slices.size(); }
+
+		/* the bytes used by the bit arrays */
+		size_t memory() const override {
+			size_t bytes = 0;
+			for (const auto& each : m_slices) { bytes += each.memory(); }
+			return bytes;
+		}
+
+		/* the ratio of set bits in the slice being filled */
+		double fill_ratio() const { return m_slices.back().fill_ratio(); }
+
+		/*
+		 * @note  estimated from the fill of every slice, the chance that an
+		 *        unseen url is taken for a seen one.
+		 */
+		double false_positive_rate() const override {
+			double pass = 1.0;
+			for (const auto& each : m_slices) { pass *= 1.0 - each.false_positive_rate(); }
+			return 1.0 - pass;
+		}
+
+		double target_false_positive_rate() const { return m_fp_rate; }
+
+		bool checkpointable() const override { return true; }
+
+		uint32_t advance_epoch() override { return ++m_epoch; }
+
+		uint32_t epoch() const override { return m_epoch; }
+
+		/* the slices one after another, each rounded up to whole pages */
+		uint64_t image_size() const override {
+			uint64_t bytes = 0;
+			for (const auto& each : m_slices) { bytes += each.image_size(); }
+			return bytes;
+		}
+
+		/* page by page */
+		bool for_each_page(const image_fn& fn) const override {
+			this->_for_each_page(0, true, fn);
+			return true;
+		}
+
+		/* only the pages changed after epoch since */
+		bool for_each_page_since(uint32_t since, const image_fn& fn) const override {
+			this->_for_each_page(since, false, fn);
+			return true;
+		}
+
+		/*
+		 * @note  writes the sizes of the filter and its slices as text, the
+		 *        bits go to the image.
+		 */
+		void save(std::ostream& out) const override {
+			auto precision = out.precision(17);
+			out << "bloom " << m_capacity << ' ' << m_fp_rate << ' ' << m_count << ' ' << m_slices.size() << '\n';
+			for (const auto& each : m_slices) {
+				out << "slice " << each.k() << ' ' << each.bits() << ' ' << each.set() << '\n';
+			}
+			out.precision(precision);
+		}
+
+		/*
+		 * @param in     positioned at what save() wrote.
+		 * @param image  the image of the slices, it is mapped copy-on-write,
+		 *               the filter never changes the file.
+		 * @ret          nullptr if the sizes or the image are not readable.
+		 */
+		static std::unique_ptr<self_type> restore(std::istream& in, const std::string& image) {
+			std::string tag;
+			size_t capacity, count, slices;
+			double fp_rate;
+
+			if (!(in >> tag >> capacity >> fp_rate >> count >> slices) || "bloom" != tag) { return nullptr; }
+			if (!(0.0 < fp_rate && fp_rate < 1.0)) { return nullptr; }
+
+			std::unique_ptr<self_type> result(new self_type(capacity, fp_rate));
+			result->m_slices.clear();
+			result->m_count = count;
+
+			region_ptr region;
+			try {
+				boost::interprocess::file_mapping file(image.c_str(), boost::interprocess::read_only);
+				region = std::make_shared<boost::interprocess::mapped_region>(file, boost::interprocess::copy_on_write);
+			}
+			catch (const std::exception&) {
+				return nullptr;
+			}
+
+			uint64_t offset = 0;
+			for (size_t i = 0; i < slices; ++i) {
+				size_t k, set;
+				uint64_t bits;
+
+				if (!(in >> tag >> k >> bits >> set) || "slice" != tag) { return nullptr; }
+				if (0 == k || bits < 64 || 0 != (bits & (bits - 1))) { return nullptr; }
+
+				result->m_slices.emplace_back(k, bits, set, region, offset);
+				offset += result->m_slices.back().image_size();
+
+				if (region->get_size() < offset) { return nullptr; }
+			}
+
+			if (result->m_slices.empty()) { return nullptr; }
+
+			return result;
+		}
+
+	private:
+		class slice {
+		public:
+			slice(size_t capacity, double fp_rate) : m_set(0) {
+				static const double ln2 = 0.693147180559945309;
+
+				double k = std::ceil(std::log2(1.0 / fp_rate));
+				double m = std::ceil(capacity * std::log(1.0 / fp_rate) / (ln2 * ln2));
+
+				size_t bits = 64;
+				while (bits < m) { bits <<= 1; }
+
+				m_k    = 0 < k ? static_cast<size_t>(k) : 1;
+				m_mask = bits - 1;
+				m_owned.assign(bits / 64, 0);
+				m_words = m_owned.data();
+				m_pages.assign(this->_pages(), 0);
+			}
+
+			/*
+			 * @note  the words are in region at offset.
+			 */
+			slice(size_t k, uint64_t bits, size_t set, region_ptr region, uint64_t offset) :
+				m_k(k),
+				m_mask(bits - 1),
+				m_set(set),
+				m_image(std::move(region)),
+				m_words(reinterpret_cast<uint64_t*>(static_cast<char*>(m_image->get_address()) + offset))
+			{
+				m_pages.assign(this->_pages(), 0);
+			}
+
+			slice(slice&&) noexcept = default;
+			slice& operator=(slice&&) noexcept = default;
+
+			/* uncopyable, the words may point into m_owned */
+			slice(const slice&) = delete;
+			slice& operator=(const slice&) = delete;
+
+			bool contains(const tools::hash128& hash) const {
+				uint64_t index = hash.low;
+				uint64_t step  = hash.high | 1;
+
+				for (size_t i = 0; i < m_k; ++i, index += step) {
+					uint64_t bit = index & m_mask;
+					if (0 == (m_words[bit >> 6] & (uint64_t(1) << (bit & 63)))) { return false; }
+				}
+
+				return true;
+			}
+
+			void add(const tools::hash128& hash, uint32_t epoch) {
+				uint64_t index = hash.low;
+				uint64_t step  = hash.high | 1;
+
+				for (size_t i = 0; i < m_k; ++i, index += step) {
+					uint64_t  bit  = index & m_mask;
+					uint64_t  flag = uint64_t(1) << (bit & 63);
+					uint64_t& word = m_words[bit >> 6];
+
+					if (0 == (word & flag)) {
+						word |= flag;
+						++m_set;
+						m_pages[(bit >> 3) / page_bytes] = epoch;
+					}
+				}
+			}
+
+			double fill_ratio() const {
+				return static_cast<double>(m_set) / static_cast<double>(m_mask + 1);
+			}
+
+			double false_positive_rate() const {
+				return std::pow(this->fill_ratio(), static_cast<double>(m_k));
+			}
+
+			size_t memory() const { return static_cast<size_t>((m_mask + 1) / 8); }
+
+			size_t k() const { return m_k; }
+			uint64_t bits() const { return m_mask + 1; }
+			size_t set() const { return m_set; }
+
+			/* the bytes rounded up to whole pages */
+			uint64_t image_size() const { return this->_pages() * page_bytes; }
+
+			/* the epoch every page was last changed in, 0 if never */
+			const std::vector<uint32_t>& pages() const { return m_pages; }
+
+			const char* data() const { return reinterpret_cast<const char*>(m_words); }
+
+		private:
+			size_t _pages() const { return (this->memory() + page_bytes - 1) / page_bytes; }
+
+		private:
+			size_t                m_k;
+			uint64_t              m_mask;
+			size_t                m_set;
+			std::vector<uint64_t> m_owned;
+			region_ptr            m_image;
+			uint64_t*             m_words;
+			std::vector<uint32_t> m_pages;
+		};
+
+		void _for_each_page(uint32_t since, bool all, const image_fn& fn) const {
+			uint64_t offset = 0;
+
+			for (const auto& each : m_slices) {
+				const auto& pages = each.pages();
+				size_t bytes = each.memory();
+
+				for (size_t i = 0; i < pages.size(); ++i) {
+					if (!all && pages[i] <= since) { continue; }
+
+					size_t begin = i * page_bytes;
+					size_t end   = begin + page_bytes < bytes ? begin + page_bytes : bytes;
+					fn(offset + begin, each.data() + begin, end - begin);
+				}
+
+				offset += each.image_size();
+			}
+		}
+
+		bool _contains(const tools::hash128& hash) const {
+			for (const auto& each : m_slices) {
+				if (each.contains(hash)) { return true; }
+			}
+			return false;
+		}
+
+		/*
+		 * @note  slice i holds capacity * 2^i urls at rate p * (1 - r) * r^i,
+		 *        the rates sum up to less than p.
+		 */
+		void _add_slice() {
+			size_t index    = m_slices.size();
+			size_t capacity = m_capacity << (index < 32 ? index : 32);
+			double fp_rate  = m_fp_rate * (1.0 - tightening_ratio) * std::pow(tightening_ratio, double(index));
+
+			m_slices.emplace_back(capacity, fp_rate);
+		}
+
+	private:
+		static const double max_fill_ratio;
+		static const double tightening_ratio;
+
+		size_t             m_capacity;
+		double             m_fp_rate;
+		size_t             m_count;
+		uint32_t           m_epoch;
+		std::vector<slice> m_slices;
+	};
+
+	const double scalable_bloom_filter::default_fp_rate(0.0001);
+	const double scalable_bloom_filter::max_fill_ratio(0.5);
+	const double scalable_bloom_filter::tightening_ratio(0.5);
+	/*
+	 * A Bloom filter where the bits of a key all fall into one 64-byte
+	 * block, so a test touches one cache line instead of k. A block is 8
+	 * 64-bit lanes and a key sets one bit in every lane, the bit of lane i
+	 * being the top 6 bits of hash * salt[i] (split block Bloom filter).
+	 * The 8 lanes are probed at once with avx2 or sse2, picked at runtime.
+	 *
+	 * The image of a checkpoint is the blocks as they are in memory, every
+	 * page remembers the epoch it was last changed in.
+	 */
+	class blocked_bloom_filter : public tools::filter<url_message> {
+
+		typedef blocked_bloom_filter       self_type;
+		typedef tools::filter<url_message> base_type;
+
+	public:
+		typedef base_type::value_type value_type;
+
+		static const size_t default_capacity     = 1u << 20;
+		static const size_t default_bits_per_key = 16u;
+
+		static const size_t lanes      = 8u;
+		static const size_t block_bits = lanes * 64u;
+
+		static const size_t page_bytes = 4096u;
+
+		/*
+		 * @param capacity      the number of urls expected.
+		 * @param bits_per_key  the memory given to each url, 16 bits give
+		 *                      about 0.1% false positives at capacity.
+		 */
+		explicit blocked_bloom_filter(
+			size_t capacity     = default_capacity, 
+			size_t bits_per_key = default_bits_per_key
+		) :
+			m_blocks(_block_count(capacity, bits_per_key)),
+			m_count(0),
+			m_epoch(1),
+			m_pages(_page_count(m_blocks.size()), 0),
+			m_insert(_select_insert()) { }
+
+		bool test(const value_type& msg) override {
+			return this->insert(msg.location().fingerprint());
+		}
+
+		/*
+		 * @ret  true if the key was not in the filter, it is added then.
+		 */
+		bool insert(std::string_view key) {
+			return this->insert(tools::murmur3_128(key));
+		}
+
+		/*
+		 * @param hash  murmur3_128 of the key.
+		 */
+		bool insert(const tools::hash128& hash) {
+			const size_t index = this->_index(hash);
+			if (m_insert(m_blocks[index].words, static_cast<uint32_t>(hash.low))) {
+				return false;
+			}
+			m_pages[index * sizeof (block) / page_bytes] = m_epoch;
+			++m_count;
+			return true;
+		}
+
+		bool contains(std::string_view key) const {
+			auto hash = tools::murmur3_128(key);
+			const uint64_t* words = m_blocks[this->_index(hash)].words;
+			auto lane_hash = static_cast<uint32_t>(hash.low);
+
+			for (size_t i = 0; i < lanes; ++i) {
+				if (0 == (words[i] & _lane_bit(lane_hash, i))) { return false; }
+			}
+			return true;
+		}
+
+		/* the number of keys inserted */
+		size_t size() const override { return m_count; }
+
+		size_t memory() const override { return m_blocks.size() * sizeof (block); }
+
+		/* the ratio of set bits, it walks the whole filter */
+		double fill_ratio() const {
+			size_t set = 0;
+			for (const auto& each : m_blocks) {
+				for (auto word : each.words) { set += std::bitset<64>(word).count(); }
+			}
+			return static_cast<double>(set) / static_cast<double>(m_blocks.size() * block_bits);
+		}
+
+		/*
+		 * @note  the chance that an unseen key finds all of its bits set,
+		 *        averaged over the blocks, it walks the whole filter.
+		 */
+		double false_positive_rate() const override {
+			double sum = 0.0;
+			for (const auto& each : m_blocks) {
+				double pass = 1.0;
+				for (auto word : each.words) { pass *= std::bitset<64>(word).count() / 64.0; }
+				sum += pass;
+			}
+			return sum / static_cast<double>(m_blocks.size());
+		}
+
+		bool checkpointable() const override { return true; }
+
+		uint32_t advance_epoch() override { return ++m_epoch; }
+
+		uint32_t epoch() const override { return m_epoch; }
+
+		uint64_t image_size() const override { return this->memory(); }
+
+		bool for_each_page(const image_fn& fn) const override {
+			this->_for_each_page(0, true, fn);
+			return true;
+		}
+
+		bool for_each_page_since(uint32_t since, const image_fn& fn) const override {
+			this->_for_each_page(since, false, fn);
+			return true;
+		}
+
+		void save(std::ostream& out) const override {
+			out << "blocked " << m_blocks.size() << ' ' << m_count << '\n';
+		}
+
+		/*
+		 * @param in     positioned at what save() wrote.
+		 * @param image  the image of the blocks, it is read.
+		 * @ret          nullptr if the sizes or the image are not readable.
+		 */
+		static std::unique_ptr<self_type> restore(std::istream& in, const std::string& image) {
+			std::string tag;
+			size_t blocks, count;
+
+			if (!(in >> tag >> blocks >> count) || "blocked" != tag || 0 == blocks) { return nullptr; }
+
+			std::unique_ptr<self_type> result(new self_type(1, 1));
+			result->m_blocks.resize(blocks);
+			result->m_pages.assign(_page_count(blocks), 0);
+			result->m_count = count;
+
+			std::ifstream file(image, std::ios::binary);
+			file.read(reinterpret_cast<char*>(result->m_blocks.data()), result->memory());
+			if (!file) { return nullptr; }
+
+			return result;
+		}
+
+	private:
+		struct alignas(64) block {
+			uint64_t words[lanes];
+		};
+
+		/*
+		 * @ret  true if every bit was set already.
+		 */
+		typedef bool (*insert_fn)(uint64_t*, uint32_t);
+
+		static size_t _block_count(size_t capacity, size_t bits_per_key) {
+			size_t bits = (0 == capacity ? 1 : capacity) * (0 == bits_per_key ? 1 : bits_per_key);
+			return (bits + block_bits - 1) / block_bits;
+		}
+
+		static size_t _page_count(size_t blocks) {
+			return (blocks * sizeof (block) + page_bytes - 1) / page_bytes;
+		}
+
+		/* the top 32 bits pick the block, multiply-shift instead of modulo */
+		size_t _index(const tools::hash128& hash) const {
+			return static_cast<size_t>(((hash.high >> 32) * m_blocks.size()) >> 32);
+		}
+
+		void _for_each_page(uint32_t since, bool all, const image_fn& fn) const {
+			const auto   data  = reinterpret_cast<const char*>(m_blocks.data());
+			const size_t bytes = this->memory();
+
+			for (size_t i = 0; i < m_pages.size(); ++i) {
+				if (!all && m_pages[i] <= since) { continue; }
+
+				size_t begin = i * page_bytes;
+				size_t end   = begin + page_bytes < bytes ? begin + page_bytes : bytes;
+				fn(begin, data + begin, end - begin);
+			}
+		}
+
+		static uint64_t _lane_bit(uint32_t hash, size_t lane) {
+			return uint64_t(1) << ((hash * salts[lane]) >> 26);
+		}
+
+		static bool _insert_scalar(uint64_t* words, uint32_t hash) {
+			bool exist = true;
+			for (size_t i = 0; i < lanes; ++i) {
+				uint64_t bit = _lane_bit(hash, i);
+				exist &= 0 != (words[i] & bit);
+				words[i] |= bit;
+			}
+			return exist;
+		}
+
+#ifdef _CRAWLER_SIMD_X86_
+		/* sse2 has no 32-bit multiply or variable shift, only the probe is vectorized */
+		static bool _insert_sse2(uint64_t* words, uint32_t hash) {
+			alignas(16) uint64_t mask[lanes];
+			for (size_t i = 0; i < lanes; ++i) { mask[i] = _lane_bit(hash, i); }
+
+			__m128i missing = _mm_setzero_si128();
+
+			for (size_t i = 0; i < lanes; i += 2) {
+				auto dst = reinterpret_cast<__m128i*>(words + i);
+				__m128i cur = _mm_load_si128(dst);
+				__m128i bit = _mm_load_si128(reinterpret_cast<const __m128i*>(mask + i));
+
+				missing = _mm_or_si128(missing, _mm_andnot_si128(cur, bit));
+				_mm_store_si128(dst, _mm_or_si128(cur, bit));
+			}
+
+			return 0xffff == _mm_movemask_epi8(_mm_cmpeq_epi32(missing, _mm_setzero_si128()));
+		}
+
+		_CRAWLER_TARGET_AVX2_ static bool _insert_avx2(uint64_t* words, uint32_t hash) {
+			const __m256i ones = _mm256_set1_epi64x(1);
+
+			__m256i shift = _mm256_srli_epi32(
+				_mm256_mullo_epi32(
+					_mm256_set1_epi32(static_cast<int>(hash)), 
+					_mm256_load_si256(reinterpret_cast<const __m256i*>(salts))
+				), 
+				26
+			);
+
+			__m256i lo_bit = _mm256_sllv_epi64(ones, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shift)));
+			__m256i hi_bit = _mm256_sllv_epi64(ones, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shift, 1)));
+
+			auto lo_dst = reinterpret_cast<__m256i*>(words);
+			auto hi_dst = reinterpret_cast<__m256i*>(words + 4);
+
+			__m256i lo = _mm256_load_si256(lo_dst);
+			__m256i hi = _mm256_load_si256(hi_dst);
+
+			bool exist = _mm256_testc_si256(lo, lo_bit) && _mm256_testc_si256(hi, hi_bit);
+
+			_mm256_store_si256(lo_dst, _mm256_or_si256(lo, lo_bit));
+			_mm256_store_si256(hi_dst, _mm256_or_si256(hi, hi_bit));
+
+			return exist;
+		}
+#endif
+
+		static insert_fn _select_insert() {
+#ifdef _CRAWLER_SIMD_X86_
+			const auto& cpu = tools::simd::detect_cpu();
+			if (cpu.avx2) { return &_insert_avx2; }
+			if (cpu.sse2) { return &_insert_sse2; }
+#endif
+			return &_insert_scalar;
+		}
+
+	private:
+		alignas(32) static const uint32_t salts[lanes];
+
+		std::vector<block>    m_blocks;
+		size_t                m_count;
+		uint32_t              m_epoch;
+		/* the epoch every page was last changed in, 0 if never */
+		std::vector<uint32_t> m_pages;
+		insert_fn             m_insert;
+	};
+
+	alignas(32) const uint32_t blocked_bloom_filter::salts[blocked_bloom_filter::lanes] = {
+		0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+		0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+	};
+	/*
+	 * An exact alternative to the Bloom filters for audit crawls: every
+	 * url is kept as a 64-bit fingerprint in a tools::fingerprint_set, so
+	 * a new url is only dropped on a fingerprint collision (about n^2/2^65,
+	 * 3e-6 for 10M urls). Urls are partitioned by host, so with a memory
+	 * budget the hosts not crawled lately are the ones spilled to disk.
+	 * It takes 10.3 to 20.6 bytes per url in memory.
+	 *
+	 * The image of a checkpoint is every partition in order, its number of
+	 * fingerprints then the fingerprints. It is written whole each time,
+	 * the changes are not tracked.
+	 */
+	class exact_filter : public tools::filter<url_message> {
+
+		typedef exact_filter               self_type;
+		typedef tools::filter<url_message> base_type;
+
+	public:
+		typedef base_type::value_type value_type;
+
+		/*
+		 * @param memory_budget  bytes kept in memory, 0 for no limit.
+		 * @param spill_dir      where cold partitions are written.
+		 * @param name           the prefix of the spill files.
+		 */
+		explicit exact_filter(
+			size_t             memory_budget = 0, 
+			const std::string& spill_dir     = ".",
+			const std::string& name          = "seen"
+		) : m_set(memory_budget, spill_dir, name), m_epoch(1) { }
+
+		bool test(const value_type& msg) override {
+			const auto& location = msg.location();
+			return m_set.insert(_host_partition(location.host()), location.fingerprint().low);
+		}
+
+		/*
+		 * @ret  true if the key was not in the filter, it is added then.
+		 */
+		bool insert(std::string_view key) {
+			return m_set.insert(_partition(key), tools::murmur3_128(key).low);
+		}
+
+		bool contains(std::string_view key) {
+			return m_set.contains(_partition(key), tools::murmur3_128(key).low);
+		}
+
+		size_t size() const override { return m_set.size(); }
+		size_t memory() const override { return m_set.memory(); }
+
+		/* a collision of two 64-bit fingerprints among size() urls */
+		double false_positive_rate() const override {
+			return static_cast<double>(m_set.size()) / 18446744073709551616.0;
+		}
+
+		const tools::fingerprint_set& fingerprints() const { return m_set; }
+
+		bool checkpointable() const override { return true; }
+
+		uint32_t advance_epoch() override { return ++m_epoch; }
+
+		uint32_t epoch() const override { return m_epoch; }
+
+		uint64_t image_size() const override {
+			return (m_set.partitions() + m_set.size()) * sizeof (uint64_t);
+		}
+
+		bool for_each_page(const image_fn& fn) const override {
+			uint64_t offset = 0;
+
+			bool result = m_set.for_each_partition([&fn, &offset](size_t, const std::vector<uint64_t>& fps) {
+				uint64_t count = fps.size();
+				fn(offset, reinterpret_cast<const char*>(&count), sizeof (count));
+				fn(offset + sizeof (count), reinterpret_cast<const char*>(fps.data()), fps.size() * sizeof (uint64_t));
+				offset += (1 + fps.size()) * sizeof (uint64_t);
+			});
+
+			if (!result) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "exact_filter", "Failed to read a spilled partition");
+			}
+			return result;
+		}
+
+		/* the spill directory ends the line */
+		void save(std::ostream& out) const override {
+			out << "exact " << m_set.partitions() << ' ' << m_set.size() << ' '
+			    << m_set.budget() << ' ' << m_set.name() << ' ' << m_set.spill_dir() << '\n';
+		}
+
+		/*
+		 * @param in     positioned at what save() wrote.
+		 * @param image  the image of the fingerprints, it is read.
+		 * @ret          nullptr if the sizes or the image are not readable.
+		 */
+		static std::unique_ptr<self_type> restore(std::istream& in, const std::string& image) {
+			std::string tag, name, spill_dir;
+			size_t partitions, count, budget;
+
+			if (!(in >> tag >> partitions >> count >> budget >> name) || "exact" != tag) { return nullptr; }
+			in.get();
+			if (!std::getline(in, spill_dir)) { return nullptr; }
+
+			std::unique_ptr<self_type> result(new self_type(budget, spill_dir, name));
+			if (partitions != result->m_set.partitions()) { return nullptr; }
+
+			std::ifstream file(image, std::ios::binary);
+			std::vector<uint64_t> fps;
+
+			for (size_t i = 0; i < partitions; ++i) {
+				uint64_t size = 0;
+				file.read(reinterpret_cast<char*>(&size), sizeof (size));
+				if (!file || count < size) { return nullptr; }
+
+				fps.resize(size);
+				file.read(reinterpret_cast<char*>(fps.data()), size * sizeof (uint64_t));
+				if (!file) { return nullptr; }
+
+				for (auto fp : fps) { result->m_set.insert(i, fp); }
+			}
+
+			if (count != result->m_set.size()) { return nullptr; }
+			return result;
+		}
+
+	private:
+		/* urls look like host/path, the host picks the partition */
+		static uint64_t _partition(std::string_view key) {
+			return _host_partition(key.substr(0, key.find_first_of("/?")));
+		}
+
+		static uint64_t _host_partition(std::string_view host) {
+			return tools::murmur3_128(host, partition_seed).high;
+		}
+
+	private:
+		static const uint64_t partition_seed = 0x9e3779b97f4a7c15ull;
+
+		tools::fingerprint_set m_set;
+		uint32_t               m_epoch;
+	};
+
+	/*
+	 * @param in     positioned at what save() of a filter wrote.
+	 * @param image  the image written with it.
+	 * @ret          the filter restored, of the kind which saved it,
+	 *               nullptr if it can not be read.
+	 */
+	inline std::unique_ptr<tools::filter<url_message>> restore_filter(std::istream& in, const std::string& image) {
+		const auto at = in.tellg();
+		std::string tag;
+		if (!(in >> tag)) { return nullptr; }
+		in.seekg(at);
+
+		if ("bloom" == tag)   { return scalable_bloom_filter::restore(in, image); }
+		if ("blocked" == tag) { return blocked_bloom_filter::restore(in, image); }
+		if ("exact" == tag)   { return exact_filter::restore(in, image); }
+		return nullptr;
+	}
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,440 @@
+#ifndef _CRAWLER_FINGERPRINT_SET_H_
+#define _CRAWLER_FINGERPRINT_SET_H_
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#define _CRAWLER_SIMD_SSE2_
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+namespace tools {
+
+	/*
+	 * An open addressing set of 64-bit fingerprints in the Swiss table
+	 * layout: one control byte per slot holding 7 bits of the fingerprint
+	 * (or empty), probed 16 slots at a time with sse2, and the fingerprints
+	 * in a separate array which is only read on a control byte match.
+	 * Nothing is ever erased, so there are no tombstones. A slot costs 9
+	 * bytes and the table grows at 7/8 full, that is 10.3 to 20.6 bytes per
+	 * fingerprint.
+	 */
+	class fingerprint_table {
+
+		typedef fingerprint_table self_type;
+
+	public:
+		static const size_t group_size = 16u;
+
+		fingerprint_table() : m_size(0) { }
+
+		fingerprint_table(self_type&& other) noexcept :
+			m_ctrl(std::move(other.m_ctrl)), m_slots(std::move(other.m_slots)), m_size(other.m_size) {
+			other.m_size = 0;
+		}
+
+		self_type& operator=(self_type&& other) noexcept {
+			if (this == &other) { return *this; }
+			m_ctrl  = std::move(other.m_ctrl);
+			m_slots = std::move(other.m_slots);
+			m_size  = other.m_size;
+			other.m_size = 0;
+			return *this;
+		}
+
+		/* uncopyable */
+		fingerprint_table(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @ret  true if fp was not in the table.
+		 */
+		bool insert(uint64_t fp) {
+			if (this->capacity() * 7 < (m_size + 1) * 8) { this->_grow(); }
+			return this->_insert(fp);
+		}
+
+		bool contains(uint64_t fp) const {
+			if (m_ctrl.empty()) { return false; }
+
+			const size_t group_mask = m_ctrl.size() - 1;
+			const int8_t tag = _tag(fp);
+
+			size_t group = _home(fp) & group_mask;
+
+			for (size_t step = 1; ; group = (group + step++) & group_mask) {
+				const int8_t* ctrl = m_ctrl[group].bytes;
+				const uint64_t* slots = &m_slots[group * group_size];
+
+				for (unsigned hits = _match(ctrl, tag); 0 != hits; hits &= hits - 1) {
+					if (fp == slots[_first(hits)]) { return true; }
+				}
+
+				if (0 != _match(ctrl, empty_tag)) { return false; }
+			}
+		}
+
+		/* grows the table to hold n fingerprints without rehashing */
+		void reserve(size_t n) {
+			while (this->capacity() * 7 < n * 8) { this->_grow(); }
+		}
+
+		template <typename _Function>
+		void for_each(_Function&& fn) const {
+			for (size_t i = 0; i < this->capacity(); ++i) {
+				if (0 <= m_ctrl[i / group_size].bytes[i % group_size]) { fn(m_slots[i]); }
+			}
+		}
+
+		size_t size() const { return m_size; }
+		bool empty() const { return 0 == m_size; }
+		size_t capacity() const { return m_ctrl.size() * group_size; }
+
+		/* the bytes used by the control bytes and the slots */
+		size_t memory() const { return this->capacity() * (1 + sizeof (uint64_t)); }
+
+		/* releases the memory */
+		void clear() {
+			std::vector<ctrl_group>().swap(m_ctrl);
+			std::vector<uint64_t>().swap(m_slots);
+			m_size = 0;
+		}
+
+	private:
+		struct alignas(16) ctrl_group {
+			int8_t bytes[group_size];
+		};
+
+		static const int8_t empty_tag = -128;
+
+		/* the low 7 bits go to the control byte, the rest picks the group */
+		static int8_t _tag(uint64_t fp) { return static_cast<int8_t>(fp & 0x7f); }
+		static size_t _home(uint64_t fp) { return static_cast<size_t>(fp >> 7); }
+
+		/*
+		 * @ret  a bit for every control byte of the group equal to tag.
+		 */
+		static unsigned _match(const int8_t* ctrl, int8_t tag) {
+#ifdef _CRAWLER_SIMD_SSE2_
+			__m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+			return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag))));
+#else
+			unsigned mask = 0;
+			for (unsigned i = 0; i < group_size; ++i) {
+				if (tag == ctrl[i]) { mask |= 1u << i; }
+			}
+			return mask;
+#endif
+		}
+
+		static unsigned _first(unsigned mask) {
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		/*
+		 * @note  triangular probing over a power of two number of groups
+		 *        visits every group.
+		 */
+		bool _insert(uint64_t fp) {
+			const size_t group_mask = m_ctrl.size() - 1;
+			const int8_t tag = _tag(fp);
+
+			size_t group = _home(fp) & group_mask;
+
+			for (size_t step = 1; ; group = (group + step++) & group_mask) {
+				int8_t* ctrl = m_ctrl[group].bytes;
+				uint64_t* slots = &m_slots[group * group_size];
+
+				for (unsigned hits = _match(ctrl, tag); 0 != hits; hits &= hits - 1) {
+					if (fp == slots[_first(hits)]) { return false; }
+				}
+
+				unsigned vacant = _match(ctrl, empty_tag);
+				if (0 != vacant) {
+					unsigned index = _first(vacant);
+					ctrl[index]  = tag;
+					slots[index] = fp;
+					++m_size;
+					return true;
+				}
+			}
+		}
+
+		void _grow() {
+			size_t groups = m_ctrl.empty() ? 1 : m_ctrl.size() * 2;
+
+			std::vector<ctrl_group> old_ctrl(groups);
+			std::vector<uint64_t>   old_slots(groups * group_size);
+
+			for (auto& each : old_ctrl) { memset(each.bytes, empty_tag, group_size); }
+
+			old_ctrl.swap(m_ctrl);
+			old_slots.swap(m_slots);
+			m_size = 0;
+
+			for (size_t i = 0; i < old_ctrl.size() * group_size; ++i) {
+				if (0 <= old_ctrl[i / group_size].bytes[i % group_size]) { this->_insert(old_slots[i]); }
+			}
+		}
+
+	private:
+		std::vector<ctrl_group> m_ctrl;
+		std::vector<uint64_t>   m_slots;
+		size_t                  m_size;
+	};
+
+	/*
+	 * fingerprint_table split into partitions. When a memory budget is
+	 * given and the tables go past it, the least recently used partitions
+	 * are written to files in the spill directory and released, and read
+	 * back the next time they are touched. Callers choose the partition,
+	 * so keys used together (e.g. urls of one host) should share one, with
+	 * keys spread evenly over the partitions a small budget makes every
+	 * insert reload a partition.
+	 */
+	class fingerprint_set {
+
+		typedef fingerprint_set self_type;
+
+	public:
+		static const size_t default_partitions = 64u;
+
+		/*
+		 * @param memory_budget  bytes the tables may use, 0 for no limit.
+		 * @param spill_dir      where cold partitions are written.
+		 * @param name           the spill files are <name>-<partition>.bin,
+		 *                       one set to a name in a directory. A file
+		 *                       left by a run before is written over.
+		 * @param partitions     rounded up to a power of two.
+		 */
+		explicit fingerprint_set(
+			size_t             memory_budget = 0,
+			const std::string& spill_dir     = ".",
+			const std::string& name          = "seen",
+			size_t             partitions    = default_partitions
+		) :
+			m_budget(memory_budget),
+			m_spill_dir(spill_dir),
+			m_name(name),
+			m_parts(_round_up(partitions)),
+			m_memory(0),
+			m_size(0),
+			m_tick(0),
+			m_spills(0),
+			m_loads(0) { }
+
+		~fingerprint_set() {
+			for (size_t i = 0; i < m_parts.size(); ++i) {
+				if (m_parts[i].spilled) { std::remove(this->_spill_path(i).c_str()); }
+			}
+		}
+
+		/* uncopyable */
+		fingerprint_set(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @param partition  any hash, it is reduced to a partition index.
+		 * @ret              true if fp was not in the set.
+		 */
+		bool insert(uint64_t partition, uint64_t fp) {
+			size_t index = static_cast<size_t>(partition) & (m_parts.size() - 1);
+			auto& part = this->_touch(index);
+
+			size_t before = part.table.memory();
+			bool inserted = part.table.insert(fp);
+
+			if (inserted) { ++m_size; }
+
+			if (before != part.table.memory()) {
+				m_memory += part.table.memory() - before;
+				this->_enforce_budget(index);
+			}
+
+			return inserted;
+		}
+
+		bool contains(uint64_t partition, uint64_t fp) {
+			size_t index = static_cast<size_t>(partition) & (m_parts.size() - 1);
+			return this->_touch(index).table.contains(fp);
+		}
+
+		size_t size() const { return m_size; }
+
+		/* the bytes held by the tables in memory */
+		size_t memory() const { return m_memory; }
+
+		size_t partitions() const { return m_parts.size(); }
+
+		size_t spilled_partitions() const {
+			size_t count = 0;
+			for (const auto& each : m_parts) { count += each.spilled ? 1 : 0; }
+			return count;
+		}
+
+		/* how many times a partition went to disk and came back */
+		size_t spills() const { return m_spills; }
+		size_t loads() const { return m_loads; }
+
+		size_t budget() const { return m_budget; }
+		const std::string& spill_dir() const { return m_spill_dir; }
+
+		const std::string& name() const { return m_name; }
+
+		/*
+		 * @param fn  void(size_t partition, const std::vector<uint64_t>& fps)
+		 *            for every partition in order, a spilled one is read
+		 *            from its file and stays spilled.
+		 * @ret       false if a spilled partition could not be read.
+		 */
+		template <typename _Function>
+		bool for_each_partition(_Function&& fn) const {
+			std::vector<uint64_t> fps;
+
+			for (size_t i = 0; i < m_parts.size(); ++i) {
+				fps.clear();
+				if (m_parts[i].spilled) {
+					if (!this->_read_spill(i, fps)) { return false; }
+				}
+				else {
+					m_parts[i].table.for_each([&fps](uint64_t fp) { fps.push_back(fp); });
+				}
+				fn(i, static_cast<const std::vector<uint64_t>&>(fps));
+			}
+			return true;
+		}
+
+	private:
+		struct partition {
+			partition() : spilled(false), last_use(0) { }
+
+			fingerprint_table table;
+			bool              spilled;
+			uint64_t          last_use;
+		};
+
+		static size_t _round_up(size_t n) {
+			size_t result = 1;
+			while (result < n) { result <<= 1; }
+			return result;
+		}
+
+		std::string _spill_path(size_t index) const {
+			return m_spill_dir + "/" + m_name + "-" + std::to_string(index) + ".bin";
+		}
+
+		partition& _touch(size_t index) {
+			auto& part = m_parts[index];
+			part.last_use = ++m_tick;
+
+			if (part.spilled && this->_load(index)) {
+				this->_enforce_budget(index);
+			}
+
+			return part;
+		}
+
+		/*
+		 * @note  spills the coldest partitions but the one in use until the
+		 *        tables fit in the budget.
+		 */
+		void _enforce_budget(size_t in_use) {
+			if (0 == m_budget) { return; }
+
+			while (m_budget < m_memory) {
+				size_t coldest = m_parts.size();
+
+				for (size_t i = 0; i < m_parts.size(); ++i) {
+					const auto& each = m_parts[i];
+					if (i == in_use || each.spilled || each.table.empty()) { continue; }
+					if (m_parts.size() == coldest || each.last_use < m_parts[coldest].last_use) {
+						coldest = i;
+					}
+				}
+
+				if (m_parts.size() == coldest || !this->_spill(coldest)) { return; }
+			}
+		}
+
+		bool _spill(size_t index) {
+			auto& part = m_parts[index];
+
+			std::vector<uint64_t> fps;
+			fps.reserve(part.table.size());
+			part.table.for_each([&fps](uint64_t fp) { fps.push_back(fp); });
+
+			std::ofstream file(this->_spill_path(index), std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(fps.data()), fps.size() * sizeof (uint64_t));
+			file.close();
+
+			if (!file) { return false; }
+
+			m_memory -= part.table.memory();
+			part.table.clear();
+			part.spilled = true;
+			++m_spills;
+
+			return true;
+		}
+
+		bool _read_spill(size_t index, std::vector<uint64_t>& fps) const {
+			std::ifstream file(this->_spill_path(index), std::ios::binary | std::ios::ate);
+			if (!file) { return false; }
+
+			size_t count = static_cast<size_t>(file.tellg()) / sizeof (uint64_t);
+			fps.resize(count);
+
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(fps.data()), count * sizeof (uint64_t));
+			return static_cast<bool>(file);
+		}
+
+		bool _load(size_t index) {
+			auto& part = m_parts[index];
+			auto path = this->_spill_path(index);
+
+			std::vector<uint64_t> fps;
+			if (!this->_read_spill(index, fps)) { return false; }
+
+			part.table.reserve(fps.size());
+			for (auto fp : fps) { part.table.insert(fp); }
+
+			m_memory += part.table.memory();
+			part.spilled = false;
+			++m_loads;
+
+			std::remove(path.c_str());
+			return true;
+		}
+
+	private:
+		size_t                 m_budget;
+		std::string            m_spill_dir;
+		std::string            m_name;
+		std::vector<partition> m_parts;
+
+		size_t                 m_memory;
+		size_t                 m_size;
+		uint64_t               m_tick;
+		size_t                 m_spills;
+		size_t                 m_loads;
+	};
+}
+
+#endif
@@ -0,0 +1,497 @@
+#ifndef _CRAWLER_FRONTIER_H_
+#define _CRAWLER_FRONTIER_H_
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <ostream>
+#include <filesystem>
+#include <string_view>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <debug.h>
+
+namespace crawler {
+
+	/*
+	 * The urls waiting to be crawled with their depth.
+	 */
+	class frontier {
+	public:
+		virtual ~frontier() = default;
+
+		/*
+		 * @param level  the priority of the url, higher is handed out
+		 *               first by the frontiers which order by it.
+		 * @note         an url is never dropped.
+		 */
+		virtual void push(std::string_view url, uint32_t depth = 0, size_t level = 0) = 0;
+
+		/*
+		 * @ret  false if there is no url left.
+		 */
+		virtual bool pop(std::string& url, uint32_t& depth) = 0;
+
+		virtual size_t size() const = 0;
+
+		bool empty() const { return 0 == this->size(); }
+
+		/*
+		 * Checkpoints. A frontier which retains keeps its files until a
+		 * later checkpoint no longer needs them.
+		 */
+		virtual void retain() { }
+
+		/*
+		 * @note  writes one line per file the urls waiting are in, the
+		 *        files must not change until commit() is called.
+		 */
+		virtual void checkpoint(std::ostream&) { }
+
+		/*
+		 * @note  the last checkpoint is stored, the files only the one
+		 *        before needed may go.
+		 */
+		virtual void commit() { }
+
+		enum class restore_result {
+			/* the line was not written by this frontier */
+			UNKNOWN,
+			RESTORED,
+			/* its file is missing or could not be cut back */
+			FAILED
+		};
+
+		/*
+		 * @param line  one line written by checkpoint().
+		 * @note        after a FAILED the frontier is not usable.
+		 */
+		virtual restore_result restore(const std::string&) { return restore_result::UNKNOWN; }
+	};
+
+	/*
+	 * A frontier of two levels. New urls are appended to a hot buffer in
+	 * memory, and when it grows past hot_bytes it is written to the end of
+	 * an append-only segment file. Urls are taken from the oldest segment,
+	 * which is memory mapped and read front to back, so refilling is one
+	 * sequential read; once a segment is read it is deleted. When nothing is
+	 * on disk the urls come straight from the hot buffer. The memory used
+	 * stays around hot_bytes however many urls are pending. The urls are
+	 * handed out in the order they came, the level is not used.
+	 *
+	 * A record is the length of the url and its depth (uint32_t each)
+	 * followed by the bytes of the url.
+	 *
+	 * The segments are only appended to, so a checkpoint is the list of
+	 * segments with their length and the offset of the next url in the
+	 * first one. While retaining, a segment read up is kept until a
+	 * checkpoint past it is committed.
+	 */
+	class disk_frontier : public frontier {
+
+		typedef disk_frontier self_type;
+
+	public:
+		static const size_t default_hot_bytes     = 4u << 20;
+		static const size_t default_segment_bytes = 64u << 20;
+
+		/*
+		 * @param dir            where the segment files are written.
+		 * @param hot_bytes      the size of the hot buffer.
+		 * @param segment_bytes  a segment is sealed once it is this large.
+		 * @param name           the prefix of the segment files.
+		 */
+		explicit disk_frontier(
+			const std::string& dir           = ".",
+			size_t             hot_bytes     = default_hot_bytes,
+			size_t             segment_bytes = default_segment_bytes,
+			const std::string& name          = "frontier"
+		) :
+			m_dir(dir),
+			m_name(name),
+			m_hot_bytes(hot_bytes),
+			m_segment_bytes(segment_bytes),
+			m_size(0),
+			m_hot_read(0),
+			m_hot_records(0),
+			m_writing(false),
+			m_head_offset(0),
+			m_next_id(0),
+			m_disk_bytes(0),
+			m_retain(false),
+			m_checkpoint_head(0) { }
+
+		~disk_frontier() {
+			m_writer.close();
+			m_head.reset();
+			/* a checkpoint may still need them */
+			if (m_retain) { return; }
+			for (const auto& each : m_segments) { std::remove(each.path.c_str()); }
+		}
+
+		/* uncopyable */
+		disk_frontier(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		void push(std::string_view url, uint32_t depth = 0, size_t = 0) override {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			auto length = static_cast<uint32_t>(url.length());
+			m_hot.append(reinterpret_cast<const char*>(&length), sizeof (length));
+			m_hot.append(reinterpret_cast<const char*>(&depth), sizeof (depth));
+			m_hot.append(url.data(), url.length());
+
+			++m_hot_records;
+			++m_size;
+
+			if (m_hot_bytes <= m_hot.size() - m_hot_read) { this->_spill(); }
+		}
+
+		bool pop(std::string& url, uint32_t& depth) override {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			while (!m_segments.empty()) {
+				if (this->_pop_segment(url, depth)) {
+					--m_size;
+					return true;
+				}
+			}
+
+			if (m_hot_read == m_hot.size()) { return false; }
+
+			m_hot_read = _read_record(m_hot.data(), m_hot_read, url, depth);
+			--m_hot_records;
+			--m_size;
+
+			/*
+			 * the urls read go once they are half of the buffer, the few left
+			 * are moved: a buffer never drained would keep every url read.
+			 */
+			if (m_hot_read == m_hot.size()) {
+				m_hot.clear();
+				m_hot_read = 0;
+			}
+			else if (m_hot.size() / 2 <= m_hot_read) {
+				m_hot.erase(0, m_hot_read);
+				m_hot_read = 0;
+			}
+
+			return true;
+		}
+
+		size_t size() const override {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_size;
+		}
+
+		/* the bytes of the segments not read yet */
+		size_t disk_bytes() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_disk_bytes;
+		}
+
+		size_t segments() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_segments.size();
+		}
+
+		void retain() override {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			m_retain = true;
+		}
+
+		/*
+		 * @note  the hot buffer is written out first, so every url waiting
+		 *        is in a segment. A line is
+		 *        "frontier <name> <id> <bytes> <records> <offset>".
+		 */
+		void checkpoint(std::ostream& out) override {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			if (m_hot_read != m_hot.size()) { this->_spill(); }
+			if (m_writing) { m_writer.flush(); }
+
+			for (const auto& each : m_segments) {
+				size_t offset = &each == &m_segments.front() && nullptr != m_head ? m_head_offset : each.start;
+				out << "frontier " << m_name << ' ' << each.id << ' ' << each.bytes << ' '
+				    << each.records << ' ' << offset << '\n';
+			}
+
+			m_checkpoint_head = m_segments.empty() ? m_next_id : m_segments.front().id;
+		}
+
+		void commit() override {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			while (!m_retired.empty() && m_retired.front().id < m_checkpoint_head) {
+				std::remove(m_retired.front().path.c_str());
+				m_retired.pop_front();
+			}
+		}
+
+		/*
+		 * @note  the segment is cut back to its length at the checkpoint,
+		 *        what was appended after it is written again by the urls
+		 *        found again. Call it before the first push or pop.
+		 */
+		restore_result restore(const std::string& line) override {
+			std::istringstream in(line);
+			std::string tag, name;
+			segment restored;
+
+			if (!(in >> tag >> name >> restored.id >> restored.bytes >> restored.records >> restored.start)) {
+				return restore_result::UNKNOWN;
+			}
+			if ("frontier" != tag || m_name != name) { return restore_result::UNKNOWN; }
+
+			restored.path = this->_path(restored.id);
+
+			std::error_code error;
+			if (std::filesystem::file_size(restored.path, error) < restored.bytes || error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "disk_frontier", "Missing checkpointed segment ", restored.path);
+				return restore_result::FAILED;
+			}
+
+			std::filesystem::resize_file(restored.path, restored.bytes, error);
+			if (error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "disk_frontier", error.message(), ": ", restored.path);
+				return restore_result::FAILED;
+			}
+
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			if (m_next_id <= restored.id) { m_next_id = restored.id + 1; }
+			m_size       += restored.records;
+			m_disk_bytes += restored.bytes;
+			m_segments.push_back(std::move(restored));
+
+			return restore_result::RESTORED;
+		}
+
+	private:
+		struct segment {
+			std::string path;
+			size_t      id;
+			size_t      bytes;
+			size_t      records;
+			/* where the first url not taken is */
+			size_t      start;
+		};
+
+		std::string _path(size_t id) const {
+			return m_dir + "/" + m_name + "-" + std::to_string(id) + ".seg";
+		}
+
+		static size_t _read_record(const char* data, size_t offset, std::string& url, uint32_t& depth) {
+			uint32_t length;
+			memcpy(&length, data + offset, sizeof (length));
+			offset += sizeof (length);
+			memcpy(&depth, data + offset, sizeof (depth));
+			offset += sizeof (depth);
+			url.assign(data + offset, length);
+			return offset + length;
+		}
+
+		/*
+		 * @note  moves the unread part of the hot buffer to the segment
+		 *        being written.
+		 */
+		void _spill() {
+			if (!m_writing) {
+				segment created = { this->_path(m_next_id), m_next_id, 0, 0, 0 };
+				++m_next_id;
+				m_writer.open(created.path, std::ios::binary | std::ios::trunc);
+				m_segments.push_back(std::move(created));
+				m_writing = true;
+			}
+
+			size_t bytes = m_hot.size() - m_hot_read;
+			m_writer.write(m_hot.data() + m_hot_read, bytes);
+
+			if (!m_writer) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "disk_frontier", "Failed to write ", m_segments.back().path);
+			}
+
+			auto& tail = m_segments.back();
+			tail.bytes   += bytes;
+			tail.records += m_hot_records;
+			m_disk_bytes += bytes;
+
+			m_hot.clear();
+			m_hot_read    = 0;
+			m_hot_records = 0;
+
+			if (m_segment_bytes <= tail.bytes) { this->_seal(); }
+		}
+
+		void _seal() {
+			m_writer.close();
+			m_writing = false;
+		}
+
+		/*
+		 * @ret  false if the oldest segment is used up (or unreadable) and
+		 *       has been removed.
+		 */
+		bool _pop_segment(std::string& url, uint32_t& depth) {
+			auto& head = m_segments.front();
+
+			if (nullptr == m_head) {
+				if (m_writing && 1 == m_segments.size()) { this->_seal(); }
+
+				try {
+					boost::interprocess::file_mapping file(head.path.c_str(), boost::interprocess::read_only);
+					m_head.reset(new boost::interprocess::mapped_region(file, boost::interprocess::read_only));
+					m_head->advise(boost::interprocess::mapped_region::advice_sequential);
+					m_head_offset = head.start;
+				}
+				catch (const std::exception& ex) {
+					CRAWLER_LOG(tools::debug_type::FATAL, "disk_frontier", ex.what(), ": ", head.path);
+					m_size -= head.records;
+					this->_drop_head();
+					return false;
+				}
+			}
+
+			if (m_head_offset < head.bytes && m_head_offset < m_head->get_size()) {
+				m_head_offset = _read_record(static_cast<const char*>(m_head->get_address()), m_head_offset, url, depth);
+				--head.records;
+				return true;
+			}
+
+			this->_drop_head();
+			return false;
+		}
+
+		void _drop_head() {
+			m_head.reset();
+			m_disk_bytes -= m_segments.front().bytes;
+
+			if (m_retain) { m_retired.push_back(std::move(m_segments.front())); }
+			else { std::remove(m_segments.front().path.c_str()); }
+
+			m_segments.pop_front();
+		}
+
+	private:
+		mutable std::mutex                                  m_mutex;
+
+		std::string                                         m_dir;
+		std::string                                         m_name;
+		size_t                                              m_hot_bytes;
+		size_t                                              m_segment_bytes;
+		size_t                                              m_size;
+
+		std::string                                         m_hot;
+		size_t                                              m_hot_read;
+		size_t                                              m_hot_records;
+
+		std::deque<segment>                                 m_segments;
+		std::ofstream                                       m_writer;
+		bool                                                m_writing;
+
+		std::unique_ptr<boost::interprocess::mapped_region> m_head;
+		size_t                                              m_head_offset;
+
+		size_t                                              m_next_id;
+		size_t                                              m_disk_bytes;
+
+		bool                                                m_retain;
+		/* read up, kept for the checkpoint stored */
+		std::deque<segment>                                 m_retired;
+		/* the first segment the last checkpoint needs */
+		size_t                                              m_checkpoint_head;
+	};
+
+	/*
+	 * A disk_frontier for every level: the urls of the highest level
+	 * waiting are handed out first, those of one level in the order they
+	 * came. Taking an url tries the levels from the top, one lock each,
+	 * there is no heap to keep in order. The hot buffer is shared out
+	 * among the levels.
+	 */
+	class priority_frontier : public frontier {
+
+		typedef priority_frontier self_type;
+
+	public:
+		/*
+		 * @param levels     the number of priorities.
+		 * @param hot_bytes  the size of the hot buffers of all the levels.
+		 */
+		explicit priority_frontier(
+			size_t             levels,
+			const std::string& dir           = ".",
+			size_t             hot_bytes     = disk_frontier::default_hot_bytes,
+			size_t             segment_bytes = disk_frontier::default_segment_bytes
+		) {
+			if (0 == levels) { levels = 1; }
+			for (size_t i = 0; i < levels; ++i) {
+				m_levels.emplace_back(
+					new disk_frontier(dir, hot_bytes / levels, segment_bytes, "frontier-" + std::to_string(i))
+				);
+			}
+		}
+
+		/* uncopyable */
+		priority_frontier(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		void push(std::string_view url, uint32_t depth = 0, size_t level = 0) override {
+			if (m_levels.size() <= level) { level = m_levels.size() - 1; }
+			m_levels[level]->push(url, depth);
+		}
+
+		bool pop(std::string& url, uint32_t& depth) override {
+			for (size_t i = m_levels.size(); 0 < i; --i) {
+				if (m_levels[i - 1]->pop(url, depth)) { return true; }
+			}
+			return false;
+		}
+
+		size_t size() const override {
+			size_t result = 0;
+			for (const auto& each : m_levels) { result += each->size(); }
+			return result;
+		}
+
+		size_t levels() const { return m_levels.size(); }
+
+		/* the urls waiting at one level */
+		size_t size(size_t level) const { return m_levels[level]->size(); }
+
+		void retain() override {
+			for (auto& each : m_levels) { each->retain(); }
+		}
+
+		void checkpoint(std::ostream& out) override {
+			for (auto& each : m_levels) { each->checkpoint(out); }
+		}
+
+		void commit() override {
+			for (auto& each : m_levels) { each->commit(); }
+		}
+
+		restore_result restore(const std::string& line) override {
+			for (auto& each : m_levels) {
+				auto result = each->restore(line);
+				if (restore_result::UNKNOWN != result) { return result; }
+			}
+			return restore_result::UNKNOWN;
+		}
+
+	private:
+		std::vector<std::unique_ptr<disk_frontier>> m_levels;
+	};
+}
+
+#endif
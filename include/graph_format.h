@@ -0,0 +1,554 @@
+#ifndef _CRAWLER_GRAPH_FORMAT_H_
+#define _CRAWLER_GRAPH_FORMAT_H_
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+#ifdef _CRAWLER_GRAPH_ZSTD_
+#include <zstd.h>
+#endif
+
+#include <debug.h>
+
+/*
+ * The binary link graph. The urls are numbered in sorted order, the
+ * edges are pairs of numbers, sorted and without duplicates:
+ *
+ *   file   := magic block* end
+ *   magic  := "crawlgr1"
+ *   block  := kind:u8 codec:u8 items:varint raw:varint stored:varint payload
+ *   end    := a block of kind 'Z', without payload
+ *
+ * The url blocks ('U') come first, each holds url_block urls front coded:
+ * per url the length of the prefix shared with the url before (0 for the
+ * first of a block), the length of the rest and the rest. The edge blocks
+ * ('E') hold edge_block edges as runs of one source: the source less the
+ * source of the run before (0 before the first of a block), the number of
+ * edges, the first destination, then each destination less the one before
+ * less one. The numbers are LEB128 varints.
+ *
+ * Every block restarts its coding and is compressed on its own (codec 1,
+ * zstd, when built with _CRAWLER_GRAPH_ZSTD_), so a block is read without
+ * the ones before and a reader keeps one block in memory.
+ */
+namespace crawler {
+
+	enum class graph_codec : uint8_t { NONE = 0, ZSTD = 1 };
+
+	namespace graph_detail {
+
+		static const char     magic[] = "crawlgr1";
+		static const size_t   magic_bytes = 8u;
+
+		inline void put_varint(std::string& out, uint64_t value) {
+			while (0x80 <= value) {
+				out.push_back(static_cast<char>(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<char>(value));
+		}
+
+		/* @note  false if the bytes end within the number */
+		inline bool get_varint(const char*& first, const char* last, uint64_t& value) {
+			value = 0;
+			for (int shift = 0; first != last && shift < 64; shift += 7) {
+				auto byte = static_cast<uint8_t>(*first++);
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+				if (0 == (byte & 0x80)) { return true; }
+			}
+			return false;
+		}
+
+		inline bool get_varint(std::istream& in, uint64_t& value) {
+			value = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				int byte = in.get();
+				if (std::char_traits<char>::eof() == byte) { return false; }
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+				if (0 == (byte & 0x80)) { return true; }
+			}
+			return false;
+		}
+	}
+
+	/*
+	 * Writes a graph file. The urls are appended first, in strictly
+	 * increasing order, then the edges in increasing order, a repeated
+	 * edge is dropped. An url is named by its rank among them.
+	 */
+	class graph_file_writer {
+
+		typedef graph_file_writer self_type;
+
+	public:
+		static const size_t url_block  = 4096u;
+		static const size_t edge_block = 65536u;
+
+#ifdef _CRAWLER_GRAPH_ZSTD_
+		static const graph_codec default_codec = graph_codec::ZSTD;
+#else
+		static const graph_codec default_codec = graph_codec::NONE;
+#endif
+
+		explicit graph_file_writer(const std::string& path, graph_codec codec = default_codec) :
+			m_path(path),
+			m_out(path, std::ios::binary | std::ios::trunc),
+			m_codec(codec),
+			m_kind('U'),
+			m_items(0),
+			m_urls(0),
+			m_edges(0),
+			m_has_edge(false),
+			m_run_src(0),
+			m_run_dst(0),
+			m_last_src(0),
+			m_failed(false)
+		{
+			m_out.write(graph_detail::magic, graph_detail::magic_bytes);
+			if (!m_out) { this->_fail("Failed to open "); }
+
+#ifndef _CRAWLER_GRAPH_ZSTD_
+			if (graph_codec::ZSTD == m_codec) {
+				CRAWLER_LOG(tools::debug_type::WARNING, "graph_file_writer", "Built without zstd, ", path, " is not compressed.");
+				m_codec = graph_codec::NONE;
+			}
+#endif
+		}
+
+		~graph_file_writer() { this->close(); }
+
+		/* uncopyable */
+		graph_file_writer(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		bool good() const { return !m_failed; }
+
+		uint64_t urls() const { return m_urls; }
+		uint64_t edges() const { return m_edges; }
+
+		/* @note  false if not after the url before, or edges were appended */
+		bool append_url(std::string_view url) {
+			if (m_failed) { return false; }
+			if ('U' != m_kind || (0 != m_urls && url <= std::string_view(m_last_url))) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "graph_file_writer", "Url out of order: ", url);
+				return false;
+			}
+
+			size_t shared = 0;
+			if (0 != m_items) {
+				size_t most = std::min(url.length(), m_last_url.length());
+				while (shared < most && url[shared] == m_last_url[shared]) { ++shared; }
+			}
+
+			graph_detail::put_varint(m_block, shared);
+			graph_detail::put_varint(m_block, url.length() - shared);
+			m_block.append(url.data() + shared, url.length() - shared);
+
+			m_last_url.assign(url.data(), url.length());
+			++m_urls;
+
+			if (url_block == ++m_items) { this->_write_block(); }
+			return !m_failed;
+		}
+
+		/* @note  false if before the edge before, or not between urls appended */
+		bool append_edge(uint32_t src, uint32_t dst) {
+			if (m_failed) { return false; }
+
+			if ('U' == m_kind) {
+				this->_write_block();
+				m_kind = 'E';
+			}
+
+			if (m_urls <= src || m_urls <= dst) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "graph_file_writer", "No url numbered ", std::max(src, dst));
+				return false;
+			}
+
+			if (m_has_edge) {
+				if (src == m_run_src && dst == m_run_dst) { return true; }
+				if (src < m_run_src || (src == m_run_src && dst < m_run_dst)) {
+					CRAWLER_LOG(tools::debug_type::FATAL, "graph_file_writer", "Edge out of order: ", src, ' ', dst);
+					return false;
+				}
+				if (src != m_run_src && !m_run.empty()) { this->_end_run(); }
+			}
+
+			m_has_edge = true;
+			m_run_src  = src;
+			m_run_dst  = dst;
+			m_run.push_back(dst);
+			++m_edges;
+
+			if (edge_block == ++m_items) {
+				this->_end_run();
+				this->_write_block();
+				m_last_src = 0;
+			}
+			return !m_failed;
+		}
+
+		/* @note  writes the blocks left and the end, false if it failed */
+		bool close() {
+			if (!m_out.is_open()) { return !m_failed; }
+
+			if (!m_run.empty()) { this->_end_run(); }
+			this->_write_block();
+
+			if (!m_failed) {
+				m_kind = 'Z';
+				this->_write_header(graph_codec::NONE, 0, 0, 0);
+				m_out.flush();
+				if (!m_out) { this->_fail("Failed to write "); }
+			}
+
+			m_out.close();
+			return !m_failed;
+		}
+
+	private:
+		void _end_run() {
+			graph_detail::put_varint(m_block, m_run_src - m_last_src);
+			graph_detail::put_varint(m_block, m_run.size());
+			graph_detail::put_varint(m_block, m_run.front());
+			for (size_t i = 1; i < m_run.size(); ++i) {
+				graph_detail::put_varint(m_block, m_run[i] - m_run[i - 1] - 1);
+			}
+
+			m_last_src = m_run_src;
+			m_run.clear();
+		}
+
+		void _write_block() {
+			if (0 == m_items || m_failed) { return; }
+
+			graph_codec codec = m_codec;
+			const std::string* payload = &m_block;
+
+#ifdef _CRAWLER_GRAPH_ZSTD_
+			if (graph_codec::ZSTD == codec) {
+				m_packed.resize(ZSTD_compressBound(m_block.size()));
+				size_t stored = ZSTD_compress(&m_packed[0], m_packed.size(), m_block.data(), m_block.size(), 3);
+
+				/* a block which does not shrink is stored as it is */
+				if (ZSTD_isError(stored) || m_block.size() <= stored) { codec = graph_codec::NONE; }
+				else {
+					m_packed.resize(stored);
+					payload = &m_packed;
+				}
+			}
+#endif
+
+			this->_write_header(codec, m_items, m_block.size(), payload->size());
+			m_out.write(payload->data(), payload->size());
+			if (!m_out) { this->_fail("Failed to write "); }
+
+			m_block.clear();
+			m_items = 0;
+		}
+
+		void _write_header(graph_codec codec, uint64_t items, uint64_t raw, uint64_t stored) {
+			std::string header;
+			header.push_back(m_kind);
+			header.push_back(static_cast<char>(codec));
+			graph_detail::put_varint(header, items);
+			graph_detail::put_varint(header, raw);
+			graph_detail::put_varint(header, stored);
+			m_out.write(header.data(), header.size());
+		}
+
+		void _fail(const char* what) {
+			CRAWLER_LOG(tools::debug_type::FATAL, "graph_file_writer", what, m_path);
+			m_failed = true;
+		}
+
+	private:
+		std::string           m_path;
+		std::ofstream         m_out;
+		graph_codec           m_codec;
+
+		/* the block being filled */
+		char                  m_kind;
+		size_t                m_items;
+		std::string           m_block;
+		std::string           m_packed;
+
+		uint64_t              m_urls;
+		uint64_t              m_edges;
+		std::string           m_last_url;
+
+		/* the destinations of the source being appended */
+		bool                  m_has_edge;
+		uint32_t              m_run_src;
+		uint32_t              m_run_dst;
+		std::vector<uint32_t> m_run;
+		/* the source of the run written before, in the block */
+		uint32_t              m_last_src;
+
+		bool                  m_failed;
+	};
+
+	/*
+	 * Reads a graph file a block at a time. Each for_each goes through
+	 * the file from the start.
+	 */
+	class graph_file_reader {
+
+		typedef graph_file_reader self_type;
+
+	public:
+		explicit graph_file_reader(const std::string& path) :
+			m_path(path), m_in(path, std::ios::binary)
+		{
+			char head[graph_detail::magic_bytes];
+			m_in.read(head, sizeof (head));
+
+			if (!m_in || 0 != memcmp(head, graph_detail::magic, sizeof (head))) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "graph_file_reader", "Not a graph file: ", path);
+				m_in.close();
+			}
+		}
+
+		/* uncopyable */
+		graph_file_reader(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		bool good() const { return m_in.is_open(); }
+
+		/*
+		 * @param fn  called as fn(uint32_t id, std::string_view url), the
+		 *            view lasts until the next call.
+		 * @note      false if the file is broken or cut.
+		 */
+		template <typename _Fn>
+		bool for_each_url(_Fn&& fn) {
+			uint32_t    id = 0;
+			std::string url;
+
+			return this->_scan('U', [&](const char* first, const char* last, uint64_t items) {
+				for (uint64_t i = 0; i < items; ++i) {
+					uint64_t shared, rest;
+					if (!graph_detail::get_varint(first, last, shared) ||
+						!graph_detail::get_varint(first, last, rest) ||
+						url.length() < shared || static_cast<uint64_t>(last - first) < rest) {
+						return false;
+					}
+
+					url.resize(shared);
+					url.append(first, rest);
+					first += rest;
+
+					fn(id++, std::string_view(url));
+				}
+				return first == last;
+			});
+		}
+
+		/*
+		 * @param fn  called as fn(uint32_t src, uint32_t dst), in order.
+		 * @note      false if the file is broken or cut.
+		 */
+		template <typename _Fn>
+		bool for_each_edge(_Fn&& fn) {
+			return this->_scan('E', [&](const char* first, const char* last, uint64_t items) {
+				uint64_t src = 0;
+				while (first != last) {
+					uint64_t delta, count, dst;
+					if (!graph_detail::get_varint(first, last, delta) ||
+						!graph_detail::get_varint(first, last, count) ||
+						!graph_detail::get_varint(first, last, dst) ||
+						0 == count || items < count) {
+						return false;
+					}
+
+					src   += delta;
+					items -= count;
+					fn(static_cast<uint32_t>(src), static_cast<uint32_t>(dst));
+
+					for (uint64_t i = 1; i < count; ++i) {
+						uint64_t gap;
+						if (!graph_detail::get_varint(first, last, gap)) { return false; }
+						dst += gap + 1;
+						fn(static_cast<uint32_t>(src), static_cast<uint32_t>(dst));
+					}
+				}
+				return 0 == items;
+			});
+		}
+
+	private:
+		/*
+		 * @param decode  called as decode(first, last, items) with the
+		 *                payload of each block of the kind, false if broken.
+		 */
+		template <typename _Fn>
+		bool _scan(char kind, _Fn&& decode) {
+			if (!this->good()) { return false; }
+
+			m_in.clear();
+			m_in.seekg(graph_detail::magic_bytes);
+
+			while (true) {
+				int      got   = m_in.get();
+				int      codec = m_in.get();
+				uint64_t items, raw, stored;
+
+				if (std::char_traits<char>::eof() == codec ||
+					!graph_detail::get_varint(m_in, items) ||
+					!graph_detail::get_varint(m_in, raw) ||
+					!graph_detail::get_varint(m_in, stored)) {
+					return this->_broken("cut");
+				}
+
+				if ('Z' == got) { return true; }
+
+				if (kind != got) {
+					m_in.seekg(static_cast<std::streamoff>(stored), std::ios::cur);
+					continue;
+				}
+
+				m_stored.resize(stored);
+				m_in.read(&m_stored[0], stored);
+				if (!m_in) { return this->_broken("cut"); }
+
+				const std::string* payload = &m_stored;
+				if (static_cast<uint8_t>(graph_codec::ZSTD) == codec) {
+#ifdef _CRAWLER_GRAPH_ZSTD_
+					m_raw.resize(raw);
+					size_t size = ZSTD_decompress(&m_raw[0], raw, m_stored.data(), stored);
+					if (ZSTD_isError(size) || raw != size) { return this->_broken("a block does not decompress"); }
+					payload = &m_raw;
+#else
+					return this->_broken("built without zstd");
+#endif
+				}
+				else if (static_cast<uint8_t>(graph_codec::NONE) != codec || raw != stored) {
+					return this->_broken("unknown codec");
+				}
+
+				if (!decode(payload->data(), payload->data() + payload->size(), items)) {
+					return this->_broken("a block does not decode");
+				}
+			}
+		}
+
+		bool _broken(const char* why) {
+			CRAWLER_LOG(tools::debug_type::FATAL, "graph_file_reader", m_path, ": ", why);
+			return false;
+		}
+
+	private:
+		std::string   m_path;
+		std::ifstream m_in;
+		std::string   m_stored;
+		std::string   m_raw;
+	};
+
+	/*
+	 * Encodes the graph written by the crawl (see link_graph): nodes_path
+	 * has a line "<id> <url>" per url, edges_path a line "<src> <dst>"
+	 * per edge. An edge naming an id without url is dropped.
+	 */
+	inline bool encode_graph(
+		const std::string& nodes_path,
+		const std::string& edges_path,
+		const std::string& graph_path,
+		graph_codec        codec = graph_file_writer::default_codec
+	) {
+		std::ifstream nodes(nodes_path, std::ios::binary);
+		std::ifstream edges(edges_path, std::ios::binary);
+		if (!nodes || !edges) {
+			CRAWLER_LOG(tools::debug_type::FATAL, "encode_graph", "Failed to open ", nodes_path, " or ", edges_path);
+			return false;
+		}
+
+		static const uint32_t none = UINT32_MAX;
+
+		/* the ids of the crawl, renumbered once the urls are sorted */
+		std::vector<std::pair<std::string, uint32_t>> urls;
+		std::vector<std::pair<uint32_t, uint32_t>>    links;
+		std::string line;
+
+		while (std::getline(nodes, line)) {
+			char* end = nullptr;
+			auto id = std::strtoul(line.c_str(), &end, 10);
+			if (' ' == *end) { urls.emplace_back(std::string(end + 1), static_cast<uint32_t>(id)); }
+		}
+		std::sort(urls.begin(), urls.end());
+
+		std::vector<uint32_t> rank;
+		uint32_t next = 0;
+		for (size_t i = 0; i < urls.size(); ++i) {
+			/* an url listed twice keeps one number */
+			if (0 != i && urls[i].first != urls[i - 1].first) { ++next; }
+			if (rank.size() <= urls[i].second) { rank.resize(size_t(urls[i].second) + 1, none); }
+			rank[urls[i].second] = next;
+		}
+
+		while (std::getline(edges, line)) {
+			char* end = nullptr;
+			auto src = std::strtoul(line.c_str(), &end, 10);
+			if (' ' != *end) { continue; }
+			auto dst = std::strtoul(end + 1, &end, 10);
+
+			if (rank.size() <= src || rank.size() <= dst || none == rank[src] || none == rank[dst]) { continue; }
+			links.emplace_back(rank[src], rank[dst]);
+		}
+		std::sort(links.begin(), links.end());
+
+		graph_file_writer out(graph_path, codec);
+		for (size_t i = 0; i < urls.size(); ++i) {
+			if (0 == i || urls[i].first != urls[i - 1].first) { out.append_url(urls[i].first); }
+		}
+		for (const auto& each : links) { out.append_edge(each.first, each.second); }
+
+		return out.close();
+	}
+
+	/*
+	 * Writes a graph file in the text form of url.txt: a line "<id> <url>"
+	 * per url, an empty line, then a line "<src> <dst>" per edge. The ids
+	 * are the ones of the graph file.
+	 */
+	inline bool graph_to_text(const std::string& graph_path, const std::string& text_path) {
+		graph_file_reader in(graph_path);
+		std::ofstream     out(text_path, std::ios::binary | std::ios::trunc);
+
+		std::string line;
+		auto write = [&out, &line]() {
+			out.write(line.data(), line.size());
+			line.clear();
+		};
+
+		bool result = in.for_each_url([&](uint32_t id, std::string_view url) {
+			line.append(std::to_string(id)).append(" ").append(url).append("\n");
+			if (64u * 1024u <= line.size()) { write(); }
+		});
+
+		line.append("\n");
+
+		result = result && in.for_each_edge([&](uint32_t src, uint32_t dst) {
+			line.append(std::to_string(src)).append(" ").append(std::to_string(dst)).append("\n");
+			if (64u * 1024u <= line.size()) { write(); }
+		});
+
+		write();
+		out.flush();
+
+		if (!out) {
+			CRAWLER_LOG(tools::debug_type::FATAL, "graph_to_text", "Failed to write ", text_path);
+			return false;
+		}
+		return result;
+	}
+}
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef _CRAWLER_GRAPH_WRITER_H_
+#define _CRAWLER_GRAPH_WRITER_H_
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <string_view>
+#include <condition_variable>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#define _CRAWLER_GRAPH_WRITEV_
+#else
+#include <fstream>
+#endif
+
+#include <metrics.h>
+#include <debug.h>
+
+namespace crawler {
+
+	/*
+	 * Appends the lines of the link graph to a file. The threads appending
+	 * copy into buffers of their own (one per stripe of threads, see
+	 * tools::metric_stripe, so they rarely share a lock), a full buffer is
+	 * handed to a writer thread which writes all the buffers it has with
+	 * one writev. The buffers are a fixed pool, when all are full or
+	 * being written an append waits for one (backpressure), so the memory
+	 * stays at buffers * buffer_bytes. A buffer not full is written after
+	 * flush_interval at the latest.
+	 *
+	 * Lines are never split between two buffers, so the lines of the
+	 * threads do not mix, only their order is not kept.
+	 */
+	class graph_writer {
+
+		typedef graph_writer self_type;
+
+	public:
+		static const size_t default_buffer_bytes = 1u << 20;
+		static const size_t default_buffers      = 16u;
+
+		static const std::chrono::milliseconds flush_interval;
+
+		/*
+		 * @param path          the file, appended to.
+		 * @param buffer_bytes  the size of a buffer, longer lines are cut.
+		 * @param buffers       the number of buffers, half of them at most
+		 *                      are filled at the same time.
+		 */
+		explicit graph_writer(
+			const std::string& path,
+			size_t             buffer_bytes = default_buffer_bytes,
+			size_t             buffers      = default_buffers
+		) :
+			m_path(path),
+			m_buffer_bytes(std::max<size_t>(buffer_bytes, 4096u)),
+			m_slots(std::max<size_t>(buffers / 2, 1u)),
+			m_writing(0),
+			m_stopped(false),
+			m_written(0),
+			m_wait(tools::metrics::global().histogram("graph_append_wait_ns")),
+			m_write_time(tools::metrics::global().histogram("graph_write_ns")),
+			m_bytes(tools::metrics::global().counter("graph_bytes"))
+		{
+			buffers = std::max<size_t>(buffers, m_slots.size() + 1);
+			m_buffers.resize(buffers);
+			for (auto& each : m_buffers) {
+				each.data.reset(new char[m_buffer_bytes]);
+				m_free.push_back(&each);
+			}
+
+#ifdef _CRAWLER_GRAPH_WRITEV_
+			m_file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+			if (m_file < 0) {
+#else
+			m_file.open(path, std::ios::binary | std::ios::app);
+			if (!m_file) {
+#endif
+				CRAWLER_LOG(tools::debug_type::FATAL, "graph_writer", "Failed to open ", path);
+			}
+
+			m_writer = std::thread(&self_type::_write_loop, this);
+		}
+
+		~graph_writer() { this->close(); }
+
+		/* uncopyable */
+		graph_writer(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @param lines  whole lines, each ending with '\n'.
+		 * @note         waits while every buffer is full.
+		 */
+		void append(std::string_view lines) {
+			auto& target = m_slots[tools::metric_stripe() % m_slots.size()];
+			std::lock_guard<std::mutex> locker(target.mutex);
+
+			while (!lines.empty()) {
+				if (nullptr == target.current) { target.current = this->_acquire(); }
+
+				auto&  current = *target.current;
+				size_t room    = m_buffer_bytes - current.size;
+				size_t take    = lines.size();
+
+				if (room < take) {
+					/* up to the last line which fits */
+					size_t end = lines.rfind('\n', room - 1);
+					if (std::string_view::npos != end) { take = end + 1; }
+					else if (0 == current.size) { take = room; }
+					else { take = 0; }
+				}
+
+				memcpy(current.data.get() + current.size, lines.data(), take);
+				current.size += take;
+				lines.remove_prefix(take);
+
+				if (!lines.empty() || m_buffer_bytes == current.size) {
+					this->_submit(target.current);
+					target.current = nullptr;
+				}
+			}
+		}
+
+		/*
+		 * @note  blocks until the lines appended before are written.
+		 */
+		void flush() {
+			this->_submit_partial();
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_drained.wait(locker, [this]() { return m_full.empty() && 0 == m_writing; });
+		}
+
+		/*
+		 * @note  writes what is left and closes the file, appends are not
+		 *        allowed after it.
+		 */
+		void close() {
+			if (!m_writer.joinable()) { return; }
+
+			this->_submit_partial();
+			{
+				std::lock_guard<std::mutex> locker(m_mutex);
+				m_stopped = true;
+			}
+			m_has_full.notify_one();
+			m_writer.join();
+
+#ifdef _CRAWLER_GRAPH_WRITEV_
+			if (0 <= m_file) { ::close(m_file); m_file = -1; }
+#else
+			m_file.close();
+#endif
+		}
+
+		/* the bytes written to the file so far */
+		uint64_t bytes_written() const { return m_written.load(); }
+
+		const std::string& path() const { return m_path; }
+
+	private:
+		struct buffer {
+			buffer() : size(0) { }
+
+			std::unique_ptr<char[]> data;
+			size_t                  size;
+		};
+
+		struct slot {
+			slot() : current(nullptr) { }
+
+			std::mutex mutex;
+			buffer*    current;
+		};
+
+		buffer* _acquire() {
+			std::unique_lock<std::mutex> locker(m_mutex);
+
+			if (m_free.empty()) {
+				tools::scoped_timer waiting(m_wait);
+				m_has_free.wait(locker, [this]() { return !m_free.empty(); });
+			}
+
+			auto result = m_free.back();
+			m_free.pop_back();
+			return result;
+		}
+
+		void _submit(buffer* filled) {
+			{
+				std::lock_guard<std::mutex> locker(m_mutex);
+				m_full.push_back(filled);
+			}
+			m_has_full.notify_one();
+		}
+
+		/*
+		 * hands the buffers being filled to the writer.
+		 *
+		 * @param wait  false for the writer thread, it skips the slots in
+		 *              use: an append there may be waiting for the buffers
+		 *              the writer has to write.
+		 */
+		void _submit_partial(bool wait = true) {
+			for (auto& each : m_slots) {
+				std::unique_lock<std::mutex> locker(each.mutex, std::defer_lock);
+				if (wait) { locker.lock(); }
+				else if (!locker.try_lock()) { continue; }
+
+				if (nullptr != each.current && 0 != each.current->size) {
+					this->_submit(each.current);
+					each.current = nullptr;
+				}
+			}
+		}
+
+		void _write_loop() {
+			std::vector<buffer*> batch;
+			auto last_partial = std::chrono::steady_clock::now();
+
+			while (true) {
+				{
+					std::unique_lock<std::mutex> locker(m_mutex);
+					m_has_full.wait_for(locker, flush_interval, [this]() { return !m_full.empty() || m_stopped; });
+
+					if (m_full.empty() && m_stopped) { break; }
+
+					batch.assign(m_full.begin(), m_full.end());
+					m_full.clear();
+					m_writing = batch.size();
+				}
+
+				if (!batch.empty()) {
+					tools::scoped_timer timer(m_write_time);
+					this->_write(batch);
+				}
+
+				{
+					std::lock_guard<std::mutex> locker(m_mutex);
+					for (auto each : batch) {
+						each->size = 0;
+						m_free.push_back(each);
+					}
+					m_writing = 0;
+				}
+				m_has_free.notify_all();
+				m_drained.notify_all();
+
+				/* the lines appended slowly are not kept back longer than flush_interval */
+				auto now = std::chrono::steady_clock::now();
+				if (flush_interval <= now - last_partial) {
+					this->_submit_partial(false);
+					last_partial = now;
+				}
+			}
+		}
+
+		void _write(const std::vector<buffer*>& batch) {
+			uint64_t bytes = 0;
+			for (auto each : batch) { bytes += each->size; }
+
+#ifdef _CRAWLER_GRAPH_WRITEV_
+			if (m_file < 0) { return; }
+
+			std::vector<iovec> parts;
+			for (auto each : batch) { parts.push_back(iovec{ each->data.get(), each->size }); }
+
+			size_t first = 0;
+			while (first < parts.size()) {
+				int     count   = static_cast<int>(std::min<size_t>(parts.size() - first, IOV_MAX));
+				ssize_t written = ::writev(m_file, parts.data() + first, count);
+
+				if (written < 0) {
+					if (EINTR == errno) { continue; }
+					CRAWLER_LOG(tools::debug_type::FATAL, "graph_writer", "Failed to write ", m_path, ": ", strerror(errno));
+					return;
+				}
+
+				/* a short write goes on where it stopped */
+				size_t left = static_cast<size_t>(written);
+				while (first < parts.size() && parts[first].iov_len <= left) {
+					left -= parts[first].iov_len;
+					++first;
+				}
+				if (first < parts.size()) {
+					parts[first].iov_base = static_cast<char*>(parts[first].iov_base) + left;
+					parts[first].iov_len -= left;
+				}
+			}
+#else
+			for (auto each : batch) { m_file.write(each->data.get(), each->size); }
+			m_file.flush();
+
+			if (!m_file) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "graph_writer", "Failed to write ", m_path);
+				return;
+			}
+#endif
+
+			m_written += bytes;
+			m_bytes.add(bytes);
+		}
+
+	private:
+		const std::string       m_path;
+		const size_t            m_buffer_bytes;
+
+		std::vector<buffer>     m_buffers;
+		std::vector<slot>       m_slots;
+
+		std::mutex              m_mutex;
+		std::condition_variable m_has_free;
+		std::condition_variable m_has_full;
+		std::condition_variable m_drained;
+		std::vector<buffer*>    m_free;
+		std::deque<buffer*>     m_full;
+		size_t                  m_writing;
+		bool                    m_stopped;
+
+#ifdef _CRAWLER_GRAPH_WRITEV_
+		int                     m_file;
+#else
+		std::ofstream           m_file;
+#endif
+		std::thread             m_writer;
+		std::atomic<uint64_t>   m_written;
+
+		tools::histogram&       m_wait;
+		tools::histogram&       m_write_time;
+		tools::counter&         m_bytes;
+	};
+
+	const std::chrono::milliseconds graph_writer::flush_interval(1000);
+}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef _CRAWLER_HOST_SCHEDULER_H_
+#define _CRAWLER_HOST_SCHEDULER_H_
+
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+namespace crawler {
+
+	/*
+	 * Orders the fetches by host. Every host has its own queue, at most
+	 * max_per_host of its items are in flight and two fetches of a host
+	 * start at least delay apart. Hosts which may fetch now take turns
+	 * (round robin), hosts which have to wait for their delay sit in a
+	 * min-heap by the time they may fetch again, and hosts with all their
+	 * slots taken are left out until release() is called. So one large
+	 * host gets its share and no more, and the rate grows with the number
+	 * of hosts.
+	 */
+	template <typename _Tp>
+	class host_scheduler {
+
+		typedef host_scheduler<_Tp> self_type;
+
+	public:
+		typedef _Tp                       value_type;
+		typedef std::chrono::steady_clock clock_type;
+
+		static const size_t default_max_per_host = 2u;
+		static const size_t default_max_backlog  = 64u;
+
+		static const std::chrono::milliseconds default_delay;
+
+		/*
+		 * @param max_per_host  the number of items of a host in flight.
+		 * @param delay         the least time between two fetches of a host.
+		 * @param max_backlog   the number of items a host may queue.
+		 */
+		explicit host_scheduler(
+			size_t                    max_per_host = default_max_per_host,
+			std::chrono::milliseconds delay        = default_delay,
+			size_t                    max_backlog  = default_max_backlog
+		) :
+			m_max_per_host(0 == max_per_host ? 1u : max_per_host),
+			m_delay(delay),
+			m_max_backlog(max_backlog),
+			m_size(0),
+			m_in_flight(0),
+			m_queued_hosts(0),
+			m_full_hosts(0) { }
+
+		/* uncopyable */
+		host_scheduler(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @ret  false if the queue of the host is full, item is not moved
+		 *       from in that case.
+		 */
+		bool push(uint32_t host, value_type& item) {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			auto& state = m_hosts[host];
+			if (m_max_backlog <= state.items.size()) { return false; }
+
+			if (state.items.empty()) { ++m_queued_hosts; }
+			state.items.push_back(std::move(item));
+			++m_size;
+			if (m_max_backlog == state.items.size()) { ++m_full_hosts; }
+
+			if (!state.scheduled && state.in_flight < m_max_per_host) {
+				this->_schedule(host, state, clock_type::now());
+			}
+
+			return true;
+		}
+
+		/*
+		 * @ret  false if no host may fetch now. Otherwise the item goes in
+		 *       flight, release(host) has to be called when it is done.
+		 */
+		bool pop(value_type& item, uint32_t& host) {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			auto now = clock_type::now();
+
+			while (!m_waiting.empty() && m_waiting.top().first <= now) {
+				m_ready.push_back(m_waiting.top().second);
+				m_waiting.pop();
+			}
+
+			this->_sweep(now);
+
+			if (m_ready.empty()) { return false; }
+
+			host = m_ready.front();
+			m_ready.pop_front();
+
+			auto& state = m_hosts[host];
+			state.scheduled = false;
+
+			if (m_max_backlog == state.items.size()) { --m_full_hosts; }
+			item = std::move(state.items.front());
+			state.items.pop_front();
+			--m_size;
+			if (state.items.empty()) { --m_queued_hosts; }
+
+			++state.in_flight;
+			++m_in_flight;
+			state.next_fetch = now + m_delay;
+
+			if (!state.items.empty() && state.in_flight < m_max_per_host) {
+				this->_schedule(host, state, now);
+			}
+
+			return true;
+		}
+
+		/*
+		 * @note  an item of host popped before is done (whether it succeeded
+		 *        or not).
+		 */
+		void release(uint32_t host) {
+			{
+				std::lock_guard<std::mutex> locker(m_mutex);
+
+				auto itr = m_hosts.find(host);
+				if (m_hosts.end() == itr) { return; }
+
+				auto& state = itr->second;
+				auto  now   = clock_type::now();
+
+				--state.in_flight;
+				--m_in_flight;
+
+				if (!state.items.empty()) {
+					if (!state.scheduled) { this->_schedule(host, state, now); }
+				}
+				else if (0 == state.in_flight) {
+					/* kept until its delay is over, so a new item still waits for it */
+					if (state.next_fetch <= now) { m_hosts.erase(itr); }
+					else { m_idle.emplace_back(state.next_fetch, host); }
+				}
+			}
+
+			m_released.notify_all();
+		}
+
+		/*
+		 * @note  blocks until a host may fetch, an item is released or time
+		 *        is over, whichever comes first.
+		 */
+		template <typename _Rep, typename _Period>
+		void wait_for(const std::chrono::duration<_Rep, _Period>& time) {
+			std::unique_lock<std::mutex> locker(m_mutex);
+
+			if (!m_ready.empty()) { return; }
+
+			auto deadline = clock_type::now() + time;
+			if (!m_waiting.empty() && m_waiting.top().first < deadline) {
+				deadline = m_waiting.top().first;
+			}
+
+			m_released.wait_until(locker, deadline);
+		}
+
+		/* the number of items queued, not counting those in flight */
+		size_t size() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_size;
+		}
+
+		bool empty() const { return 0 == this->size(); }
+
+		/*
+		 * @ret  true if every host with items queued has max_backlog of
+		 *       them, an item pushed now is refused unless its host is new.
+		 */
+		bool saturated() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return 0 != m_queued_hosts && m_queued_hosts == m_full_hosts;
+		}
+
+		size_t in_flight() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_in_flight;
+		}
+
+		/* the number of hosts known, idle ones still in their delay included */
+		size_t hosts() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_hosts.size();
+		}
+
+	private:
+		struct host_state {
+			host_state() : in_flight(0), scheduled(false) { }
+
+			std::deque<value_type> items;
+			size_t                 in_flight;
+			clock_type::time_point next_fetch;
+			/* whether the host is in m_ready or m_waiting */
+			bool                   scheduled;
+		};
+
+		typedef std::pair<clock_type::time_point, uint32_t> timed_host;
+
+		/*
+		 * @note  the host has items and a free slot.
+		 */
+		void _schedule(uint32_t host, host_state& state, clock_type::time_point now) {
+			state.scheduled = true;
+			if (state.next_fetch <= now) { m_ready.push_back(host); }
+			else { m_waiting.emplace(state.next_fetch, host); }
+		}
+
+		/*
+		 * @note  forgets the hosts which went idle and whose delay is over,
+		 *        the delay is the same for all, so m_idle is in time order.
+		 */
+		void _sweep(clock_type::time_point now) {
+			while (!m_idle.empty() && m_idle.front().first <= now) {
+				auto itr = m_hosts.find(m_idle.front().second);
+				m_idle.pop_front();
+
+				if (m_hosts.end() == itr) { continue; }
+
+				const auto& state = itr->second;
+				if (state.items.empty() && 0 == state.in_flight && state.next_fetch <= now) {
+					m_hosts.erase(itr);
+				}
+			}
+		}
+
+	private:
+		mutable std::mutex                         m_mutex;
+		std::condition_variable                    m_released;
+
+		const size_t                               m_max_per_host;
+		const std::chrono::milliseconds            m_delay;
+		const size_t                               m_max_backlog;
+
+		std::unordered_map<uint32_t, host_state>   m_hosts;
+		std::deque<uint32_t>                       m_ready;
+		std::priority_queue<
+			timed_host, std::vector<timed_host>, std::greater<timed_host>
+		>                                          m_waiting;
+		std::deque<timed_host>                     m_idle;
+
+		size_t                                     m_size;
+		size_t                                     m_in_flight;
+		/* the hosts with items queued, and those of them at max_backlog */
+		size_t                                     m_queued_hosts;
+		size_t                                     m_full_hosts;
+	};
+
+	template <typename _Tp>
+	const std::chrono::milliseconds host_scheduler<_Tp>::default_delay(100);
+}
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef _CRAWLER_HTTP_PARSER_H_
+#define _CRAWLER_HTTP_PARSER_H_
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+#include <http_response.h>
+
+namespace crawler {
+
+	/*
+	 * Incremental HTTP/1.x response parser. It finds where a response ends
+	 * on a persistent connection (Content-Length, chunked or read-until-EOF)
+	 * and fills an http_response: the header is copied into its header
+	 * string, the body is read in place into its buffer_chain (prepare and
+	 * commit) and chunk framing is removed by moving the data down within
+	 * the same block. A body longer than max_body_size is malformed, the
+	 * Content-Length is trusted up to max_reserve_size only: a larger
+	 * body grows in blocks as it comes.
+	 */
+	class http_response_parser {
+	public:
+		static const size_t max_body_size    = 64u << 20;
+		static const size_t max_reserve_size = 4u << 20;
+
+		enum class status {
+			HEADER, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER, UNTIL_EOF, COMPLETE, BAD
+		};
+
+		http_response_parser() : m_resp(nullptr), m_prepared(nullptr) { reset(); }
+
+		explicit http_response_parser(http_response& resp) : m_prepared(nullptr) { reset(resp); }
+
+		void reset() {
+			m_stat       = status::HEADER;
+			m_line.clear();
+			m_scanned    = 0;
+			m_remaining  = 0;
+			m_code       = 0;
+			m_keep_alive = false;
+			m_received   = 0;
+		}
+
+		void reset(http_response& resp) {
+			m_resp = &resp;
+			reset();
+		}
+
+		/*
+		 * @note  the header is read into a separate buffer, afterwards the 
+		 *        body is read into the space returned by prepare().
+		 */
+		bool reading_header() const { return status::HEADER == m_stat; }
+
+		/*
+		 * @param data  bytes read from the connection.
+		 * @param len   the number of bytes in data.
+		 * @ret         false if the response is malformed.
+		 */
+		bool feed(const char* data, size_t len) {
+			if (status::HEADER == m_stat) {
+				m_received += len;
+
+				auto& header = m_resp->header_buffer();
+				header.append(data, len);
+
+				size_t from = 3 < m_scanned ? m_scanned - 3 : 0;
+				size_t end  = header.find("\r\n\r\n", from);
+				if (std::string::npos == end) {
+					m_scanned = header.length();
+					return true;
+				}
+
+				end += 4;
+				size_t rest = header.length() - end;
+
+				if (!this->_parse_header()) {
+					m_stat = status::BAD;
+					return false;
+				}
+
+				/* the bytes after the header are moved into the body */
+				data += len - rest;
+				len   = rest;
+				header.resize(end);
+				m_received -= len;
+			}
+
+			while (0 < len && !this->complete() && !this->bad()) {
+				auto space = this->prepare();
+				size_t n = len < space.second ? len : space.second;
+				memcpy(space.first, data, n);
+				this->commit(n);
+				data += n;
+				len  -= n;
+			}
+
+			if (0 < len) { m_keep_alive = false; }
+
+			return !this->bad();
+		}
+
+		/*
+		 * @ret  the free space at the end of the body to read into.
+		 */
+		tools::buffer_chain::mutable_buffer prepare() {
+			size_t block_size = 
+				status::BODY == m_stat && m_remaining <= max_reserve_size ? m_remaining : default_block_size;
+			auto space = m_resp->body_buffer().prepare(block_size);
+			m_prepared = space.first;
+			return space;
+		}
+
+		/*
+		 * @note  n bytes have been read into the space returned by the last
+		 *        prepare().
+		 * @ret   false if the response is malformed.
+		 */
+		bool commit(size_t n) {
+			m_received += n;
+			m_resp->body_buffer().commit(this->_consume(m_prepared, n));
+			/* chunked or until eof, the length is only known at the end */
+			if (max_body_size < m_resp->body_buffer().size()) { m_stat = status::BAD; }
+			return !this->bad();
+		}
+
+		/*
+		 * @note  called when the peer closed the connection.
+		 * @ret   true if the response is complete after the eof.
+		 */
+		bool finish() {
+			if (status::UNTIL_EOF == m_stat) {
+				m_stat = status::COMPLETE;
+			}
+			m_keep_alive = false;
+			return status::COMPLETE == m_stat;
+		}
+
+		bool complete() const { return status::COMPLETE == m_stat; }
+		bool bad() const { return status::BAD == m_stat; }
+		bool keep_alive() const { return m_keep_alive && complete(); }
+
+		status current() const { return m_stat; }
+		int    status_code() const { return m_code; }
+		size_t received() const { return m_received; }
+
+	private:
+		static bool _iequals(const char* first, const char* last, const char* str) {
+			size_t len = strlen(str);
+			if ((size_t)(last - first) != len) { return false; }
+			for (size_t i = 0; i < len; ++i) {
+				if (tolower((unsigned char) first[i]) != str[i]) { return false; }
+			}
+			return true;
+		}
+
+		static bool _icontains(const char* first, const char* last, const char* str) {
+			size_t len = strlen(str);
+			while (len <= (size_t)(last - first)) {
+				if (_iequals(first, first + len, str)) { return true; }
+				++first;
+			}
+			return false;
+		}
+
+		bool _parse_header() {
+			const auto& header = m_resp->header_buffer();
+
+			const char* first = header.data();
+			const char* last  = first + header.find("\r\n\r\n") + 4;
+
+			/* status line: HTTP/1.x ddd reason */
+			if (header.length() < 12 || 0 != strncmp(first, "HTTP/1.", 7)) {
+				return false;
+			}
+
+			bool http10 = '0' == first[7];
+			m_code = atoi(first + 9);
+			m_resp->set_status_code(m_code);
+
+			bool has_length = false, chunked = false, close = http10, keep = false;
+			size_t length = 0;
+
+			const char* line = static_cast<const char*>(memchr(first, '\n', last - first)) + 1;
+			while (line < last) {
+				const char* eol = static_cast<const char*>(memchr(line, '\n', last - line));
+				if (nullptr == eol) { break; }
+
+				const char* value_end = ('\r' == *(eol - 1)) ? eol - 1 : eol;
+				const char* colon = static_cast<const char*>(memchr(line, ':', value_end - line));
+
+				if (nullptr != colon) {
+					const char* value = colon + 1;
+					while (value < value_end && (' ' == *value || '\t' == *value)) { ++value; }
+
+					if (_iequals(line, colon, "content-length")) {
+						has_length = true;
+						length = strtoull(value, nullptr, 10);
+					}
+					else if (_iequals(line, colon, "transfer-encoding")) {
+						chunked = _icontains(value, value_end, "chunked");
+					}
+					else if (_iequals(line, colon, "connection")) {
+						close = close || _icontains(value, value_end, "close");
+						keep  = _icontains(value, value_end, "keep-alive");
+					}
+				}
+
+				line = eol + 1;
+			}
+
+			m_keep_alive = http10 ? keep : !close;
+
+			if ((100 <= m_code && m_code < 200) || 204 == m_code || 304 == m_code) {
+				m_stat = status::COMPLETE;
+			}
+			else if (chunked) {
+				m_stat = status::CHUNK_SIZE;
+			}
+			else if (has_length) {
+				if (max_body_size < length) { return false; }
+
+				m_remaining = length;
+				m_stat = 0 == length ? status::COMPLETE : status::BODY;
+				/* the body is read into one block of the exact size, if it is not too large */
+				if (0 != length) { m_resp->body_buffer().reserve(length < max_reserve_size ? length : max_reserve_size); }
+			}
+			else {
+				/* no framing, the body ends with the connection */
+				m_keep_alive = false;
+				m_stat = status::UNTIL_EOF;
+			}
+
+			return true;
+		}
+
+		/*
+		 * @note  data is the space just read into, the body bytes are moved 
+		 *        to its front and the framing bytes are dropped.
+		 * @ret   the number of body bytes at the front of data.
+		 */
+		size_t _consume(char* data, size_t len) {
+			char*       out  = data;
+			const char* itr  = data;
+			const char* last = data + len;
+
+			while (itr < last) {
+				switch (m_stat) {
+					case status::BODY:
+					case status::CHUNK_DATA: {
+						size_t n = std::min<size_t>(m_remaining, last - itr);
+						if (out != itr) { memmove(out, itr, n); }
+						out += n;
+						itr += n;
+						m_remaining -= n;
+						if (0 == m_remaining) {
+							m_stat = status::BODY == m_stat ? status::COMPLETE : status::CHUNK_END;
+						}
+						break;
+					}
+
+					case status::UNTIL_EOF: {
+						size_t n = last - itr;
+						if (out != itr) { memmove(out, itr, n); }
+						out += n;
+						itr  = last;
+						break;
+					}
+
+					case status::CHUNK_SIZE:
+					case status::CHUNK_END:
+					case status::TRAILER: {
+						const char* eol = static_cast<const char*>(memchr(itr, '\n', last - itr));
+						if (nullptr == eol) {
+							m_line.append(itr, last - itr);
+							itr = last;
+							break;
+						}
+						m_line.append(itr, eol - itr);
+						itr = eol + 1;
+						if (!m_line.empty() && '\r' == m_line.back()) { m_line.pop_back(); }
+
+						if (!this->_handle_line()) {
+							m_stat = status::BAD;
+							return out - data;
+						}
+						m_line.clear();
+						break;
+					}
+
+					case status::COMPLETE: {
+						/* unexpected bytes after the response, do not reuse the connection */
+						m_keep_alive = false;
+						return out - data;
+					}
+
+					default: { return out - data; }
+				}
+			}
+
+			return out - data;
+		}
+
+		bool _handle_line() {
+			switch (m_stat) {
+				case status::CHUNK_SIZE: {
+					char* end = nullptr;
+					m_remaining = strtoull(m_line.c_str(), &end, 16);
+					if (end == m_line.c_str()) { return false; }
+					m_stat = 0 == m_remaining ? status::TRAILER : status::CHUNK_DATA;
+					return true;
+				}
+
+				case status::CHUNK_END: {
+					if (!m_line.empty()) { return false; }
+					m_stat = status::CHUNK_SIZE;
+					return true;
+				}
+
+				case status::TRAILER: {
+					if (m_line.empty()) { m_stat = status::COMPLETE; }
+					return true;
+				}
+
+				default: { return false; }
+			}
+		}
+
+	private:
+		static const size_t default_block_size = tools::buffer_chain::default_block_size;
+
+		http_response* m_resp;
+		char*          m_prepared;
+
+		status      m_stat;
+		std::string m_line;
+		size_t      m_scanned;
+		size_t      m_remaining;
+		int         m_code;
+		bool        m_keep_alive;
+		size_t      m_received;
+	};
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _CRAWLER_HTTP_RESPONSE_H_
+#define _CRAWLER_HTTP_RESPONSE_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <buffer_chain.h>
+
+namespace crawler {
+
+	/*
+	 * A response as read from the connection: the status line and headers,
+	 * the decoded body in a buffer_chain filled by the read loop, and the
+	 * url it was requested from. It is passed around by http_response_ptr,
+	 * the body is never copied after it has been read.
+	 */
+	class http_response {
+
+		typedef http_response self_type;
+
+	public:
+		explicit http_response(std::string url) :
+			m_url(std::move(url)), m_code(0), m_sealed(false) { }
+
+		/* uncopyable */
+		http_response(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		const std::string& request_url() const { return m_url; }
+
+		int status_code() const { return m_code; }
+
+		/* the status line and the headers, ending with an empty line */
+		const std::string& header() const { return m_header; }
+
+		/*
+		 * @note  a contiguous view of the body, valid after seal().
+		 */
+		std::string_view body() const { return m_body.view(); }
+
+		size_t body_size() const { return m_body.size(); }
+
+		/*
+		 * @note  called once the response is complete, a body which did not
+		 *        fit in one block (unknown length) is merged here, so the
+		 *        response is immutable and contiguous afterwards.
+		 */
+		void seal() {
+			m_body.linearize();
+			m_sealed = true;
+		}
+
+		bool sealed() const { return m_sealed; }
+
+		/* filled by http_response_parser */
+		std::string&         header_buffer() { return m_header; }
+		tools::buffer_chain& body_buffer() { return m_body; }
+		void                 set_status_code(int code) { m_code = code; }
+
+	private:
+		std::string         m_url;
+		std::string         m_header;
+		tools::buffer_chain m_body;
+		int                 m_code;
+		bool                m_sealed;
+	};
+
+	typedef std::shared_ptr<http_response> http_response_ptr;
+}
+
+#endif
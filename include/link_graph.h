@@ -0,0 +1,363 @@
+#ifndef _CRAWLER_LINK_GRAPH_H_
+#define _CRAWLER_LINK_GRAPH_H_
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+#include <hash.h>
+#include <fingerprint_set.h>
+#include <graph_writer.h>
+#include <metrics.h>
+#include <debug.h>
+
+namespace crawler {
+
+	/*
+	 * The id of every url of the graph, given out in the order the urls
+	 * are first seen (by any thread). An url is known by the 64-bit hash of
+	 * its text, which is all the map keeps of it.
+	 */
+	class url_ids {
+
+		typedef url_ids self_type;
+
+	public:
+		url_ids() : m_next(0) { }
+
+		/* uncopyable */
+		url_ids(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		static uint64_t key(std::string_view url) { return tools::murmur3_128(url).low; }
+
+		/*
+		 * @param fresh  set if the url got its id now.
+		 */
+		uint32_t assign(std::string_view url, bool& fresh) {
+			const uint64_t k = key(url);
+			auto& target = m_shards[(k >> 56) % shards];
+			std::lock_guard<std::mutex> locker(target.mutex);
+
+			auto result = target.ids.emplace(k, 0);
+			fresh = result.second;
+			if (fresh) { result.first->second = m_next.fetch_add(1, std::memory_order_relaxed); }
+			return result.first->second;
+		}
+
+		/* @note  for loading, the ids given out from then on follow the largest */
+		void restore(std::string_view url, uint32_t id) {
+			const uint64_t k = key(url);
+			auto& target = m_shards[(k >> 56) % shards];
+			std::lock_guard<std::mutex> locker(target.mutex);
+
+			target.ids[k] = id;
+			this->reserve(id);
+		}
+
+		/* no id up to id is given out */
+		void reserve(uint32_t id) {
+			size_t next = m_next.load();
+			while (next <= id && !m_next.compare_exchange_weak(next, size_t(id) + 1)) { }
+		}
+
+		size_t size() const { return m_next.load(); }
+
+		void clear() {
+			for (auto& each : m_shards) {
+				std::lock_guard<std::mutex> locker(each.mutex);
+				each.ids.clear();
+			}
+			m_next.store(0);
+		}
+
+	private:
+		static const size_t shards = 16u;
+
+		struct shard {
+			std::mutex                             mutex;
+			std::unordered_map<uint64_t, uint32_t> ids;
+		};
+
+	private:
+		shard               m_shards[shards];
+		std::atomic<size_t> m_next;
+	};
+
+	/*
+	 * The edges of the graph, each pair of ids once. The pairs are mixed
+	 * into fingerprints (one to one, so there are no false duplicates) and
+	 * kept in tools::fingerprint_table, about 16 bytes an edge.
+	 */
+	class edge_set {
+
+		typedef edge_set self_type;
+
+	public:
+		edge_set() = default;
+
+		/* uncopyable */
+		edge_set(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/* @ret  true if the edge was not in the set */
+		bool insert(uint32_t src, uint32_t dst) {
+			const uint64_t fp = tools::fmix64((static_cast<uint64_t>(src) << 32) | dst);
+			auto& target = m_shards[fp >> 60];
+			std::lock_guard<std::mutex> locker(target.mutex);
+			return target.edges.insert(fp);
+		}
+
+		size_t size() const {
+			size_t result = 0;
+			for (const auto& each : m_shards) {
+				std::lock_guard<std::mutex> locker(each.mutex);
+				result += each.edges.size();
+			}
+			return result;
+		}
+
+		void clear() {
+			for (auto& each : m_shards) {
+				std::lock_guard<std::mutex> locker(each.mutex);
+				each.edges = tools::fingerprint_table();
+			}
+		}
+
+	private:
+		static const size_t shards = 16u;
+
+		struct shard {
+			mutable std::mutex       mutex;
+			tools::fingerprint_table edges;
+		};
+
+	private:
+		shard m_shards[shards];
+	};
+
+	/*
+	 * The link graph in the text form of url.txt, built while crawling:
+	 * the urls get their ids as the pages are analyzed and a line
+	 * "<id> <url>" goes to path.nodes, a new edge goes to path.edges as
+	 * "<src> <dst>". Both are written through a graph_writer, export_text
+	 * joins them into url.txt (an empty line between), a copy with nothing
+	 * to parse.
+	 *
+	 * On resume the two files are read back to restore the ids and the
+	 * edges. A line cut by a crash is dropped, an edge whose node line was
+	 * lost keeps its ids, no url gets them again.
+	 */
+	class link_graph {
+
+		typedef link_graph self_type;
+
+	public:
+		/*
+		 * @param path    the files are path.nodes and path.edges.
+		 * @param resume  goes on with the files there, else they are
+		 *                started over.
+		 */
+		link_graph(const std::string& path, bool resume) :
+			m_nodes_path(path + ".nodes"),
+			m_edges_path(path + ".edges"),
+			m_nodes(tools::metrics::global().counter("graph_nodes")),
+			m_edges(tools::metrics::global().counter("graph_edges")),
+			m_duplicates(tools::metrics::global().counter("graph_duplicate_edges"))
+		{
+			if (!(resume && this->_load())) {
+				std::error_code ignored;
+				std::filesystem::remove(m_nodes_path, ignored);
+				std::filesystem::remove(m_edges_path, ignored);
+			}
+
+			m_nodes_out.reset(new graph_writer(m_nodes_path));
+			m_edges_out.reset(new graph_writer(m_edges_path));
+		}
+
+		/* uncopyable */
+		link_graph(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		/*
+		 * @param first, last  the links of the page source, strings or views.
+		 */
+		template <typename _ForwardItr>
+		void add(std::string_view source, _ForwardItr first, _ForwardItr last) {
+			thread_local std::string nodes;
+			thread_local std::string edges;
+			nodes.clear();
+			edges.clear();
+
+			bool fresh;
+			const uint32_t src = m_ids.assign(source, fresh);
+			if (fresh) { _node_line(nodes, src, source); }
+
+			size_t added = 0, duplicates = 0;
+
+			for (; first != last; ++first) {
+				std::string_view link(*first);
+
+				const uint32_t dst = m_ids.assign(link, fresh);
+				if (fresh) { _node_line(nodes, dst, link); }
+
+				if (!m_links.insert(src, dst)) { ++duplicates; continue; }
+
+				_append_number(edges, src).push_back(' ');
+				_append_number(edges, dst).push_back('\n');
+				++added;
+			}
+
+			if (!nodes.empty()) { m_nodes_out->append(nodes); }
+			if (!edges.empty()) { m_edges_out->append(edges); }
+
+			m_edges.add(added);
+			m_duplicates.add(duplicates);
+		}
+
+		/* writes out the lines left, nothing can be added after it */
+		void close() {
+			m_nodes_out->close();
+			m_edges_out->close();
+		}
+
+		/*
+		 * @note  closes the graph and writes it to path in the form of
+		 *        url.txt.
+		 */
+		bool export_text(const std::string& path) {
+			this->close();
+
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			std::ifstream nodes(m_nodes_path, std::ios::binary);
+			std::ifstream edges(m_edges_path, std::ios::binary);
+
+			/* an empty file gives rdbuf nothing to copy, which sets failbit */
+			if (std::char_traits<char>::eof() != nodes.peek()) { out << nodes.rdbuf(); }
+			out << '\n';
+			if (std::char_traits<char>::eof() != edges.peek()) { out << edges.rdbuf(); }
+			out.flush();
+
+			if (!out) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "link_graph", "Failed to write ", path);
+				return false;
+			}
+			return true;
+		}
+
+		const std::string& nodes_path() const { return m_nodes_path; }
+		const std::string& edges_path() const { return m_edges_path; }
+
+		size_t nodes() const { return m_ids.size(); }
+		size_t edges() const { return m_links.size(); }
+
+	private:
+		static std::string& _append_number(std::string& out, uint32_t value) {
+			char digits[16];
+			char* end = digits + sizeof (digits);
+			char* at  = end;
+			do { *--at = static_cast<char>('0' + value % 10); value /= 10; } while (0 != value);
+			return out.append(at, end);
+		}
+
+		void _node_line(std::string& out, uint32_t id, std::string_view url) {
+			_append_number(out, id).append(" ").append(url).push_back('\n');
+			m_nodes.add();
+		}
+
+		/*
+		 * @note  reads both files back, each cut after its last whole line.
+		 *        false if one of them is missing or can not be read, what
+		 *        was read is dropped then.
+		 */
+		bool _load() {
+			std::error_code ignored;
+			if (!std::filesystem::exists(m_nodes_path, ignored) || !std::filesystem::exists(m_edges_path, ignored)) {
+				CRAWLER_LOG(tools::debug_type::WARNING, "link_graph", "No graph to resume in ", m_nodes_path);
+				return false;
+			}
+
+			bool result = _read_lines(m_nodes_path, [this](std::string_view line) {
+				char* end = nullptr;
+				auto id = std::strtoul(line.data(), &end, 10);
+				if (' ' != *end) { return; }
+				m_ids.restore(std::string_view(end + 1, line.data() + line.length() - end - 1), static_cast<uint32_t>(id));
+			});
+
+			result = result && _read_lines(m_edges_path, [this](std::string_view line) {
+				char* end = nullptr;
+				auto src = std::strtoul(line.data(), &end, 10);
+				if (' ' != *end) { return; }
+				auto dst = std::strtoul(end + 1, &end, 10);
+
+				m_ids.reserve(static_cast<uint32_t>(std::max(src, dst)));
+				m_links.insert(static_cast<uint32_t>(src), static_cast<uint32_t>(dst));
+			});
+
+			if (!result) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "link_graph", "Failed to read back ", m_nodes_path, " and ", m_edges_path);
+				m_ids.clear();
+				m_links.clear();
+				return false;
+			}
+
+			CRAWLER_LOG(
+				tools::debug_type::INFO, "link_graph",
+				"Resumed with ", m_ids.size(), " urls, ", m_links.size(), " edges."
+			);
+			return true;
+		}
+
+		/*
+		 * @param fn  called with each line, without the '\n', the view ends
+		 *            with a '\0'.
+		 * @note      false if the file can not be read or cut.
+		 */
+		template <typename _Fn>
+		static bool _read_lines(const std::string& path, _Fn&& fn) {
+			std::ifstream in(path, std::ios::binary);
+			if (!in) { return false; }
+
+			std::string line;
+			uint64_t    whole = 0;
+
+			while (std::getline(in, line)) {
+				if (in.eof()) { break; }
+				whole += line.length() + 1;
+				fn(std::string_view(line));
+			}
+			in.close();
+
+			std::error_code error;
+			if (whole != std::filesystem::file_size(path, error)) {
+				std::filesystem::resize_file(path, whole, error);
+			}
+			return !error;
+		}
+
+	private:
+		std::string                   m_nodes_path;
+		std::string                   m_edges_path;
+
+		url_ids                       m_ids;
+		edge_set                      m_links;
+
+		std::unique_ptr<graph_writer> m_nodes_out;
+		std::unique_ptr<graph_writer> m_edges_out;
+
+		tools::counter&               m_nodes;
+		tools::counter&               m_edges;
+		tools::counter&               m_duplicates;
+	};
+}
+
+#endif
@@ -6,17 +6,42 @@
 
 #include <bounded_blocking_queue.h>
 #include <message_base.h>
+#include <object_pool.h>
 
 namespace tools {
 
 	template <typename _MessageCatagoty>
 	using msg_ptr = std::shared_ptr<message_base<_MessageCatagoty>>;
 
+	/*
+	 * @note  messages are made here rather than with new, the message and
+	 *        its control block come from the block pools.
+	 */
+	template <typename _Message, typename... _Args>
+	std::shared_ptr<_Message> make_message(_Args&&... args) {
+		return make_pooled<_Message>(std::forward<_Args>(args)...);
+	}
+
+	/*
+	 * define _CRAWLER_LOCKFREE_QUEUE_ to use the lock-free ring backend.
+	 * the deque backend takes its nodes from the block pools, so neither
+	 * allocates once the queue has reached its size. In core this is the
+	 * candidates and the responses queues: the seeds queue is ordered by
+	 * priority (bucket_queue) and the switch does not change it.
+	 */
+#ifdef _CRAWLER_LOCKFREE_QUEUE_
+	template <typename _MessageCatagoty>
+	using message_queue = bounded_blocking_queue<
+		msg_ptr<_MessageCatagoty>,
+		mpmc_ring<msg_ptr<_MessageCatagoty>>
+	>;
+#else
 	template <typename _MessageCatagoty>
 	using message_queue = bounded_blocking_queue<
 		msg_ptr<_MessageCatagoty>,
-		std::deque<msg_ptr<_MessageCatagoty>>
+		std::deque<msg_ptr<_MessageCatagoty>, pool_allocator<msg_ptr<_MessageCatagoty>>>
 	>;
+#endif
 
 }
 
@@ -2,8 +2,13 @@
 #define _CRAWLER_MESSAGES_H_
 
 #include <string>
+#include <cassert>
+#include <cstdint>
 
 #include <message_base.h>
+#include <compact_url.h>
+#include <object_pool.h>
+#include <http_response.h>
 
 namespace crawler {
 
@@ -20,20 +25,49 @@ namespace crawler {
 	public:
 		typedef base_type::message_catagory message_catagory;
 
-		url_message(const std::string& url) : m_req_url(url) { }
-		url_message(std::string&& url) : m_req_url(std::move(url)) { }
-
-		url_message(const self_type&) = default;
-		url_message(self_type&& other) : m_req_url(std::move(other.m_req_url)) { }
+		/*
+		 * @param depth  the number of links from a seed to the url.
+		 */
+		url_message(const std::string& url, uint32_t depth = 0) :
+			m_path(_allocate(compact_url::path_length(url))), 
+			m_location(url, m_path),
+			m_depth(depth) { }
+
+		explicit url_message(const compact_url& location, uint32_t depth = 0) :
+			m_path(_allocate(location.path().length())),
+			m_location(location.rebased(m_path)),
+			m_depth(depth) { }
+
+		url_message(const self_type& other) :
+			m_path(_allocate(other.m_location.path().length())),
+			m_location(other.m_location.rebased(m_path)),
+			m_depth(other.m_depth) { }
+
+		virtual ~url_message() {
+			if (nullptr != m_path) { tools::pool_deallocate(m_path, m_location.path().length()); }
+		}
 
-		virtual ~url_message() = default;
+		self_type& operator=(const self_type&) = delete;
 
 		message_catagory catagory() const override { return message_catagory::URL; }
 
-		const std::string& url() const { return m_req_url; }
+		const compact_url& location() const { return m_location; }
+
+		/* the url as a string, it is rebuilt on every call */
+		std::string url() const { return m_location.str(); }
+
+		uint32_t depth() const { return m_depth; }
+
+	private:
+		/* the path is owned by the message, so it goes away with it */
+		static char* _allocate(size_t length) {
+			return 0 == length ? nullptr : static_cast<char*>(tools::pool_allocate(length));
+		}
 
 	private:
-		std::string m_req_url;
+		char*       m_path;
+		compact_url m_location;
+		uint32_t    m_depth;
 	};
 
 	class http_resp_message :
@@ -45,31 +79,37 @@ namespace crawler {
 	public:
 		typedef base_type::message_catagory message_catagory;
 
-		http_resp_message(std::string&& url, std::string&& resp) : 
-			m_response(std::move(resp)) {
-			assert(url.length() < m_response.length());
-			memcpy(m_response.data(), url.data(), sizeof (char) * url.length());
-			m_response[url.length()] = '\r';
-			m_response[url.length() + 1] = '\n';
+		/*
+		 * @param depth   the depth of the requested url, the links found in
+		 *                the page are one deeper.
+		 * @param source  the low half of the fingerprint of the requested url.
+		 */
+		explicit http_resp_message(http_response_ptr resp, uint32_t depth = 0, uint64_t source = 0) : 
+			m_response(std::move(resp)), m_depth(depth), m_source(source) {
+			assert(nullptr != m_response && m_response->sealed());
 		}
 
 		http_resp_message(const self_type& other) = default;
 
 		http_resp_message(self_type&& other) noexcept : 
-			m_response(std::move(other.m_response)) { }
+			m_response(std::move(other.m_response)), m_depth(other.m_depth), m_source(other.m_source) { }
 
 		virtual ~http_resp_message() = default;
 
 		message_catagory catagory() const override { return message_catagory::HTTP_RESP; }
 
-		const std::string& response() const { return m_response; }
+		const http_response& response() const { return *m_response; }
 
-		std::string request_url() const {
-			return m_response.substr(0, m_response.find_first_of('\r'));
-		}
+		const std::string& request_url() const { return m_response->request_url(); }
+
+		uint32_t depth() const { return m_depth; }
+
+		uint64_t source() const { return m_source; }
 
 	private:
-		std::string m_response;
+		http_response_ptr m_response;
+		uint32_t          m_depth;
+		uint64_t          m_source;
 	};
 
 	class stop_signal : 
@@ -0,0 +1,383 @@
+#ifndef _CRAWLER_METRICS_H_
+#define _CRAWLER_METRICS_H_
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <sstream>
+#include <functional>
+
+#include <boost/asio.hpp>
+
+#include <debug.h>
+
+namespace tools {
+
+	/*
+	 * Counters and histograms cheap enough for the hot paths. Every thread
+	 * adds to a stripe of its own (a cache line each, given out to the
+	 * threads in turn), a read sums the stripes. So the threads counting
+	 * share no cache line as long as there are no more than stripes of
+	 * them, and a read may be a little behind.
+	 */
+	static const size_t metric_stripes = 16u;
+
+	inline size_t metric_stripe() {
+		static std::atomic<size_t> next(0);
+		thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % metric_stripes;
+		return index;
+	}
+
+	class counter {
+
+		typedef counter self_type;
+
+	public:
+		counter() = default;
+
+		/* uncopyable */
+		counter(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		void add(uint64_t n = 1) {
+			m_cells[metric_stripe()].value.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		uint64_t value() const {
+			uint64_t result = 0;
+			for (const auto& each : m_cells) { result += each.value.load(std::memory_order_relaxed); }
+			return result;
+		}
+
+	private:
+		struct alignas(64) cell {
+			cell() : value(0) { }
+			std::atomic<uint64_t> value;
+		};
+
+		cell m_cells[metric_stripes];
+	};
+
+	/*
+	 * The distribution of a value (a time in ns, a size in bytes) in
+	 * buckets of powers of two, bucket i holds the values of bit length i.
+	 * A percentile is interpolated within its bucket, so it is right within
+	 * a factor of two and usually much closer.
+	 */
+	class histogram {
+
+		typedef histogram self_type;
+
+	public:
+		static const size_t buckets = 65u;
+
+		struct snapshot {
+			snapshot() : count(0), sum(0) {
+				for (auto& each : counts) { each = 0; }
+			}
+
+			uint64_t count;
+			uint64_t sum;
+			uint64_t counts[buckets];
+
+			double mean() const { return 0 == count ? 0.0 : static_cast<double>(sum) / count; }
+
+			/* @param q  0 to 1 */
+			double percentile(double q) const {
+				if (0 == count) { return 0.0; }
+
+				double rank = q * count;
+				uint64_t below = 0;
+
+				for (size_t i = 0; i < buckets; ++i) {
+					if (0 == counts[i] || below + counts[i] < rank) {
+						below += counts[i];
+						continue;
+					}
+					if (0 == i) { return 0.0; }
+
+					double low  = static_cast<double>(uint64_t(1) << (i - 1));
+					double high = 64 == i ? low * 2.0 : static_cast<double>(uint64_t(1) << i) - 1.0;
+					return low + (high - low) * (rank - below) / counts[i];
+				}
+				return 0.0;
+			}
+
+			/* the changes since an older snapshot */
+			snapshot since(const snapshot& older) const {
+				snapshot result;
+				result.count = count - older.count;
+				result.sum   = sum - older.sum;
+				for (size_t i = 0; i < buckets; ++i) { result.counts[i] = counts[i] - older.counts[i]; }
+				return result;
+			}
+		};
+
+		histogram() = default;
+
+		/* uncopyable */
+		histogram(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		void record(uint64_t value) {
+			auto& target = m_stripes[metric_stripe()];
+			target.counts[_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+			target.sum.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		template <typename _Rep, typename _Period>
+		void record(const std::chrono::duration<_Rep, _Period>& time) {
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+			this->record(static_cast<uint64_t>(0 < ns ? ns : 0));
+		}
+
+		snapshot read() const {
+			snapshot result;
+			for (const auto& each : m_stripes) {
+				result.sum += each.sum.load(std::memory_order_relaxed);
+				for (size_t i = 0; i < buckets; ++i) {
+					uint64_t n = each.counts[i].load(std::memory_order_relaxed);
+					result.counts[i] += n;
+					result.count     += n;
+				}
+			}
+			return result;
+		}
+
+	private:
+		static size_t _bucket(uint64_t value) {
+#if defined(_MSC_VER)
+			unsigned long index;
+			return _BitScanReverse64(&index, value) ? index + 1 : 0;
+#else
+			return 0 == value ? 0 : 64u - __builtin_clzll(value);
+#endif
+		}
+
+		struct alignas(64) stripe {
+			stripe() : sum(0) {
+				for (auto& each : counts) { each.store(0, std::memory_order_relaxed); }
+			}
+
+			std::atomic<uint64_t> counts[buckets];
+			std::atomic<uint64_t> sum;
+		};
+
+		stripe m_stripes[metric_stripes];
+	};
+
+	/*
+	 * Records the time from its construction to its destruction.
+	 */
+	class scoped_timer {
+	public:
+		explicit scoped_timer(histogram& target) :
+			m_target(target), m_start(std::chrono::steady_clock::now()) { }
+
+		~scoped_timer() { m_target.record(std::chrono::steady_clock::now() - m_start); }
+
+		scoped_timer(const scoped_timer&) = delete;
+		scoped_timer& operator=(const scoped_timer&) = delete;
+
+	private:
+		histogram&                            m_target;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	/*
+	 * The instruments of the process by name. They are made on the first
+	 * lookup and live as long as the process, so the code counting looks
+	 * them up once and keeps the reference.
+	 */
+	class metrics {
+
+		typedef metrics self_type;
+
+	public:
+		static self_type& global() {
+			static self_type instance;
+			return instance;
+		}
+
+		metrics() = default;
+
+		/* uncopyable */
+		metrics(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		tools::counter& counter(const std::string& name) {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			auto& slot = m_counters[name];
+			if (nullptr == slot) { slot.reset(new tools::counter()); }
+			return *slot;
+		}
+
+		/* @param name  ends with the unit, _ns or _bytes */
+		tools::histogram& histogram(const std::string& name) {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			auto& slot = m_histograms[name];
+			if (nullptr == slot) { slot.reset(new tools::histogram()); }
+			return *slot;
+		}
+
+		/*
+		 * @note  a line per counter, "<name> <value>", and per histogram,
+		 *        "<name> count=.. mean=.. p50=.. p90=.. p99=..".
+		 */
+		void render(std::ostream& out) const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+
+			for (const auto& each : m_counters) {
+				out << each.first << ' ' << each.second->value() << '\n';
+			}
+			for (const auto& each : m_histograms) {
+				auto values = each.second->read();
+				out << each.first
+				    << " count=" << values.count
+				    << " mean=" << static_cast<uint64_t>(values.mean())
+				    << " p50=" << static_cast<uint64_t>(values.percentile(0.5))
+				    << " p90=" << static_cast<uint64_t>(values.percentile(0.9))
+				    << " p99=" << static_cast<uint64_t>(values.percentile(0.99)) << '\n';
+			}
+		}
+
+	private:
+		mutable std::mutex                                        m_mutex;
+		std::map<std::string, std::unique_ptr<tools::counter>>   m_counters;
+		std::map<std::string, std::unique_ptr<tools::histogram>> m_histograms;
+	};
+
+	/*
+	 * Logs a stats line every interval and serves a text page on a local
+	 * port (plain HTTP, any path), both from one thread of its own.
+	 */
+	class stats_service {
+
+		typedef stats_service self_type;
+
+	public:
+		typedef std::function<std::string()> render_type;
+
+		/*
+		 * @param port      the port on 127.0.0.1, 0 for no page.
+		 * @param interval  the time between two stats lines.
+		 * @param line      makes the stats line.
+		 * @param page      makes the page.
+		 */
+		stats_service(
+			unsigned short            port,
+			std::chrono::milliseconds interval,
+			render_type               line,
+			render_type               page
+		) :
+			m_work(boost::asio::make_work_guard(m_context)),
+			m_timer(m_context),
+			m_acceptor(m_context),
+			m_interval(interval),
+			m_line(std::move(line)),
+			m_page(std::move(page))
+		{
+			if (0 != port) { this->_listen(port); }
+			this->_schedule();
+			m_thread = std::thread([this]() { m_context.run(); });
+		}
+
+		~stats_service() {
+			m_work.reset();
+			m_context.stop();
+			if (m_thread.joinable()) { m_thread.join(); }
+		}
+
+		/* uncopyable */
+		stats_service(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+	private:
+		typedef boost::asio::ip::tcp::socket socket_type;
+
+		void _listen(unsigned short port) {
+			boost::system::error_code err;
+			boost::asio::ip::tcp::endpoint local(boost::asio::ip::address_v4::loopback(), port);
+
+			m_acceptor.open(local.protocol(), err);
+			if (!err) { m_acceptor.set_option(boost::asio::socket_base::reuse_address(true), err); }
+			if (!err) { m_acceptor.bind(local, err); }
+			if (!err) { m_acceptor.listen(boost::asio::socket_base::max_listen_connections, err); }
+
+			if (err) {
+				CRAWLER_LOG(tools::debug_type::WARNING, "stats_service", err.message(), ": port ", port);
+				return;
+			}
+
+			this->_accept();
+		}
+
+		void _accept() {
+			auto sock = std::make_shared<socket_type>(m_context);
+			m_acceptor.async_accept(*sock, [this, sock](const boost::system::error_code& err) {
+				if (boost::asio::error::operation_aborted == err) { return; }
+				if (!err) { this->_serve(sock); }
+				this->_accept();
+			});
+		}
+
+		/*
+		 * @note  the request is not looked at, the page is the answer to
+		 *        any of them.
+		 */
+		void _serve(const std::shared_ptr<socket_type>& sock) {
+			auto request = std::make_shared<std::array<char, 1024>>();
+
+			sock->async_read_some(
+				boost::asio::buffer(*request),
+				[this, sock, request](const boost::system::error_code& err, size_t) {
+					if (err) { return; }
+
+					std::string body = m_page();
+					auto response = std::make_shared<std::string>(
+						"HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+						std::to_string(body.length()) + "\r\nConnection: close\r\n\r\n" + body
+					);
+
+					boost::asio::async_write(
+						*sock, boost::asio::buffer(*response),
+						[sock, response](const boost::system::error_code&, size_t) {
+							boost::system::error_code ignored;
+							sock->shutdown(boost::asio::socket_base::shutdown_both, ignored);
+							sock->close(ignored);
+						}
+					);
+				}
+			);
+		}
+
+		void _schedule() {
+			m_timer.expires_after(m_interval);
+			m_timer.async_wait([this](const boost::system::error_code& err) {
+				if (err) { return; }
+				CRAWLER_LOG(tools::debug_type::INFO, "stats", m_line());
+				this->_schedule();
+			});
+		}
+
+	private:
+		boost::asio::io_context                                                  m_context;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work;
+		boost::asio::steady_timer                                                m_timer;
+		boost::asio::ip::tcp::acceptor                                           m_acceptor;
+
+		std::chrono::milliseconds                                                m_interval;
+		render_type                                                              m_line;
+		render_type                                                              m_page;
+
+		std::thread                                                              m_thread;
+	};
+}
+
+#endif
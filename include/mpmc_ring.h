@@ -0,0 +1,253 @@
+#ifndef _CRAWLER_MPMC_RING_H_
+#define _CRAWLER_MPMC_RING_H_
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <type_traits>
+#include <condition_variable>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace tools {
+
+	inline void cpu_relax() {
+#if defined(_MSC_VER)
+		_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	/*
+	 * Bounded lock-free multi-producer multi-consumer ring (Dmitry Vyukov's
+	 * algorithm). Every cell carries a sequence number which tells whether
+	 * it is ready for the producer or the consumer of a given lap, so a push
+	 * or a pop is one CAS on a position plus one store on the cell. The
+	 * capacity is rounded up to a power of two.
+	 */
+	template <typename _Tp>
+	class mpmc_ring {
+
+		typedef mpmc_ring<_Tp> self_type;
+
+	public:
+		typedef _Tp    value_type;
+		typedef size_t size_type;
+
+		explicit mpmc_ring(size_type capacity) :
+			m_mask(_round_up(capacity) - 1),
+			m_cells(new cell[m_mask + 1])
+		{
+			for (size_type i = 0; i <= m_mask; ++i) {
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			m_enqueue_pos.store(0, std::memory_order_relaxed);
+			m_dequeue_pos.store(0, std::memory_order_relaxed);
+		}
+
+		~mpmc_ring() {
+			value_type ignored;
+			while (try_pop(ignored)) { }
+		}
+
+		/* uncopyable */
+		mpmc_ring(const self_type&) = delete;
+		self_type& operator=(const self_type&) = delete;
+
+		template <typename _ValTp>
+		bool try_push(_ValTp&& item) {
+			cell* target;
+			size_type pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+			while (true) {
+				target = &m_cells[pos & m_mask];
+				size_type seq = target->sequence.load(std::memory_order_acquire);
+				auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+				if (0 == diff) {
+					if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else if (diff < 0) {
+					/* full */
+					return false;
+				}
+				else {
+					pos = m_enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+
+			new (&target->storage) value_type(std::forward<_ValTp>(item));
+			target->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool try_pop(value_type& out) {
+			cell* target;
+			size_type pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+			while (true) {
+				target = &m_cells[pos & m_mask];
+				size_type seq = target->sequence.load(std::memory_order_acquire);
+				auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+				if (0 == diff) {
+					if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else if (diff < 0) {
+					/* empty */
+					return false;
+				}
+				else {
+					pos = m_dequeue_pos.load(std::memory_order_relaxed);
+				}
+			}
+
+			auto item = reinterpret_cast<value_type*>(&target->storage);
+			out = std::move(*item);
+			item->~value_type();
+			target->sequence.store(pos + m_mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* a snapshot, it may be stale as soon as it returns */
+		size_type size() const {
+			size_type enqueued = m_enqueue_pos.load(std::memory_order_relaxed);
+			size_type dequeued = m_dequeue_pos.load(std::memory_order_relaxed);
+			return enqueued < dequeued ? 0 : enqueued - dequeued;
+		}
+
+		bool empty() const { return 0 == size(); }
+		size_type capacity() const { return m_mask + 1; }
+
+	private:
+		static size_type _round_up(size_type n) {
+			size_type result = 2;
+			while (result < n) { result <<= 1; }
+			return result;
+		}
+
+		struct cell {
+			std::atomic<size_type>                                         sequence;
+			typename std::aligned_storage<sizeof(_Tp), alignof(_Tp)>::type storage;
+		};
+
+		static const size_t cache_line_size = 64u;
+
+		const size_type         m_mask;
+		std::unique_ptr<cell[]> m_cells;
+
+		alignas(cache_line_size) std::atomic<size_type> m_enqueue_pos;
+		alignas(cache_line_size) std::atomic<size_type> m_dequeue_pos;
+	};
+
+	/*
+	 * Blocking for lock-free structures: a waiter spins, then yields, then
+	 * parks on a condition variable. Notifying costs one atomic load unless
+	 * someone is parked, so the fast path never touches the mutex.
+	 */
+	class backoff_waiter {
+	public:
+		backoff_waiter() : m_parked(0) { }
+
+		/* uncopyable */
+		backoff_waiter(const backoff_waiter&) = delete;
+		backoff_waiter& operator=(const backoff_waiter&) = delete;
+
+		/*
+		 * @param ready     returns true when the wait is over, it is called
+		 *                  again after every wake up.
+		 * @param deadline  when to give up.
+		 * @ret             false on timeout.
+		 */
+		template <typename _Predicate, typename _Clock, typename _Duration>
+		bool wait_until(
+			_Predicate&&                                      ready,
+			const std::chrono::time_point<_Clock, _Duration>& deadline
+		) {
+			if (this->_spin(ready)) { return true; }
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+			this->_park();
+			bool result = m_cond.wait_until(locker, deadline, ready);
+			this->_unpark();
+
+			return result;
+		}
+
+		template <typename _Predicate>
+		void wait(_Predicate&& ready) {
+			if (this->_spin(ready)) { return; }
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+			this->_park();
+			m_cond.wait(locker, ready);
+			this->_unpark();
+		}
+
+		/*
+		 * @note  to be called after the state the waiters check has changed.
+		 */
+		void notify_one() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (0 == m_parked.load(std::memory_order_relaxed)) { return; }
+			std::lock_guard<std::mutex> locker(m_mutex);
+			m_cond.notify_one();
+		}
+
+		void notify_all() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (0 == m_parked.load(std::memory_order_relaxed)) { return; }
+			std::lock_guard<std::mutex> locker(m_mutex);
+			m_cond.notify_all();
+		}
+
+	private:
+		template <typename _Predicate>
+		static bool _spin(_Predicate& ready) {
+			for (size_t i = 0; i < spin_rounds; ++i) {
+				if (ready()) { return true; }
+				cpu_relax();
+			}
+			for (size_t i = 0; i < yield_rounds; ++i) {
+				if (ready()) { return true; }
+				std::this_thread::yield();
+			}
+			return false;
+		}
+
+		/* 
+		 * @note  pairs with the fence in notify_*, either the notifier sees 
+		 *        the parked waiter or the waiter sees the new state.
+		 */
+		void _park() {
+			m_parked.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		void _unpark() { m_parked.fetch_sub(1, std::memory_order_relaxed); }
+
+	private:
+		static const size_t spin_rounds  = 128u;
+		static const size_t yield_rounds = 16u;
+
+		std::mutex              m_mutex;
+		std::condition_variable m_cond;
+		std::atomic<size_t>     m_parked;
+	};
+}
+
+#endif
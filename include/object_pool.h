@@ -0,0 +1,232 @@
+#ifndef _CRAWLER_OBJECT_POOL_H_
+#define _CRAWLER_OBJECT_POOL_H_
+
+#include <new>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace tools {
+
+	/*
+	 * Fixed size blocks for objects which are created on one thread and
+	 * destroyed on another, as the messages of a pipeline are. Every thread
+	 * allocates from and frees to its own cache without locking. A cache
+	 * which runs dry takes a batch of blocks from the shared depot, and a
+	 * cache which gets too many hands a batch back, so blocks freed by the
+	 * consumer thread return to the producer thread. The memory comes from
+	 * the heap in chunks while the pool grows and is never given back, in
+	 * steady state no allocation reaches the heap.
+	 */
+	template <size_t _BlockSize>
+	class block_pool {
+	public:
+		static const size_t block_size = (_BlockSize + 15u) & ~size_t(15u);
+		static const size_t batch_size = 64u;
+
+		static void* allocate() {
+			auto& local = _cache();
+			if (nullptr == local.head) {
+				local.head  = _depot().take();
+				local.count = batch_size;
+			}
+
+			node* result = local.head;
+			local.head = result->next;
+			--local.count;
+
+			return result;
+		}
+
+		static void deallocate(void* p) {
+			auto& local = _cache();
+
+			auto freed = static_cast<node*>(p);
+			freed->next = local.head;
+			local.head  = freed;
+
+			if (2 * batch_size <= ++local.count) {
+				node* last = local.head;
+				for (size_t i = 1; i < batch_size; ++i) { last = last->next; }
+
+				node* batch = local.head;
+				local.head  = last->next;
+				last->next  = nullptr;
+				local.count -= batch_size;
+
+				_depot().give(batch);
+			}
+		}
+
+		/* the number of chunks taken from the heap so far */
+		static size_t chunks() { return _depot().chunks(); }
+
+	private:
+		struct node {
+			node* next;
+		};
+
+		class depot {
+		public:
+			depot() : m_loose(nullptr), m_loose_count(0), m_left(0), m_next(nullptr) { }
+
+			/* a list of exactly batch_size blocks */
+			node* take() {
+				std::lock_guard<std::mutex> locker(m_mutex);
+
+				if (!m_batches.empty()) {
+					node* batch = m_batches.back();
+					m_batches.pop_back();
+					return batch;
+				}
+
+				if (m_left < batch_size) {
+					m_chunks.emplace_back(new char[chunk_blocks * block_size]);
+					m_next = m_chunks.back().get();
+					m_left = chunk_blocks;
+				}
+
+				node* batch = reinterpret_cast<node*>(m_next);
+				for (size_t i = 0; i < batch_size; ++i) {
+					auto current = reinterpret_cast<node*>(m_next);
+					m_next += block_size;
+					current->next = i + 1 < batch_size ? reinterpret_cast<node*>(m_next) : nullptr;
+				}
+				m_left -= batch_size;
+
+				return batch;
+			}
+
+			void give(node* batch) {
+				std::lock_guard<std::mutex> locker(m_mutex);
+				m_batches.push_back(batch);
+			}
+
+			/* a list of any length, from a cache going away */
+			void give_loose(node* list) {
+				std::lock_guard<std::mutex> locker(m_mutex);
+
+				while (nullptr != list) {
+					node* next = list->next;
+					list->next = m_loose;
+					m_loose = list;
+					list = next;
+
+					if (batch_size == ++m_loose_count) {
+						m_batches.push_back(m_loose);
+						m_loose = nullptr;
+						m_loose_count = 0;
+					}
+				}
+			}
+
+			size_t chunks() const {
+				std::lock_guard<std::mutex> locker(m_mutex);
+				return m_chunks.size();
+			}
+
+		private:
+			static const size_t chunk_blocks = batch_size * 16u;
+
+			mutable std::mutex                   m_mutex;
+			std::vector<node*>                   m_batches;
+			node*                                m_loose;
+			size_t                               m_loose_count;
+			std::vector<std::unique_ptr<char[]>> m_chunks;
+			size_t                               m_left;
+			char*                                m_next;
+		};
+
+		struct cache {
+			cache() : head(nullptr), count(0) { }
+			~cache() { if (nullptr != head) { _depot().give_loose(head); } }
+
+			node*  head;
+			size_t count;
+		};
+
+		static cache& _cache() {
+			thread_local cache local;
+			return local;
+		}
+
+		/*
+		 * @note  never destroyed, caches of threads still running at exit
+		 *        may return blocks to it.
+		 */
+		static depot& _depot() {
+			static depot* shared = new depot();
+			return *shared;
+		}
+	};
+
+	/*
+	 * @note  blocks of up to 1024 bytes come from the block_pool of their
+	 *        size class, larger ones from the heap.
+	 */
+	inline void* pool_allocate(size_t bytes) {
+		if (bytes <= 16u)   { return block_pool<16u>::allocate();   }
+		if (bytes <= 32u)   { return block_pool<32u>::allocate();   }
+		if (bytes <= 64u)   { return block_pool<64u>::allocate();   }
+		if (bytes <= 128u)  { return block_pool<128u>::allocate();  }
+		if (bytes <= 256u)  { return block_pool<256u>::allocate();  }
+		if (bytes <= 512u)  { return block_pool<512u>::allocate();  }
+		if (bytes <= 1024u) { return block_pool<1024u>::allocate(); }
+		return ::operator new(bytes);
+	}
+
+	inline void pool_deallocate(void* p, size_t bytes) {
+		if (bytes <= 16u)   { block_pool<16u>::deallocate(p);   return; }
+		if (bytes <= 32u)   { block_pool<32u>::deallocate(p);   return; }
+		if (bytes <= 64u)   { block_pool<64u>::deallocate(p);   return; }
+		if (bytes <= 128u)  { block_pool<128u>::deallocate(p);  return; }
+		if (bytes <= 256u)  { block_pool<256u>::deallocate(p);  return; }
+		if (bytes <= 512u)  { block_pool<512u>::deallocate(p);  return; }
+		if (bytes <= 1024u) { block_pool<1024u>::deallocate(p); return; }
+		::operator delete(p);
+	}
+
+	/*
+	 * Standard allocator over pool_allocate, stateless, so any two compare
+	 * equal and memory may be freed through any rebound copy.
+	 */
+	template <typename _Tp>
+	class pool_allocator {
+	public:
+		typedef _Tp value_type;
+
+		static_assert(alignof(_Tp) <= 16u, "block_pool blocks are 16-byte aligned");
+
+		pool_allocator() noexcept = default;
+
+		template <typename _Up>
+		pool_allocator(const pool_allocator<_Up>&) noexcept { }
+
+		_Tp* allocate(size_t n) {
+			return static_cast<_Tp*>(pool_allocate(n * sizeof (_Tp)));
+		}
+
+		void deallocate(_Tp* p, size_t n) {
+			pool_deallocate(p, n * sizeof (_Tp));
+		}
+
+		template <typename _Up>
+		bool operator==(const pool_allocator<_Up>&) const noexcept { return true; }
+
+		template <typename _Up>
+		bool operator!=(const pool_allocator<_Up>&) const noexcept { return false; }
+	};
+
+	/*
+	 * @note  the object and the shared_ptr control block share one pooled
+	 *        block.
+	 */
+	template <typename _Tp, typename... _Args>
+	std::shared_ptr<_Tp> make_pooled(_Args&&... args) {
+		return std::allocate_shared<_Tp>(pool_allocator<_Tp>(), std::forward<_Args>(args)...);
+	}
+}
+
+#endif
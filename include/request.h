@@ -2,11 +2,20 @@
 #define _CRAWLER_REQUEST_H_
 
 #include <memory>
+#include <vector>
+#include <thread>
+#include <condition_variable>
 
 #include <boost/shared_array.hpp>
 #include <boost/asio.hpp>
 
 #include <debug.h>
+#include <compact_url.h>
+#include <http_response.h>
+#include <http_parser.h>
+#include <connection_pool.h>
+#include <dns_cache.h>
+#include <metrics.h>
 
 namespace bsys = boost::system;
 
@@ -54,13 +63,16 @@ namespace crawler {
 	public:
 		typedef typename base_type::resp_handler          resp_handler;
 		typedef typename base_type::handlers_type         handlers_type;
-		typedef typename http_request_executor<self_type> executor_type;
+		typedef http_request_executor<self_type>          executor_type;
 
 		explicit http_request(const std::string& http_url) { this->_parse(http_url); }
 
 		http_request(const std::string& host, const std::string& url) : 
 			m_host(host), m_req_url(url) { }
 
+		explicit http_request(const compact_url& location) :
+			m_host(location.host()), m_req_url(location.path()) { }
+
 
 		http_request(self_type&& other) noexcept :
 			base_type(std::move(other)),
@@ -98,8 +110,8 @@ namespace crawler {
 		return req;
 	}
 
-	typedef http_request<std::function<void(const std::string&)>> http_req;
-	typedef http_request_executor<http_req>                       http_req_executor;
+	typedef http_request<std::function<void(const http_response_ptr&)>> http_req;
+	typedef http_request_executor<http_req>                             http_req_executor;
 
 	template <typename _Request>
 	class request_executor {
@@ -111,6 +123,19 @@ namespace crawler {
 		virtual void commit(std::shared_ptr<request_type>) { }
 	};
 
+	/*
+	 * Every event loop is an io_context run by one thread. Requests are
+	 * sharded onto the loops by the hash of their host, so everything that
+	 * belongs to a host (pooled sockets) stays on one thread, and resolve
+	 * (through the shared dns_cache), connect, write and read are all 
+	 * asynchronous. The number of
+	 * requests in flight is bounded, commit() blocks while it is reached.
+	 * A request not done request_timeout after its connect (or its send on
+	 * a pooled connection) has its socket closed and counts as failed, so
+	 * a server which never answers does not keep its slot. The time of
+	 * every step goes to the histograms http_*_ns of
+	 * tools::metrics::global().
+	 */
 	template <typename _HTTPRequest>
 	class http_request_executor : 
 		public request_executor<_HTTPRequest> {
@@ -127,184 +152,470 @@ namespace crawler {
 		typedef char byte_type;
 
 		typedef std::shared_ptr<request_type>                 req_ptr;
-		typedef std::shared_ptr<std::string>                  string_ptr;
 		typedef std::shared_ptr<boost::asio::ip::tcp::socket> sock_ptr;
 		typedef boost::shared_array<byte_type>                tmp_buffer_ptr;
-		typedef std::shared_ptr<std::stringbuf>               buffer_ptr;
+
+		/* 
+		 * holds one in-flight slot, the slot is given back when the last 
+		 * copy is destroyed 
+		 */
+		typedef std::shared_ptr<void>                         ticket_ptr;
+
+		typedef std::chrono::steady_clock                     clock_type;
+
+		/*
+		 * dns and connect are timed from their start, ttfb from the send
+		 * of the request and download from the first byte to the last.
+		 */
+		struct timings {
+			timings() :
+				dns(tools::metrics::global().histogram("http_dns_ns")),
+				connect(tools::metrics::global().histogram("http_connect_ns")),
+				ttfb(tools::metrics::global().histogram("http_ttfb_ns")),
+				download(tools::metrics::global().histogram("http_download_ns")),
+				bytes(tools::metrics::global().counter("http_read_bytes")),
+				completed(tools::metrics::global().counter("http_completed")),
+				failed(tools::metrics::global().counter("http_failed")),
+				timed_out(tools::metrics::global().counter("http_timed_out")) { }
+
+			tools::histogram& dns;
+			tools::histogram& connect;
+			tools::histogram& ttfb;
+			tools::histogram& download;
+			tools::counter&   bytes;
+			tools::counter&   completed;
+			tools::counter&   failed;
+			tools::counter&   timed_out;
+		};
+
+		struct event_loop {
+			event_loop() : work(boost::asio::make_work_guard(context)) { }
+
+			boost::asio::io_context                                                  context;
+			boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+			std::thread                                                              thread;
+		};
+
+		/*
+		 * state of one request on one connection.
+		 */
+		struct session {
+			session(event_loop& l, req_ptr r, ticket_ptr t, sock_ptr s, bool from_pool) : 
+				loop(l),
+				req(std::move(r)), 
+				ticket(std::move(t)),
+				sock(std::move(s)), 
+				reused(from_pool),
+				finished(false),
+				timed_out(false),
+				deadline(l.context),
+				tmp_buff(new byte_type[default_buffer_size]),
+				resp(std::make_shared<http_response>(req->host() + req->url())),
+				parser(*resp) { }
+
+			event_loop&               loop;
+			req_ptr                   req;
+			ticket_ptr                ticket;
+			sock_ptr                  sock;
+			bool                      reused;
+			bool                      finished;
+			bool                      timed_out;
+			boost::asio::steady_timer deadline;
+			tmp_buffer_ptr            tmp_buff;
+			std::string               req_str;
+			http_response_ptr         resp;
+			http_response_parser      parser;
+			clock_type::time_point    sent;
+			clock_type::time_point    first_byte;
+		};
+
+		typedef std::shared_ptr<session> session_ptr;
 
 	public:
-		explicit http_request_executor(size_t threads) : m_pool(threads) { }
+		/*
+		 * @param loops          the number of event loops(threads).
+		 * @param max_in_flight    the max number of requests being processed.
+		 * @param request_timeout  the time a request has from its connect to
+		 *                         its last byte.
+		 */
+		explicit http_request_executor(
+			size_t               loops,
+			size_t               max_in_flight     = default_max_in_flight,
+			size_t               max_idle_per_host = connection_pool::default_max_idle_per_host,
+			std::chrono::seconds max_idle_time     = connection_pool::default_max_idle_time,
+			std::chrono::seconds request_timeout   = default_request_timeout
+		) : 
+			m_max_in_flight(std::max<size_t>(1u, max_in_flight)),
+			m_in_flight(0),
+			m_request_timeout(request_timeout),
+			m_connections(max_idle_per_host, max_idle_time) 
+		{
+			loops = std::max<size_t>(1u, loops);
+			for (size_t i = 0; i < loops; ++i) {
+				m_loops.emplace_back(new event_loop());
+			}
+			for (auto& each : m_loops) {
+				each->thread = std::thread(&_run_loop, std::ref(*each));
+			}
+		}
 
 		~http_request_executor() {
-			m_pool.stop();
-			m_service.stop();
+			for (auto& each : m_loops) {
+				each->work.reset();
+				each->context.stop();
+			}
+			for (auto& each : m_loops) {
+				if (each->thread.joinable()) { each->thread.join(); }
+			}
+			m_connections.clear();
+			/* drop the pending handlers while the members they refer to are alive */
+			m_loops.clear();
 		}
 
+		/*
+		 * @note  blocks while max_in_flight requests are being processed.
+		 */
 		void commit(std::shared_ptr<request_type> req_ptr) override {
+			auto  ticket = this->_acquire_slot();
+			auto& loop   = *m_loops[std::hash<std::string>()(req_ptr->host()) % m_loops.size()];
+
 			boost::asio::post(
-				m_pool,
+				loop.context,
 				std::bind(
-					&_handle_send_req, std::ref(m_service), req_ptr
+					&self_type::_handle_send_req, this, std::ref(loop), req_ptr, ticket
 				)
 			);
 		}
 
-		void join() { m_pool.join(); }
+		/*
+		 * @note  waits until all the committed requests are finished.
+		 */
+		void join() { 
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_slot_released.wait(locker, [this]() { return 0 == m_in_flight; });
+		}
+
+		size_t in_flight() const {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			return m_in_flight;
+		}
+
+		const connection_pool& connections() const { return m_connections; }
+		const dns_cache&       dns() const { return m_dns; }
 
 	private:
-		static string_ptr 
-			_generate_get_request(const request_type& request) 
-		{
-			static const char* get_template = 
-				"GET %s HTTP/1.1\r\n"
-				"HOST: %s\r\n"
-				"Connection: close\r\n\r\n";
+		static void _run_loop(event_loop& loop) {
+			while (true) {
+				try {
+					loop.context.run();
+					return;
+				}
+				catch (const std::exception& ex) {
+					CRAWLER_LOG(tools::debug_type::WARNING, "_run_loop", ex.what());
+				}
+			}
+		}
+
+		ticket_ptr _acquire_slot() {
+			{
+				std::unique_lock<std::mutex> locker(m_mutex);
+				m_slot_released.wait(locker, [this]() { return m_in_flight < m_max_in_flight; });
+				++m_in_flight;
+			}
+			return ticket_ptr(nullptr, [this](void*) { this->_release_slot(); });
+		}
+
+		void _release_slot() {
+			std::lock_guard<std::mutex> locker(m_mutex);
+			--m_in_flight;
+			m_slot_released.notify_all();
+		}
 
-			char buffer[default_buffer_size];
-			int bytes_sprinted = 
-				sprintf_s(buffer, default_buffer_size, get_template, request.url().c_str(), request.host().c_str());
+		static std::string _generate_get_request(const request_type& request) {
+			static const char* version    = " HTTP/1.1\r\n";
+			static const char* host       = "Host: ";
+			static const char* keep_alive = "\r\nConnection: keep-alive\r\n\r\n";
 
-			if (bytes_sprinted < 0) {
-				throw std::exception("Error in sprintf_s().");
+			std::string req_str;
+			req_str.reserve(64u + request.url().length() + request.host().length());
+
+			req_str.append("GET ");
+			req_str.append(request.url().empty() ? "/" : request.url());
+			req_str.append(version);
+			req_str.append(host);
+			req_str.append(request.host());
+			req_str.append(keep_alive);
+
+			return req_str;
+		}
+
+		static void _close(const sock_ptr& sock) {
+			bsys::error_code ignored;
+			sock->shutdown(boost::asio::socket_base::shutdown_both, ignored);
+			sock->close(ignored);
+		}
+
+		/*
+		 * @note  a pooled socket may have been closed by the server while
+		 *        it was idle, in that case the request is sent again on a
+		 *        new connection.
+		 */
+		bool _retry_if_stale(const session_ptr& s) {
+			if (!s->reused || s->timed_out || 0 != s->parser.received()) { return false; }
+			_finish(s);
+			_close(s->sock);
+			this->_connect(s->loop, s->req, s->ticket);
+			return true;
+		}
+
+		/*
+		 * @note  the deadline of the session is armed on its connect, or on
+		 *        its send if the socket is pooled. When it expires the
+		 *        socket is closed, the connect, write or read pending fails
+		 *        and sees timed_out.
+		 */
+		void _arm(const session_ptr& s) {
+			s->deadline.expires_after(m_request_timeout);
+			s->deadline.async_wait([s](const bsys::error_code& err) {
+				/* a handler run before may have finished the session already */
+				if (err || s->finished) { return; }
+				s->timed_out = true;
+				_close(s->sock);
+			});
+		}
+
+		/* the session is done with its socket, its deadline is dropped */
+		static void _finish(const session_ptr& s) {
+			s->finished = true;
+			s->deadline.cancel();
+		}
+
+		template <typename... _Args>
+		void _fail(const session_ptr& s, const char* where, const _Args&... what) {
+			_finish(s);
+			if (s->timed_out) {
+				CRAWLER_LOG(tools::debug_type::WARNING, where, "Timed out: ", s->req->host());
+				m_timings.timed_out.add();
 			}
-			if (default_buffer_size <= bytes_sprinted) {
-				throw std::overflow_error("Request is too long.");
+			else {
+				CRAWLER_LOG(tools::debug_type::WARNING, where, what...);
 			}
+			m_timings.failed.add();
+			_close(s->sock);
+		}
+
+		void _handle_complete(const session_ptr& s) {
+			_finish(s);
+			m_timings.download.record(clock_type::now() - s->first_byte);
+			m_timings.completed.add();
+
+			s->resp->seal();
 
-			return std::make_shared<std::string>(buffer, bytes_sprinted);
+			const auto& handlers = s->req->get_handlers();
+			for (const auto& each : handlers) {
+				each(s->resp);
+			}
+
+			if (s->parser.keep_alive()) {
+				m_connections.release(s->req->host(), std::move(s->sock));
+			}
+			else {
+				_close(s->sock);
+			}
 		}
 
-		static void _handle_read_resp(
-			req_ptr                 req, 
-			buffer_ptr              buff, 
-			tmp_buffer_ptr          tmp_buff,
-			sock_ptr                sock,    
+		void _handle_read_resp(
+			session_ptr             s,
 			const bsys::error_code& err, 
 			size_t                  bytes_read
 		) {
-			if (2 == err.value() /* end of file */) {
-				const auto& handlers = req->get_handlers();
-				for (const auto& each : handlers) {
-					each(buff->str());
+			if (s->timed_out) {
+				this->_fail(s, "_handle_read_resp");
+				return;
+			}
+			if (boost::asio::error::eof == err) {
+				if (s->parser.finish()) {
+					this->_handle_complete(s);
+					return;
 				}
-				sock->shutdown(boost::asio::socket_base::shutdown_both);
-				sock->close();
+				if (this->_retry_if_stale(s)) { return; }
+
+				this->_fail(s, "_handle_read_resp", "Truncated response: ", s->req->host());
 				return;
 			}
 			if (bsys::errc::success != err.value()) {
-				// todo with error
-				tools::log(tools::debug_type::WARNING, "_handle_read_resp", err.message());
+				if (this->_retry_if_stale(s)) { return; }
 
-				sock->shutdown(boost::asio::socket_base::shutdown_both);
-				sock->close();
+				this->_fail(s, "_handle_read_resp", err.message());
 				return;
 			}
 
-			buff->sputn(tmp_buff.get(), bytes_read);
+			m_timings.bytes.add(bytes_read);
+			if (0 == s->parser.received()) {
+				s->first_byte = clock_type::now();
+				m_timings.ttfb.record(s->first_byte - s->sent);
+			}
 
-			sock->async_read_some(
-				boost::asio::buffer(tmp_buff.get(), default_buffer_size),
+			/* the header goes through tmp_buff, the body is read in place */
+			bool good = s->parser.reading_header() ? 
+				s->parser.feed(s->tmp_buff.get(), bytes_read) : s->parser.commit(bytes_read);
+
+			if (!good) {
+				this->_fail(s, "_handle_read_resp", "Malformed response: ", s->req->host());
+				return;
+			}
+
+			if (s->parser.complete()) {
+				this->_handle_complete(s);
+				return;
+			}
+
+			this->_read(s);
+		}
+
+		void _read(const session_ptr& s) {
+			auto space = s->parser.reading_header() ?
+				tools::buffer_chain::mutable_buffer(s->tmp_buff.get(), default_buffer_size) : 
+				s->parser.prepare();
+
+			s->sock->async_read_some(
+				boost::asio::buffer(space.first, space.second),
 				std::bind(
-					&_handle_read_resp,
-					req,
-					buff,
-					tmp_buff,
-					sock,
+					&self_type::_handle_read_resp,
+					this,
+					s,
 					std::placeholders::_1,
 					std::placeholders::_2
 				)
 			);
 		}
 
-		static void _handle_connection(
-			req_ptr                 req,
-			sock_ptr                sock,
-			const bsys::error_code& err
-		) {
-			if (bsys::errc::success != err.value()) {
+		void _send(const session_ptr& s) {
+			s->req_str = _generate_get_request(*s->req);
+			s->sent    = clock_type::now();
 
-				tools::log(tools::debug_type::WARNING, "_handle_connection", err.message());
+			boost::asio::async_write(
+				*s->sock,
+				boost::asio::buffer(s->req_str.data(), s->req_str.length()),
+				[s](const bsys::error_code& err, size_t) {
+					if (bsys::errc::success == err.value() || s->finished) { return; }
+					/* the pending read fails as well and decides whether to retry */
+					if (!s->reused && !s->timed_out) {
+						CRAWLER_LOG(tools::debug_type::WARNING, "lamda function in async_write", err.message());
+					}
+					_close(s->sock);
+				}
+			);
 
-				sock->shutdown(boost::asio::socket_base::shutdown_both);
-				sock->close();
+			this->_read(s);
+		}
+
+		void _handle_connection(
+			session_ptr             s,
+			const bsys::error_code& err
+		) {
+			if (s->timed_out || bsys::errc::success != err.value()) {
+				this->_fail(s, "_handle_connection", err.message());
 				return;
 			}
 
-			tmp_buffer_ptr recv_tmp_buff(new byte_type[default_buffer_size]);
-			buffer_ptr     recv_buff(new std::stringbuf());
+			this->_send(s);
+		}
 
-			auto req_str_ptr = _generate_get_request(*req);
+		void _handle_resolve(
+			event_loop&                                         loop,
+			req_ptr                                             req,
+			ticket_ptr                                          ticket,
+			clock_type::time_point                              started,
+			const bsys::error_code&                             err,
+			const boost::asio::ip::tcp::resolver::results_type& result
+		) {
+			auto now = clock_type::now();
+			m_timings.dns.record(now - started);
 
-			boost::asio::async_write(
-				*sock,
-				boost::asio::buffer(req_str_ptr->data(), req_str_ptr->length()),
-				[req_str_ptr](const bsys::error_code& err, size_t bytes_written) {
-					if (bsys::errc::success == err.value()) { return; }
-					tools::log(tools::debug_type::WARNING, "lamda function in async_write", err.message());
+			if (bsys::errc::success != err.value() || result.empty()) {
+				CRAWLER_LOG(
+					tools::debug_type::WARNING, 
+					"_handle_resolve", 
+					err.message(), ": ", req->host()
+				);
+				m_timings.failed.add();
+				return;
+			}
+
+			auto s = std::make_shared<session>(
+				loop, req, ticket, std::make_shared<boost::asio::ip::tcp::socket>(loop.context), false
+			);
+			this->_arm(s);
+
+			boost::asio::async_connect(
+				*s->sock,
+				result,
+				[this, s, now](const bsys::error_code& err, const boost::asio::ip::tcp::endpoint&) {
+					if (!err) { m_timings.connect.record(clock_type::now() - now); }
+					this->_handle_connection(s, err);
 				}
 			);
+		}
 
-			sock->async_read_some(
-				boost::asio::buffer(recv_tmp_buff.get(), default_buffer_size),
+		/*
+		 * @note  a host "name:port" (the canonical form keeps a port other
+		 *        than 80) is resolved as name on that port.
+		 */
+		void _connect(event_loop& loop, req_ptr req, ticket_ptr ticket) {
+			const auto& host  = req->host();
+			auto        colon = host.rfind(':');
+
+			m_dns.async_resolve(
+				loop.context,
+				std::string::npos == colon ? host : host.substr(0, colon),
+				std::string::npos == colon ? std::string("80") : host.substr(colon + 1),
 				std::bind(
-					&_handle_read_resp,
+					&self_type::_handle_resolve,
+					this,
+					std::ref(loop),
 					req,
-					recv_buff,
-					recv_tmp_buff,
-					sock,
+					ticket,
+					clock_type::now(),
 					std::placeholders::_1,
 					std::placeholders::_2
 				)
 			);
 		}
 
-		static void _handle_send_req(
-			boost::asio::io_service& service,
-			req_ptr                  req
-		) {
-			boost::asio::ip::tcp::resolver resolver(service);
-			boost::asio::ip::tcp::resolver::query query(req->host(), "80");
-
-			try {
-				auto result = resolver.resolve(query);
-				if (result.end() == result) { return; }
-
-				auto req_str_ptr = _generate_get_request(*req);
-
-				for (auto itr = result.begin(); result.end() != itr; ++itr) {
-
-					boost::asio::ip::tcp::endpoint remote = *result.begin();
-					sock_ptr sock(new boost::asio::ip::tcp::socket(service));
-
-					sock->async_connect(
-						remote,
-						std::bind(
-							&_handle_connection,
-							req,
-							sock,
-							std::placeholders::_1
-						)
-					);
-				}
-
-				service.run();
-			} 
-			catch (const std::exception& ex) {
-				tools::log(
-					tools::debug_type::WARNING, 
-					"_handle_send_req", 
-					std::string(ex.what()) + ": " + req->host()
-				);
+		void _handle_send_req(event_loop& loop, req_ptr req, ticket_ptr ticket) {
+			auto sock = m_connections.acquire(req->host());
+			if (nullptr != sock) {
+				auto s = std::make_shared<session>(loop, req, ticket, std::move(sock), true);
+				this->_arm(s);
+				this->_send(s);
+			}
+			else {
+				this->_connect(loop, req, ticket);
 			}
 		}
 
 	private:
-		static const size_t default_buffer_size = 2048u;
+		static const size_t default_buffer_size   = 2048u;
+		static const size_t default_max_in_flight = 1024u;
+
+		static const std::chrono::seconds default_request_timeout;
 
 	private:
-		boost::asio::io_service  m_service;
-		boost::asio::thread_pool m_pool;
+		mutable std::mutex         m_mutex;
+		std::condition_variable    m_slot_released;
+		const size_t               m_max_in_flight;
+		size_t                     m_in_flight;
+		const std::chrono::seconds m_request_timeout;
+
+		dns_cache                                m_dns;
+		std::vector<std::unique_ptr<event_loop>> m_loops;
+		connection_pool                          m_connections;
+		timings                                  m_timings;
 	};
+
+	template <typename _HTTPRequest>
+	const std::chrono::seconds http_request_executor<_HTTPRequest>::default_request_timeout(30);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,9 +1,16 @@
 #ifndef CRAWLER_RESOVLER_H
 #define CRAWLER_RESOVLER_H
 
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <simd_scan.h>
+#include <url_canonicalizer.h>
+
 namespace tools {
 
 	class string_resovler {
@@ -11,12 +18,21 @@ namespace tools {
 		virtual ~string_resovler() = default;
 
 		template <typename _Predicate>
-		size_t resovle(const std::string& source, _Predicate&& predicate) {
+		size_t resovle(std::string_view source, _Predicate&& predicate) {
+			return this->resovle(source, std::string_view(), std::forward<_Predicate>(predicate));
+		}
+
+		/*
+		 * @param base  where the source comes from, the results may be
+		 *              resolved against it.
+		 */
+		template <typename _Predicate>
+		size_t resovle(std::string_view source, std::string_view base, _Predicate&& predicate) {
 			size_t offset = 0, count = 0;
 			std::string result;
 
 			while (offset < source.length()) {
-				offset = this->process(source, offset, result);
+				offset = this->process(source, offset, base, result);
 				if (source.length() <= offset) { break; }
 				predicate(source, offset - result.length(), result);
 				++count;
@@ -29,10 +45,11 @@ namespace tools {
 		/*
 		 * @param source  the string to process.
 		 * @param pos     the current position to start parsing.
+		 * @param base    where the source comes from.
 		 * @param out     the next result will store in out.
 		 * @ret           when process ended, the offset of the rest string.
 		 */
-		virtual size_t process(const std::string& source, size_t pos, std::string& out) = 0;
+		virtual size_t process(std::string_view source, size_t pos, std::string_view base, std::string& out) = 0;
 	};
 }
 
@@ -44,22 +61,21 @@ namespace crawler {
 	class response_resovler : public tools::string_resovler {
 	public:
 
-		size_t process(const std::string &source, size_t pos, std::string &out) override {
+		size_t process(std::string_view source, size_t pos, std::string_view base, std::string &out) override {
 			out = "";
 
-			auto url = source.substr(0, source.find('\r'));
-			auto hostName = url.substr(0, source.find('/'));
+			std::string hostName(base.substr(0, base.find('/')));
 
 			boost::regex urlreg("<a[^>]+href=[\"|\'](?!javascript:)(.*?)[\"|\']");
 			boost::regex addreg("(\\/[^\\/](.*?))|(\\/)");
 			boost::regex doublereg("\\/\\/(.*?)");
 			boost::regex httpreg("(http\\:\\/\\/)|(https\\:\\/\\/)");
 
-			boost::smatch m;
+			boost::cmatch m;
 			boost::smatch http_match;
 
-			std::string::const_iterator it_begin = source.begin() + pos;
-			std::string::const_iterator it_end = source.end();
+			const char* it_begin = source.data() + pos;
+			const char* it_end = source.data() + source.length();
 
 			if (boost::regex_search(it_begin, it_end, m, urlreg)) {
 				std::string result = m[1].str();
@@ -94,8 +110,168 @@ namespace crawler {
 				return ++pos;
 			}
 
-			return it_begin - source.begin();
+			return it_begin - source.data();
+		}
+	};
+
+	/*
+	 * Single pass replacement of response_resovler. Each call continues
+	 * scanning where the previous one stopped, finds the next <a> tag with
+	 * an href attribute (quoted or not, in any case) and resolves the value
+	 * against the page url with url_canonicalizer, so the results are
+	 * canonical urls. No regex is compiled and the only writes go to the
+	 * out buffer. Candidate tags are found in bulk by the vectorized
+	 * tools::simd::scan_tags.
+	 */
+	class link_resovler : public tools::string_resovler {
+	public:
+		/*
+		 * @param sort_query  see url_canonicalizer.
+		 */
+		explicit link_resovler(bool sort_query = false) : m_canonicalizer(sort_query) { }
+
+		size_t process(std::string_view source, size_t pos, std::string_view base, std::string& out) override {
+			out.clear();
+
+			const char* first = source.data();
+			const char* last  = first + source.length();
+			const char* itr   = first + pos;
+
+			/* 
+			 * only the '<a' and '<!' positions found by the prefilter are 
+			 * parsed, the batch grows while candidates are rejected so a 
+			 * call returning on its first candidate does not scan ahead.
+			 */
+			const char* candidates[max_scan_batch];
+			size_t      batch = 1, count = 0, index = 0;
+			const char* scan_from = itr;
+
+			while (itr < last) {
+				if (index == count) {
+					if (last <= scan_from) { break; }
+					count = tools::simd::scan_tags(scan_from, last, candidates, batch);
+					index = 0;
+					if (0 == count) { break; }
+					scan_from = count < batch ? last : candidates[count - 1] + 1;
+					batch = max_scan_batch < batch * 2 ? max_scan_batch : batch * 2;
+				}
+
+				const char* tag = candidates[index++];
+				if (tag < itr) { continue; }
+
+				if ('!' == tag[1]) {
+					itr = _starts_with(tag, last, "<!--") ? _find(tag + 4, last, "-->") : tag + 1;
+					continue;
+				}
+
+				itr = tag + 1;
+				if (last - itr < 2 || !_is_space(itr[1])) {
+					continue;
+				}
+
+				const char* value_first = nullptr;
+				const char* value_last  = nullptr;
+
+				itr = _find_href(itr + 1, last, value_first, value_last);
+				if (nullptr == value_first) { continue; }
+
+				/* javascript:, mailto: and the like are rejected here */
+				if (!m_canonicalizer.resolve(base, std::string_view(value_first, value_last - value_first), out)) {
+					continue;
+				}
+
+				return itr - first;
+			}
+
+			return source.length();
+		}
+
+	private:
+		static const size_t max_scan_batch = 32u;
+
+		static bool _is_space(char c) {
+			return ' ' == c || '\t' == c || '\n' == c || '\r' == c || '\f' == c;
+		}
+
+		static char _lower(char c) {
+			return ('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c;
+		}
+
+		static bool _starts_with(const char* first, const char* last, const char* str) {
+			size_t len = strlen(str);
+			return len <= (size_t)(last - first) && 0 == memcmp(first, str, len);
+		}
+
+		static bool _istarts_with(const char* first, const char* last, const char* str) {
+			size_t len = strlen(str);
+			if ((size_t)(last - first) < len) { return false; }
+			for (size_t i = 0; i < len; ++i) {
+				if (_lower(first[i]) != str[i]) { return false; }
+			}
+			return true;
+		}
+
+		static const char* _find(const char* first, const char* last, const char* str) {
+			const char* found = std::search(first, last, str, str + strlen(str));
+			return last == found ? last : found + strlen(str);
 		}
+
+		/*
+		 * @note  scans the attributes of a tag.
+		 * @ret   the position after the href value, or after the tag when
+		 *        there is no href.
+		 */
+		static const char* _find_href(
+			const char*  itr,
+			const char*  last,
+			const char*& value_first,
+			const char*& value_last
+		) {
+			while (itr < last) {
+				while (itr < last && (_is_space(*itr) || '/' == *itr)) { ++itr; }
+				if (last <= itr || '>' == *itr) { return itr; }
+
+				const char* name = itr;
+				while (itr < last && !_is_space(*itr) && '=' != *itr && '>' != *itr && '/' != *itr) { 
+					++itr; 
+				}
+				bool is_href = 4 == itr - name && _istarts_with(name, itr, "href");
+
+				while (itr < last && _is_space(*itr)) { ++itr; }
+				if (last <= itr || '=' != *itr) { continue; }
+
+				++itr;
+				while (itr < last && _is_space(*itr)) { ++itr; }
+				if (last <= itr) { return itr; }
+
+				const char* vfirst;
+				const char* vlast;
+
+				if ('"' == *itr || '\'' == *itr) {
+					const char* quote = static_cast<const char*>(memchr(itr + 1, *itr, last - itr - 1));
+					if (nullptr == quote) { return last; }
+					vfirst = itr + 1;
+					vlast  = quote;
+					itr    = quote + 1;
+				}
+				else {
+					vfirst = itr;
+					while (itr < last && !_is_space(*itr) && '>' != *itr) { ++itr; }
+					vlast = itr;
+				}
+
+				if (is_href) {
+					value_first = vfirst;
+					value_last  = vlast;
+					return itr;
+				}
+			}
+
+			return itr;
+		}
+
+	private:
+		url_canonicalizer m_canonicalizer;
 	};
 }
 #endif
@@ -0,0 +1,623 @@
+#ifndef _CRAWLER_SHUFFLE_H_
+#define _CRAWLER_SHUFFLE_H_
+
+#include <mutex>
+#include <queue>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include <hash.h>
+#include <debug.h>
+
+namespace crawler {
+
+	namespace shuffle_detail {
+
+		/* a spill file written through a buffer */
+		class spill_out {
+		public:
+			explicit spill_out(const std::string& path) :
+				m_out(path, std::ios::binary | std::ios::trunc) { }
+
+			~spill_out() { this->close(); }
+
+			void put(const void* data, size_t bytes) {
+				m_buffer.append(static_cast<const char*>(data), bytes);
+				if (buffer_bytes <= m_buffer.size()) { this->flush(); }
+			}
+
+			void put_u64(uint64_t value) { this->put(&value, sizeof (value)); }
+			void put_u32(uint32_t value) { this->put(&value, sizeof (value)); }
+
+			void put_string(std::string_view text) {
+				this->put_u32(static_cast<uint32_t>(text.length()));
+				this->put(text.data(), text.length());
+			}
+
+			/* appends records made elsewhere, for the writers shared by threads */
+			void put_block(const std::string& block) {
+				this->flush();
+				m_out.write(block.data(), block.size());
+			}
+
+			void flush() {
+				m_out.write(m_buffer.data(), m_buffer.size());
+				m_buffer.clear();
+			}
+
+			bool close() {
+				if (!m_out.is_open()) { return true; }
+				this->flush();
+				m_out.close();
+				return !m_out.fail();
+			}
+
+		private:
+			static const size_t buffer_bytes = 1u << 20;
+
+			std::ofstream m_out;
+			std::string   m_buffer;
+		};
+
+		/* reads spill files one after another, as one */
+		class spill_in {
+		public:
+			explicit spill_in(std::vector<std::string> paths) :
+				m_paths(std::move(paths)), m_next(0), m_buffer(buffer_bytes), m_at(0), m_end(0) { }
+
+			bool get(void* data, size_t bytes) {
+				auto out = static_cast<char*>(data);
+				while (0 != bytes) {
+					if (m_at == m_end && !this->_fill()) { return false; }
+					size_t n = std::min(bytes, m_end - m_at);
+					memcpy(out, m_buffer.data() + m_at, n);
+					m_at += n; out += n; bytes -= n;
+				}
+				return true;
+			}
+
+			bool get_u64(uint64_t& value) { return this->get(&value, sizeof (value)); }
+			bool get_u32(uint32_t& value) { return this->get(&value, sizeof (value)); }
+
+			bool get_string(std::string& text) {
+				uint32_t length;
+				if (!this->get_u32(length)) { return false; }
+				text.resize(length);
+				return this->get(&text[0], length);
+			}
+
+		private:
+			static const size_t buffer_bytes = 1u << 20;
+
+			bool _fill() {
+				while (true) {
+					if (m_in.is_open()) {
+						m_in.read(m_buffer.data(), m_buffer.size());
+						m_at  = 0;
+						m_end = static_cast<size_t>(m_in.gcount());
+						if (0 != m_end) { return true; }
+						m_in.close();
+					}
+					if (m_paths.size() == m_next) { return false; }
+					m_in.clear();
+					m_in.open(m_paths[m_next++], std::ios::binary);
+				}
+			}
+
+		private:
+			std::vector<std::string> m_paths;
+			size_t                   m_next;
+			std::ifstream            m_in;
+			std::vector<char>        m_buffer;
+			size_t                   m_at;
+			size_t                   m_end;
+		};
+
+		inline void append_number(std::string& out, uint64_t value) {
+			char digits[24];
+			char* end = digits + sizeof (digits);
+			char* at  = end;
+			do { *--at = static_cast<char>('0' + value % 10); value /= 10; } while (0 != value);
+			out.append(at, end);
+		}
+
+		/*
+		 * merges sorted streams of records, next(i, key) reads the next key
+		 * of stream i, take(i) handles its current record.
+		 */
+		template <typename _Next, typename _Take>
+		void merge(size_t streams, _Next&& next, _Take&& take) {
+			typedef std::pair<uint64_t, size_t> head_type;
+			std::priority_queue<head_type, std::vector<head_type>, std::greater<head_type>> heads;
+
+			uint64_t key;
+			for (size_t i = 0; i < streams; ++i) {
+				if (next(i, key)) { heads.emplace(key, i); }
+			}
+
+			while (!heads.empty()) {
+				size_t i = heads.top().second;
+				heads.pop();
+				take(i);
+				if (next(i, key)) { heads.emplace(key, i); }
+			}
+		}
+	}
+
+	/*
+	 * Turns the edge list of a crawl ("<src>\t<dst>" lines) into url.txt:
+	 * a line "<id> <url>" per url in the order the urls first appear, an
+	 * empty line, then a line "<src> <dst>" per edge in the order the
+	 * edges first appear. The output is the same, byte for byte, as the one
+	 * of the shuffle it replaces, which held every url and every edge in
+	 * memory. This one holds a partition at a time per thread:
+	 *
+	 *   1. the input is cut in chunks read by the threads, each occurrence
+	 *      of an url goes to a spill file by the hash of the url, with its
+	 *      position (chunk, line, side), so positions compare as the lines.
+	 *   2. per partition, the first position of each url.
+	 *   3. the partitions merged by first position give the ids, and the
+	 *      url lines.
+	 *   4. per partition, each occurrence gets the id of its url, sorted by
+	 *      position.
+	 *   5. merged by position, the two sides of a line meet: the edge,
+	 *      packed in 64 bits, goes to a spill file by its hash.
+	 *   6. per partition, the edges sorted (key, line) keep their first
+	 *      line, sorted back by line.
+	 *   7. merged by line, the edge lines.
+	 *
+	 * The steps per partition run on the threads, the merges read the
+	 * partitions one record at a time.
+	 */
+	class external_shuffle {
+
+		typedef external_shuffle self_type;
+
+	public:
+		static const size_t default_memory = 1u << 30;
+
+		/* the partitions are opened at once by a merge */
+		static const size_t max_partitions = 512u;
+		/* the input bytes of a partition, at most, when there is memory to spare */
+		static const size_t partition_bytes = 16u << 20;
+
+		/*
+		 * @param memory   roughly the bytes used at most.
+		 * @param threads  0 for one per core.
+		 */
+		explicit external_shuffle(size_t memory = default_memory, size_t threads = 0) :
+			m_memory(std::max<size_t>(memory, 1u << 24)),
+			m_threads(0 != threads ? threads : std::max(1u, std::thread::hardware_concurrency())) { }
+
+		/*
+		 * @param src  the edge list.
+		 * @param dst  url.txt, the spill files go to dst.shuffle/ and are
+		 *             removed after.
+		 */
+		bool run(const std::string& src, const std::string& dst) {
+			std::error_code error;
+			const uint64_t size = std::filesystem::file_size(src, error);
+			if (error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "shuffle", error.message(), ": ", src);
+				return false;
+			}
+
+			/*
+			 * a partition (its distinct urls, in a hash map) takes about 4 times
+			 * its bytes, and is faster kept small even with memory to spare.
+			 */
+			m_partitions = static_cast<size_t>(std::min<uint64_t>(
+				max_partitions,
+				std::max<uint64_t>({ m_threads, 4 * m_threads * size / m_memory + 1, size / partition_bytes + 1 })
+			));
+
+			m_dir = dst + ".shuffle";
+			std::filesystem::remove_all(m_dir, error);
+			std::filesystem::create_directories(m_dir, error);
+			if (error) {
+				CRAWLER_LOG(tools::debug_type::FATAL, "shuffle", error.message(), ": ", m_dir);
+				return false;
+			}
+
+			std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+
+			bool result = this->_split(src, size) &&
+			              this->_parallel(&self_type::_first_positions) &&
+			              this->_number_urls(out) &&
+			              this->_parallel(&self_type::_number_occurrences) &&
+			              this->_pair_edges() &&
+			              this->_parallel(&self_type::_first_edges) &&
+			              this->_write_edges(out);
+
+			out.flush();
+			if (!out) { result = false; }
+
+			std::filesystem::remove_all(m_dir, error);
+
+			if (!result) { CRAWLER_LOG(tools::debug_type::FATAL, "shuffle", "Failed to shuffle ", src, " to ", dst); }
+			return result;
+		}
+
+	private:
+		typedef shuffle_detail::spill_out spill_out;
+		typedef shuffle_detail::spill_in  spill_in;
+
+		/* a position is (chunk, line, side), the line is (chunk, line) */
+		static const unsigned chunk_shift = 40u;
+
+		std::string _path(const char* kind, size_t part) const {
+			return m_dir + "/" + kind + "-" + std::to_string(part) + ".bin";
+		}
+
+		static size_t _partition_of(std::string_view url, size_t parts) {
+			return static_cast<size_t>(tools::murmur3_128(url).high % parts);
+		}
+
+		template <typename _Fn>
+		bool _parallel(_Fn step) {
+			std::atomic<bool> failed(false);
+			{
+				boost::asio::thread_pool pool(m_threads);
+				for (size_t part = 0; part < m_partitions; ++part) {
+					boost::asio::post(pool, [this, step, part, &failed]() {
+						if (!(this->*step)(part)) { failed.store(true); }
+					});
+				}
+				pool.join();
+			}
+			return !failed.load();
+		}
+
+		/*
+		 * step 1. A chunk begins at the first line which begins at or after
+		 * size * chunk / threads, lines are split at '\n' only, so that a
+		 * line is what getline reads.
+		 */
+		bool _split(const std::string& src, uint64_t size) {
+			const size_t chunks = m_threads;
+
+			std::vector<uint64_t> starts(chunks + 1, size);
+			starts[0] = 0;
+			{
+				std::ifstream in(src, std::ios::binary);
+				for (size_t c = 1; c < chunks; ++c) {
+					uint64_t at = std::max(starts[c - 1], size * c / chunks);
+					if (0 == at || size <= at) { starts[c] = std::min(at, size); continue; }
+
+					/* the line begins right after a '\n' */
+					in.clear();
+					in.seekg(static_cast<std::streamoff>(at - 1));
+					int each;
+					while (std::char_traits<char>::eof() != (each = in.get()) && '\n' != each) { ++at; }
+					starts[c] = std::min(at, size);
+				}
+			}
+
+			std::vector<std::unique_ptr<spill_out>> parts;
+			std::vector<std::mutex>                 locks(m_partitions);
+			for (size_t part = 0; part < m_partitions; ++part) {
+				parts.emplace_back(new spill_out(this->_path("occ", part)));
+			}
+
+			/* each thread gathers records per partition, then appends them in a block */
+			const size_t block_bytes = std::max<size_t>(4096u, std::min<size_t>(1u << 16, m_memory / (4 * chunks * m_partitions)));
+
+			std::atomic<bool> failed(false);
+			{
+				boost::asio::thread_pool pool(m_threads);
+				for (size_t c = 0; c < chunks; ++c) {
+					boost::asio::post(pool, [&, c]() {
+						std::vector<std::string> blocks(m_partitions);
+
+						auto spill = [&](size_t part) {
+							std::lock_guard<std::mutex> locker(locks[part]);
+							parts[part]->put_block(blocks[part]);
+							blocks[part].clear();
+						};
+
+						auto occurrence = [&](std::string_view url, uint64_t position) {
+							size_t part = _partition_of(url, m_partitions);
+							auto length = static_cast<uint32_t>(url.length());
+							blocks[part].append(reinterpret_cast<const char*>(&position), sizeof (position))
+							            .append(reinterpret_cast<const char*>(&length), sizeof (length))
+							            .append(url.data(), url.length());
+							if (block_bytes <= blocks[part].size()) { spill(part); }
+						};
+
+						uint64_t line_no = 0;
+						bool ok = _read_lines(src, starts[c], starts[c + 1], [&](std::string_view line) {
+							/* the old shuffle took the whole line for both sides when there is no tab */
+							size_t tab = line.find('\t');
+							std::string_view source = line.substr(0, tab);
+							std::string_view target = std::string_view::npos == tab ? line : line.substr(tab + 1);
+
+							uint64_t position = (static_cast<uint64_t>(c) << chunk_shift) | (line_no++ << 1);
+							occurrence(source, position);
+							occurrence(target, position | 1);
+						});
+
+						for (size_t part = 0; part < m_partitions; ++part) {
+							if (!blocks[part].empty()) { spill(part); }
+						}
+						if (!ok) { failed.store(true); }
+					});
+				}
+				pool.join();
+			}
+
+			for (auto& each : parts) {
+				if (!each->close()) { failed.store(true); }
+			}
+			return !failed.load();
+		}
+
+		/* @param fn  called with each line of [first, last) of the file */
+		template <typename _Fn>
+		static bool _read_lines(const std::string& path, uint64_t first, uint64_t last, _Fn&& fn) {
+			if (first == last) { return true; }
+
+			std::ifstream in(path, std::ios::binary);
+			in.seekg(static_cast<std::streamoff>(first));
+
+			std::vector<char> buffer(1u << 20);
+			std::string       carry;
+			uint64_t          left = last - first;
+
+			while (0 != left) {
+				in.read(buffer.data(), std::min<uint64_t>(left, buffer.size()));
+				size_t got = static_cast<size_t>(in.gcount());
+				if (0 == got) { return false; }
+				left -= got;
+
+				const char* at  = buffer.data();
+				const char* end = at + got;
+				while (true) {
+					auto newline = static_cast<const char*>(memchr(at, '\n', end - at));
+					if (nullptr == newline) { break; }
+
+					if (carry.empty()) { fn(std::string_view(at, newline - at)); }
+					else {
+						carry.append(at, newline);
+						fn(std::string_view(carry));
+						carry.clear();
+					}
+					at = newline + 1;
+				}
+				carry.append(at, end);
+			}
+
+			/* the last line of the file, without '\n' */
+			if (!carry.empty()) { fn(std::string_view(carry)); }
+			return true;
+		}
+
+		/* step 2: the distinct urls of a partition by first position */
+		bool _first_positions(size_t part) {
+			std::unordered_map<std::string, uint64_t> firsts;
+			spill_in in({ this->_path("occ", part) });
+
+			uint64_t    position;
+			std::string url;
+			while (in.get_u64(position) && in.get_string(url)) {
+				auto result = firsts.emplace(url, position);
+				if (!result.second && position < result.first->second) { result.first->second = position; }
+			}
+
+			std::vector<std::pair<uint64_t, const std::string*>> sorted;
+			sorted.reserve(firsts.size());
+			for (const auto& each : firsts) { sorted.emplace_back(each.second, &each.first); }
+			std::sort(sorted.begin(), sorted.end());
+
+			spill_out out(this->_path("first", part));
+			for (const auto& each : sorted) {
+				out.put_u64(each.first);
+				out.put_string(*each.second);
+			}
+			return out.close();
+		}
+
+		/* step 3 */
+		bool _number_urls(std::ofstream& out) {
+			std::vector<std::unique_ptr<spill_in>>  firsts;
+			std::vector<std::unique_ptr<spill_out>> ids;
+			std::vector<std::string>                urls(m_partitions);
+
+			for (size_t part = 0; part < m_partitions; ++part) {
+				firsts.emplace_back(new spill_in({ this->_path("first", part) }));
+				ids.emplace_back(new spill_out(this->_path("id", part)));
+			}
+
+			uint32_t    next = 0;
+			std::string text;
+
+			shuffle_detail::merge(
+				m_partitions,
+				[&](size_t part, uint64_t& position) {
+					return firsts[part]->get_u64(position) && firsts[part]->get_string(urls[part]);
+				},
+				[&](size_t part) {
+					ids[part]->put_u32(next);
+					shuffle_detail::append_number(text, next++);
+					text.append(" ").append(urls[part]).append("\n");
+					if ((1u << 20) <= text.size()) { out.write(text.data(), text.size()); text.clear(); }
+				}
+			);
+
+			text.append("\n");
+			out.write(text.data(), text.size());
+
+			bool result = static_cast<bool>(out);
+			for (auto& each : ids) { result = each->close() && result; }
+			return result;
+		}
+
+		/* step 4 */
+		bool _number_occurrences(size_t part) {
+			std::unordered_map<std::string, uint32_t> ids;
+			{
+				spill_in firsts({ this->_path("first", part) });
+				spill_in numbers({ this->_path("id", part) });
+
+				uint64_t    position;
+				uint32_t    id;
+				std::string url;
+				while (firsts.get_u64(position) && firsts.get_string(url) && numbers.get_u32(id)) {
+					ids.emplace(std::move(url), id);
+				}
+			}
+
+			std::vector<std::pair<uint64_t, uint32_t>> numbered;
+			{
+				spill_in in({ this->_path("occ", part) });
+
+				uint64_t    position;
+				std::string url;
+				while (in.get_u64(position) && in.get_string(url)) {
+					auto itr = ids.find(url);
+					if (ids.end() == itr) { return false; }
+					numbered.emplace_back(position, itr->second);
+				}
+			}
+
+			/* the chunks were appended in any order */
+			std::sort(numbered.begin(), numbered.end());
+
+			spill_out out(this->_path("num", part));
+			for (const auto& each : numbered) {
+				out.put_u64(each.first);
+				out.put_u32(each.second);
+			}
+
+			std::error_code ignored;
+			std::filesystem::remove(this->_path("occ", part), ignored);
+			return out.close();
+		}
+
+		/* step 5 */
+		bool _pair_edges() {
+			std::vector<std::unique_ptr<spill_in>>  numbered;
+			std::vector<std::unique_ptr<spill_out>> edges;
+			std::vector<uint64_t>                   positions(m_partitions);
+			std::vector<uint32_t>                   ids(m_partitions);
+
+			for (size_t part = 0; part < m_partitions; ++part) {
+				numbered.emplace_back(new spill_in({ this->_path("num", part) }));
+				edges.emplace_back(new spill_out(this->_path("edge", part)));
+			}
+
+			uint32_t source = 0;
+
+			shuffle_detail::merge(
+				m_partitions,
+				[&](size_t part, uint64_t& position) {
+					if (!numbered[part]->get_u64(positions[part]) || !numbered[part]->get_u32(ids[part])) { return false; }
+					position = positions[part];
+					return true;
+				},
+				[&](size_t part) {
+					/* the source of a line comes right before its target */
+					if (0 == (positions[part] & 1)) {
+						source = ids[part];
+						return;
+					}
+
+					const uint64_t key = (static_cast<uint64_t>(source) << 32) | ids[part];
+					auto& target = *edges[tools::fmix64(key) % m_partitions];
+					target.put_u64(key);
+					target.put_u64(positions[part] >> 1);
+				}
+			);
+
+			bool result = true;
+			for (auto& each : edges) { result = each->close() && result; }
+			return result;
+		}
+
+		/* step 6 */
+		bool _first_edges(size_t part) {
+			std::vector<std::pair<uint64_t, uint64_t>> edges;
+			{
+				spill_in in({ this->_path("edge", part) });
+
+				uint64_t key, line;
+				while (in.get_u64(key) && in.get_u64(line)) { edges.emplace_back(key, line); }
+			}
+
+			std::sort(edges.begin(), edges.end());
+			edges.erase(
+				std::unique(edges.begin(), edges.end(), [](const auto& a, const auto& b) { return a.first == b.first; }),
+				edges.end()
+			);
+
+			for (auto& each : edges) { std::swap(each.first, each.second); }
+			std::sort(edges.begin(), edges.end());
+
+			spill_out out(this->_path("dedup", part));
+			for (const auto& each : edges) {
+				out.put_u64(each.first);
+				out.put_u64(each.second);
+			}
+			return out.close();
+		}
+
+		/* step 7 */
+		bool _write_edges(std::ofstream& out) {
+			std::vector<std::unique_ptr<spill_in>> edges;
+			std::vector<uint64_t>                  keys(m_partitions);
+
+			for (size_t part = 0; part < m_partitions; ++part) {
+				edges.emplace_back(new spill_in({ this->_path("dedup", part) }));
+			}
+
+			std::string text;
+
+			shuffle_detail::merge(
+				m_partitions,
+				[&](size_t part, uint64_t& line) {
+					return edges[part]->get_u64(line) && edges[part]->get_u64(keys[part]);
+				},
+				[&](size_t part) {
+					shuffle_detail::append_number(text, keys[part] >> 32);
+					text.append(" ");
+					shuffle_detail::append_number(text, keys[part] & 0xffffffffu);
+					text.append("\n");
+					if ((1u << 20) <= text.size()) { out.write(text.data(), text.size()); text.clear(); }
+				}
+			);
+
+			out.write(text.data(), text.size());
+			return static_cast<bool>(out);
+		}
+
+	private:
+		size_t      m_memory;
+		size_t      m_threads;
+		size_t      m_partitions;
+		std::string m_dir;
+	};
+
+	/*
+	 * @param src  the edge list of a crawl.
+	 * @param dst  url.txt.
+	 */
+	inline bool shuffle(const std::string& src, const std::string& dst) {
+		return external_shuffle().run(src, dst);
+	}
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef _CRAWLER_SIMD_SCAN_H_
+#define _CRAWLER_SIMD_SCAN_H_
+
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define _CRAWLER_SIMD_X86_
+#endif
+
+#ifdef _CRAWLER_SIMD_X86_
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#if defined(_CRAWLER_SIMD_X86_) && !defined(_MSC_VER)
+#define _CRAWLER_TARGET_AVX2_ __attribute__((target("avx2")))
+#else
+#define _CRAWLER_TARGET_AVX2_
+#endif
+
+namespace tools {
+
+	namespace simd {
+
+		struct cpu_features {
+			bool sse2;
+			bool avx2;
+		};
+
+		/*
+		 * @note  detected once, the instruction sets are picked at runtime
+		 *        so the binary still runs on cpus without avx2.
+		 */
+		inline const cpu_features& detect_cpu() {
+			static const cpu_features features = []() {
+				cpu_features result = { false, false };
+#if defined(_CRAWLER_SIMD_X86_) && defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 0);
+				int max_leaf = info[0];
+
+				__cpuid(info, 1);
+				result.sse2 = 0 != (info[3] & (1 << 26));
+				bool osxsave = 0 != (info[2] & (1 << 27));
+
+				if (7 <= max_leaf && osxsave && 6 == (_xgetbv(0) & 6)) {
+					__cpuidex(info, 7, 0);
+					result.avx2 = 0 != (info[1] & (1 << 5));
+				}
+#elif defined(_CRAWLER_SIMD_X86_)
+				__builtin_cpu_init();
+				result.sse2 = __builtin_cpu_supports("sse2");
+				result.avx2 = __builtin_cpu_supports("avx2");
+#endif
+				return result;
+			}();
+
+			return features;
+		}
+
+		inline unsigned count_trailing_zeros(unsigned mask) {
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		/*
+		 * A tag candidate is a '<' followed by 'a', 'A' or '!', which is
+		 * every position the link parser has to look at (anchors and
+		 * comments).
+		 */
+		inline bool is_tag_candidate(const char* itr, const char* last) {
+			return '<' == itr[0] && itr + 1 < last &&
+				('a' == (itr[1] | 0x20) || '!' == itr[1]);
+		}
+
+		/*
+		 * @param first  the begin of the text to scan.
+		 * @param last   the end of the text to scan.
+		 * @param out    receives the candidates in ascending order.
+		 * @param max    the max number of candidates to report.
+		 * @ret          the number of candidates reported, when it is max
+		 *               the scan stopped after out[max - 1].
+		 */
+		inline size_t scan_tags_scalar(
+			const char* first, const char* last, const char** out, size_t max
+		) {
+			size_t count = 0;
+			for (; first < last && count < max; ++first) {
+				if (is_tag_candidate(first, last)) { out[count++] = first; }
+			}
+			return count;
+		}
+
+#ifdef _CRAWLER_SIMD_X86_
+		inline size_t scan_tags_sse2(
+			const char* first, const char* last, const char** out, size_t max
+		) {
+			const __m128i lt    = _mm_set1_epi8('<');
+			const __m128i a     = _mm_set1_epi8('a');
+			const __m128i bang  = _mm_set1_epi8('!');
+			const __m128i lower = _mm_set1_epi8(0x20);
+
+			size_t count = 0;
+
+			/* the second load reads one byte ahead */
+			while (17 <= last - first) {
+				__m128i cur  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+				__m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + 1));
+
+				__m128i hit = _mm_and_si128(
+					_mm_cmpeq_epi8(cur, lt),
+					_mm_or_si128(
+						_mm_cmpeq_epi8(_mm_or_si128(next, lower), a),
+						_mm_cmpeq_epi8(next, bang)
+					)
+				);
+
+				unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+				while (0 != mask) {
+					out[count++] = first + count_trailing_zeros(mask);
+					if (max <= count) { return count; }
+					mask &= mask - 1;
+				}
+
+				first += 16;
+			}
+
+			return count + scan_tags_scalar(first, last, out + count, max - count);
+		}
+
+		_CRAWLER_TARGET_AVX2_ inline size_t scan_tags_avx2(
+			const char* first, const char* last, const char** out, size_t max
+		) {
+			const __m256i lt    = _mm256_set1_epi8('<');
+			const __m256i a     = _mm256_set1_epi8('a');
+			const __m256i bang  = _mm256_set1_epi8('!');
+			const __m256i lower = _mm256_set1_epi8(0x20);
+
+			size_t count = 0;
+
+			while (33 <= last - first) {
+				__m256i cur  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+				__m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + 1));
+
+				__m256i hit = _mm256_and_si256(
+					_mm256_cmpeq_epi8(cur, lt),
+					_mm256_or_si256(
+						_mm256_cmpeq_epi8(_mm256_or_si256(next, lower), a),
+						_mm256_cmpeq_epi8(next, bang)
+					)
+				);
+
+				unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+				while (0 != mask) {
+					out[count++] = first + count_trailing_zeros(mask);
+					if (max <= count) { return count; }
+					mask &= mask - 1;
+				}
+
+				first += 32;
+			}
+
+			return count + scan_tags_sse2(first, last, out + count, max - count);
+		}
+#endif
+
+		typedef size_t (*scan_tags_fn)(const char*, const char*, const char**, size_t);
+
+		inline scan_tags_fn select_scan_tags() {
+#ifdef _CRAWLER_SIMD_X86_
+			const auto& cpu = detect_cpu();
+			if (cpu.avx2) { return &scan_tags_avx2; }
+			if (cpu.sse2) { return &scan_tags_sse2; }
+#endif
+			return &scan_tags_scalar;
+		}
+
+		/*
+		 * @note  same contract as scan_tags_scalar, using the widest
+		 *        instruction set of the cpu.
+		 */
+		inline size_t scan_tags(
+			const char* first, const char* last, const char** out, size_t max
+		) {
+			static const scan_tags_fn fn = select_scan_tags();
+			return fn(first, last, out, max);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef _CRAWLER_URL_CANONICALIZER_H_
+#define _CRAWLER_URL_CANONICALIZER_H_
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
+namespace crawler {
+
+	/*
+	 * Brings urls to the form the crawler keeps them in, host/path?query
+	 * without a scheme, so that every spelling of a page is tested by the
+	 * filter once:
+	 *   - the host is lowercased, user info, a trailing dot and :80 go,
+	 *   - the fragment goes,
+	 *   - '.' and '..' segments are resolved,
+	 *   - escapes of unreserved characters are decoded, the other escapes
+	 *     get uppercase hex digits, bytes not allowed in urls are escaped
+	 *     and tabs and line breaks are dropped,
+	 *   - the root path is empty ("www.runoob.com/" is "www.runoob.com"),
+	 *   - the query parameters are sorted if asked for.
+	 * Links are resolved against the url of the page they were found in.
+	 * The results are written to a caller's buffer, the scratch space is
+	 * per thread and reused, so nothing is allocated once it is warm.
+	 */
+	class url_canonicalizer {
+	public:
+		/*
+		 * @param sort_query  whether a=1&b=2 and b=2&a=1 are the same url.
+		 */
+		explicit url_canonicalizer(bool sort_query = false) : m_sort_query(sort_query) { }
+
+		/*
+		 * @param base  the url of the page (host/path?query, a http or https
+		 *              scheme is allowed).
+		 * @param href  the link as written in the page.
+		 * @param out   receives the canonical url, cleared first.
+		 * @ret         false if href does not lead to a http(s) url.
+		 */
+		bool resolve(std::string_view base, std::string_view href, std::string& out) const {
+			out.clear();
+
+			href = _trim(href);
+			href = href.substr(0, href.find('#'));
+
+			size_t scheme = _scheme_length(href);
+			if (0 != scheme) {
+				if (!_is_http(href.substr(0, scheme))) { return false; }
+				href.remove_prefix(scheme + 1);
+				if (!_starts_with(href, "//")) { return false; }
+			}
+
+			if (_starts_with(href, "//")) {
+				return this->_absolute(href.substr(2), out);
+			}
+
+			base = _skip_scheme(_trim(base));
+			base = base.substr(0, base.find('#'));
+
+			size_t host_end = base.find_first_of("/?");
+			std::string_view base_host = base.substr(0, host_end);
+			if (base_host.empty()) { return false; }
+
+			std::string_view base_rest  = std::string_view::npos == host_end ? std::string_view() : base.substr(host_end);
+			std::string_view base_path  = base_rest.substr(0, base_rest.find('?'));
+			std::string_view base_query = base_rest.substr(base_path.length());
+
+			thread_local std::string path;
+			path.clear();
+
+			std::string_view query;
+
+			if (href.empty()) {
+				path.append(base_path);
+				query = base_query;
+			}
+			else if ('?' == href[0]) {
+				path.append(base_path);
+				query = href;
+			}
+			else {
+				std::string_view href_path = href.substr(0, href.find('?'));
+				query = href.substr(href_path.length());
+
+				if ('/' != href[0]) {
+					/* relative to the directory of the page */
+					size_t slash = base_path.rfind('/');
+					if (std::string_view::npos == slash) { path.push_back('/'); }
+					else { path.append(base_path.substr(0, slash + 1)); }
+				}
+				path.append(href_path);
+			}
+
+			return this->_assemble(base_host, path, query, out);
+		}
+
+		/*
+		 * @param url  an absolute url, host/path?query with or without a
+		 *             http(s) scheme.
+		 * @ret        false if it is not a http(s) url or has no host. A
+		 *             host with a port ("localhost:8080/a") is not taken for
+		 *             a scheme.
+		 */
+		bool canonicalize(std::string_view url, std::string& out) const {
+			out.clear();
+
+			url = _trim(url);
+			size_t scheme = _scheme_length(url);
+			if (0 != scheme && !_is_port(url.substr(scheme + 1))) {
+				if (!_is_http(url.substr(0, scheme))) { return false; }
+				url.remove_prefix(scheme + 1);
+				if (!_starts_with(url, "//")) { return false; }
+				url.remove_prefix(2);
+			}
+
+			return this->_absolute(url.substr(0, url.find('#')), out);
+		}
+
+		std::string canonicalize(std::string_view url) const {
+			std::string result;
+			if (!this->canonicalize(url, result)) { result.assign(url); }
+			return result;
+		}
+
+	private:
+		/* authority/path?query */
+		bool _absolute(std::string_view url, std::string& out) const {
+			size_t host_end = url.find_first_of("/?");
+			std::string_view host = url.substr(0, host_end);
+			std::string_view rest = std::string_view::npos == host_end ? std::string_view() : url.substr(host_end);
+			std::string_view path = rest.substr(0, rest.find('?'));
+
+			return this->_assemble(host, path, rest.substr(path.length()), out);
+		}
+
+		/*
+		 * @param query  empty or starting with '?'.
+		 */
+		bool _assemble(
+			std::string_view host,
+			std::string_view path,
+			std::string_view query,
+			std::string&     out
+		) const {
+			if (!_append_host(host, out)) { return false; }
+
+			const size_t host_length = out.length();
+
+			thread_local std::string scratch;
+
+			scratch.clear();
+			_append_escaped(path, scratch);
+			_append_path(scratch, out);
+
+			if (1 < query.length()) {
+				scratch.clear();
+				_append_escaped(query.substr(1), scratch);
+
+				if (!scratch.empty()) {
+					if (host_length == out.length()) { out.push_back('/'); }
+					out.push_back('?');
+					if (m_sort_query) { _append_sorted(scratch, out); }
+					else { out.append(scratch); }
+				}
+			}
+
+			return true;
+		}
+
+		static bool _append_host(std::string_view host, std::string& out) {
+			size_t at = host.rfind('@');
+			if (std::string_view::npos != at) { host.remove_prefix(at + 1); }
+
+			if (_ends_with(host, ":80")) { host.remove_suffix(3); }
+			if (_ends_with(host, ":"))   { host.remove_suffix(1); }
+			if (_ends_with(host, "."))   { host.remove_suffix(1); }
+
+			if (host.empty()) { return false; }
+
+			const size_t start = out.length();
+			out.append(host);
+
+			for (size_t i = start; i < out.length(); ++i) {
+				char c = out[i];
+				if (!_is_alnum(c) && '-' != c && '.' != c && '_' != c && ':' != c) {
+					out.resize(start);
+					return false;
+				}
+				out[i] = _lower(c);
+			}
+
+			return true;
+		}
+
+		/*
+		 * @note  RFC 3986 remove_dot_segments, writing the result after the
+		 *        host, the root path is left out.
+		 */
+		static void _append_path(std::string_view path, std::string& out) {
+			const size_t path_start = out.length();
+
+			if (!path.empty() && '/' == path[0]) { path.remove_prefix(1); }
+
+			while (true) {
+				size_t slash = path.find('/');
+				bool   last  = std::string_view::npos == slash;
+				std::string_view segment = path.substr(0, slash);
+
+				if ("." == segment) { }
+				else if (".." == segment) {
+					size_t prev = out.rfind('/');
+					if (std::string_view::npos != prev && path_start <= prev) { out.resize(prev); }
+				}
+				else if (!last || !segment.empty()) {
+					out.push_back('/');
+					out.append(segment);
+				}
+
+				if (last) {
+					if (("." == segment || ".." == segment || segment.empty()) && path_start < out.length()) {
+						out.push_back('/');
+					}
+					break;
+				}
+
+				path.remove_prefix(slash + 1);
+			}
+		}
+
+		static void _append_escaped(std::string_view src, std::string& out) {
+			static const char hex[] = "0123456789ABCDEF";
+
+			for (size_t i = 0; i < src.length(); ) {
+				/* the characters kept as they are go in runs */
+				size_t run = i;
+				while (run < src.length() && _is_kept(static_cast<unsigned char>(src[run]))) { ++run; }
+				out.append(src.data() + i, run - i);
+				if (src.length() <= run) { break; }
+
+				i = run;
+				auto c = static_cast<unsigned char>(src[i++]);
+
+				if ('\t' == c || '\n' == c || '\r' == c) { continue; }
+
+				if ('%' == c && i + 1 < src.length() && _is_hex(src[i]) && _is_hex(src[i + 1])) {
+					c = static_cast<unsigned char>(_hex_value(src[i]) * 16 + _hex_value(src[i + 1]));
+					i += 2;
+					if (_is_unreserved(c)) { out.push_back(static_cast<char>(c)); continue; }
+				}
+
+				out.push_back('%');
+				out.push_back(hex[c >> 4]);
+				out.push_back(hex[c & 15]);
+			}
+		}
+
+		/* unreserved characters and delimiters */
+		static bool _is_kept(unsigned char c) {
+			static const struct table {
+				table() : kept() {
+					for (int c = 0; c < 256; ++c) {
+						kept[c] = _is_unreserved(static_cast<unsigned char>(c)) ||
+							(0 != c && nullptr != strchr("!$&'()*+,;=:@/?", c));
+					}
+				}
+				bool kept[256];
+			} lookup;
+
+			return lookup.kept[c];
+		}
+
+		static void _append_sorted(std::string_view query, std::string& out) {
+			thread_local std::vector<std::string_view> params;
+			params.clear();
+
+			while (!query.empty()) {
+				size_t amp = query.find('&');
+				auto param = query.substr(0, amp);
+				if (!param.empty()) { params.push_back(param); }
+				if (std::string_view::npos == amp) { break; }
+				query.remove_prefix(amp + 1);
+			}
+
+			std::stable_sort(params.begin(), params.end(),
+				[](std::string_view lhs, std::string_view rhs) {
+					return lhs.substr(0, lhs.find('=')) < rhs.substr(0, rhs.find('='));
+				}
+			);
+
+			for (size_t i = 0; i < params.size(); ++i) {
+				if (0 != i) { out.push_back('&'); }
+				out.append(params[i]);
+			}
+		}
+
+		/*
+		 * @ret  the length of the scheme if url starts with one, 0 otherwise.
+		 */
+		/* @param rest  what follows the first ':' of the url */
+		static bool _is_port(std::string_view rest) {
+			size_t digits = 0;
+			while (digits < rest.length() && '0' <= rest[digits] && rest[digits] <= '9') { ++digits; }
+			return 0 != digits && (rest.length() == digits || '/' == rest[digits] || '?' == rest[digits] || '#' == rest[digits]);
+		}
+
+		static size_t _scheme_length(std::string_view url) {
+			if (url.empty() || !_is_alpha(url[0])) { return 0; }
+
+			for (size_t i = 1; i < url.length(); ++i) {
+				char c = url[i];
+				if (':' == c) { return i; }
+				if (!_is_alnum(c) && '+' != c && '-' != c && '.' != c) { return 0; }
+			}
+
+			return 0;
+		}
+
+		static bool _is_http(std::string_view scheme) {
+			return _iequals(scheme, "http") || _iequals(scheme, "https");
+		}
+
+		static std::string_view _skip_scheme(std::string_view url) {
+			size_t scheme = _scheme_length(url);
+			if (0 != scheme && _is_http(url.substr(0, scheme)) && _starts_with(url.substr(scheme + 1), "//")) {
+				url.remove_prefix(scheme + 3);
+			}
+			return url;
+		}
+
+		static std::string_view _trim(std::string_view str) {
+			while (!str.empty() && _is_space(str.front())) { str.remove_prefix(1); }
+			while (!str.empty() && _is_space(str.back()))  { str.remove_suffix(1); }
+			return str;
+		}
+
+		static bool _starts_with(std::string_view str, std::string_view prefix) {
+			return prefix.length() <= str.length() && str.substr(0, prefix.length()) == prefix;
+		}
+
+		static bool _ends_with(std::string_view str, std::string_view suffix) {
+			return suffix.length() <= str.length() && str.substr(str.length() - suffix.length()) == suffix;
+		}
+
+		static bool _iequals(std::string_view lhs, std::string_view rhs) {
+			if (lhs.length() != rhs.length()) { return false; }
+			for (size_t i = 0; i < lhs.length(); ++i) {
+				if (_lower(lhs[i]) != _lower(rhs[i])) { return false; }
+			}
+			return true;
+		}
+
+		static bool _is_space(char c) {
+			return ' ' == c || '\t' == c || '\n' == c || '\r' == c || '\f' == c;
+		}
+
+		static bool _is_alpha(char c) { return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'); }
+		static bool _is_digit(char c) { return '0' <= c && c <= '9'; }
+		static bool _is_alnum(char c) { return _is_alpha(c) || _is_digit(c); }
+
+		static bool _is_hex(char c) {
+			return _is_digit(c) || ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F');
+		}
+
+		static int _hex_value(char c) {
+			return _is_digit(c) ? c - '0' : (_lower(c) - 'a' + 10);
+		}
+
+		static bool _is_unreserved(unsigned char c) {
+			return _is_alnum(static_cast<char>(c)) || '-' == c || '.' == c || '_' == c || '~' == c;
+		}
+
+		static char _lower(char c) {
+			return ('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c;
+		}
+
+	private:
+		bool m_sort_query;
+	};
+}
+
+#endif
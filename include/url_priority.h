@@ -0,0 +1,164 @@
+#ifndef _CRAWLER_URL_PRIORITY_H_
+#define _CRAWLER_URL_PRIORITY_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include <messages.h>
+
+namespace crawler {
+
+	/*
+	 * Decides which urls are crawled first. An url gets one of levels
+	 * priorities, higher first, urls of one level go in the order they
+	 * were found. level() may be called from any thread, observe() is
+	 * called by the filter thread for every link found, new or not.
+	 */
+	class url_priority {
+	public:
+		static const size_t levels = 16u;
+
+		virtual ~url_priority() = default;
+
+		/* @ret  0 to levels - 1 */
+		virtual size_t level(const url_message& msg) const = 0;
+
+		/*
+		 * @ret  true if the level of the url went up with this link, the url
+		 *       is then queued again with its new level (the copy fetched
+		 *       later is skipped).
+		 */
+		virtual bool observe(const url_message&) { return false; }
+
+		/* whether observe() may ever return true, an url is queued once otherwise */
+		virtual bool promotes() const { return false; }
+	};
+
+	/*
+	 * Shallow pages first, the seeds are depth 0. Urls of one depth keep
+	 * their order, so this is the breadth first crawl.
+	 */
+	class depth_priority : public url_priority {
+	public:
+		size_t level(const url_message& msg) const override {
+			return msg.depth() < levels ? levels - 1 - msg.depth() : 0;
+		}
+	};
+
+	/*
+	 * Pages linked to most often so far first, a level for every doubling
+	 * of the links. The links are counted in a count-min sketch (conservative
+	 * update), so the memory is fixed and a count may be too high, never
+	 * too low.
+	 */
+	class in_degree_priority : public url_priority {
+	public:
+		static const size_t default_width = 1u << 18;
+
+		/* @param width  the counters per row, rounded up to a power of two */
+		explicit in_degree_priority(size_t width = default_width) :
+			m_mask(_round_up(width) - 1),
+			m_counts(rows * (m_mask + 1)) { }
+
+		size_t level(const url_message& msg) const override {
+			return _level(this->count(msg));
+		}
+
+		bool observe(const url_message& msg) override {
+			size_t index[rows];
+			this->_indices(msg, index);
+
+			uint16_t least = UINT16_MAX;
+			for (size_t i = 0; i < rows; ++i) {
+				uint16_t each = m_counts[index[i]].load(std::memory_order_relaxed);
+				if (each < least) { least = each; }
+			}
+
+			if (UINT16_MAX == least) { return false; }
+
+			/* only the smallest counters go up */
+			for (size_t i = 0; i < rows; ++i) {
+				if (least == m_counts[index[i]].load(std::memory_order_relaxed)) {
+					m_counts[index[i]].store(least + 1, std::memory_order_relaxed);
+				}
+			}
+
+			/* the first link is how the url was found, it is not a promotion */
+			return 0 != least && _level(least) != _level(least + 1u);
+		}
+
+		bool promotes() const override { return true; }
+
+		/* the links to the url seen so far (an upper bound) */
+		uint16_t count(const url_message& msg) const {
+			size_t index[rows];
+			this->_indices(msg, index);
+
+			uint16_t least = UINT16_MAX;
+			for (size_t i = 0; i < rows; ++i) {
+				uint16_t each = m_counts[index[i]].load(std::memory_order_relaxed);
+				if (each < least) { least = each; }
+			}
+			return least;
+		}
+
+	private:
+		static const size_t rows = 4u;
+
+		static size_t _round_up(size_t n) {
+			size_t result = 1;
+			while (result < n) { result <<= 1; }
+			return result;
+		}
+
+		/* the bit length of the count: 0, 1, 2-3, 4-7, ... */
+		static size_t _level(unsigned count) {
+			size_t result = 0;
+			while (0 != count && result < levels - 1) {
+				count >>= 1;
+				++result;
+			}
+			return result;
+		}
+
+		/* four 32-bit slices of the fingerprint, one per row */
+		void _indices(const url_message& msg, size_t* index) const {
+			const auto& fp = msg.location().fingerprint();
+			const uint64_t halves[2] = { fp.low, fp.high };
+
+			for (size_t i = 0; i < rows; ++i) {
+				uint64_t slice = halves[i / 2] >> (32 * (i % 2));
+				index[i] = i * (m_mask + 1) + (static_cast<size_t>(slice) & m_mask);
+			}
+		}
+
+	private:
+		const size_t                       m_mask;
+		std::vector<std::atomic<uint16_t>> m_counts;
+	};
+
+	/*
+	 * Any scoring of the caller, a score in [0, 1] is spread over the levels.
+	 */
+	class score_priority : public url_priority {
+	public:
+		typedef std::function<double(const url_message&)> scorer_type;
+
+		explicit score_priority(scorer_type score) : m_score(std::move(score)) { }
+
+		size_t level(const url_message& msg) const override {
+			double score = m_score(msg);
+			if (!(0.0 < score)) { return 0; }
+			if (1.0 <= score)   { return levels - 1; }
+			return static_cast<size_t>(score * levels);
+		}
+
+	private:
+		scorer_type m_score;
+	};
+}
+
+#endif
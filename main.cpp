@@ -1,6 +1,8 @@
 #include <vector>
+#include <iostream>
 
 #include <core.h>
+#include <shuffle.h>
 #include <debug.h>
 
 namespace tools {
@@ -40,92 +42,32 @@ namespace crawler {
 			return false;
 		}
 	}
+}
 
-	/*
-	 * Created by Xie Xiaofei on 2018-07-12
-	 * @param src  Դļ·
-	 * @param dst  Ŀļ·
-	 */
-	inline bool shuffle(const std::string& src, const std::string& dst) {
-		std::ifstream in(src);
-		std::ofstream out(dst);
-		std::ofstream temp("temp.txt");
-		std::pmr::unordered_map<std::string, int> urlMap;
-		int sourceID = 0;
-		int destID = 0;
-		std::string filename;
-		std::string line;
-		std::string link;
-		int count = 0;
-		if (in) {
-			while (getline(in, line)) {
-				std::string sourceUrl;
-				std::string destUrl;
-				size_t pos = line.find("\t");
-				sourceUrl = line.substr(0, pos);
-				destUrl = line.substr(pos + 1, line.size());
-				//sourceUrl
-				std::unordered_map < std::string, int >::iterator sourceIter;
-				sourceIter = urlMap.find(sourceUrl);
-				if (sourceIter != urlMap.end()) {
-					sourceID = sourceIter->second;
-				}
-				else
-				{
-					sourceID = count;
-					urlMap.insert(std::unordered_map < std::string, int >::value_type(sourceUrl, count));
-					out << sourceID << " " << sourceUrl << std::endl;
-					count++;
-				}
-
-				//destUrl
-				std::unordered_map < std::string, int >::iterator destIter;
-				destIter = urlMap.find(destUrl);
-				if (destIter != urlMap.end()) {
-					destID = destIter->second;
-				}
-				else
-				{
-					destID = count;
-					urlMap.insert(std::unordered_map < std::string, int >::value_type(destUrl, count));
-					out << destID << " " << destUrl << std::endl;
-					count++;
-				}
-				temp << sourceID << " " << destID << std::endl;
-			}
-		}
-		else
-		{
-			return false;
-		}
-		in.close();
-		temp.close();
-
-		out << std::endl;
-
-		std::ifstream tempIn("temp.txt");
-		std::set<std::string> pairs;
-
-		while (getline(tempIn, line)) {
-			auto itr = pairs.find(line);
-			if (pairs.end() != itr) { continue; }
-			out << line << std::endl;
-			pairs.emplace_hint(itr, std::move(line));
-		}
-
-		tempIn.close();
-		out.close();
-
-		remove("temp.txt");
+int main(int argc, char** argv) {
 
-		return true;
+	/* the edge list of a crawl of an earlier version ("<src>\t<dst>" lines) to url.txt */
+	if (4 == argc && std::string("--shuffle") == argv[1]) {
+		return crawler::shuffle(argv[2], argv[3]) ? 0 : -3;
 	}
-}
 
-int main(int argc, char** argv) {
+	/*
+	 * --resume: go on from the last checkpoint, --binary: write a graph file (graph_format.h),
+	 * --filter scalable|blocked|exact: the filter of the urls seen (filter.h)
+	 */
+	bool resume = false;
+	bool binary = false;
+	std::string filter = "scalable";
+
+	for (int i = 3; i < argc; ++i) {
+		if (std::string("--resume") == argv[i]) { resume = true; }
+		else if (std::string("--binary") == argv[i]) { binary = true; }
+		else if (std::string("--filter") == argv[i] && i + 1 < argc) { filter = argv[++i]; }
+		else { argc = 0; }
+	}
 
-	if (3 != argc) {
-		tools::log(
+	if (argc < 3) {
+		CRAWLER_LOG(
 			tools::debug_type::FATAL, "main", "Invalid console parameter."
 		);
 		exit(-1);
@@ -139,7 +81,7 @@ int main(int argc, char** argv) {
 	std::vector<crawler::url_message> seeds;
 
 	if (!crawler::load_seeds(seeds_file, seeds) || seeds.empty()) {
-		tools::log(
+		CRAWLER_LOG(
 			tools::debug_type::FATAL, "main", "Failed to load seeds."
 		);
 		exit(-2);
@@ -148,11 +90,25 @@ int main(int argc, char** argv) {
 	crawler::core my_crawler(
 		seeds.begin(), seeds.end()
 	);
+
+	if ("blocked" == filter) { my_crawler.use_filter(std::make_shared<crawler::blocked_bloom_filter>()); }
+	else if ("exact" == filter) { my_crawler.use_filter(std::make_shared<crawler::exact_filter>(0, crawler::core::state_dir)); }
+	else if ("scalable" != filter) {
+		CRAWLER_LOG(
+			tools::debug_type::FATAL, "main", "Unknown filter ", filter
+		);
+		exit(-1);
+	}
+
+	/* continues from the last checkpoint, or starts from the seeds if none */
+	if (resume) { my_crawler.resume(); }
+
 	my_crawler.run();
 
-	crawler::shuffle(my_crawler.output_path(), out_file);
+	/* the ids were given out while crawling, the graph is only copied (or encoded) */
+	my_crawler.export_graph(out_file, binary);
 
-	tools::log(
+	CRAWLER_LOG(
 		tools::debug_type::INFO, "main", "Completed, enter a key to quit..."
 	);
 
@@ -0,0 +1,3 @@
+#include <shuffle.h>
+#include <cstdlib>
+int main(int c,char**v){ size_t mem = c>3? std::strtoull(v[3],0,10):crawler::external_shuffle::default_memory; size_t th = c>4? std::strtoull(v[4],0,10):0; return crawler::external_shuffle(mem,th).run(v[1],v[2])?0:1; }
@@ -0,0 +1,10 @@
+#include <string>
+#include <fstream>
+#include <set>
+#include <unordered_map>
+#include <memory_resource>
+#include <cstdio>
+namespace crawler {
+#include "old_body.inc"
+}
+int main(int c,char**v){ return crawler::shuffle(v[1],v[2])?0:1; }
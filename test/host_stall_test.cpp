@@ -0,0 +1,73 @@
+/*
+ * Checks that a host which never answers can not keep the crawl alive.
+ * The seeds are three pages of a local server which accepts connections
+ * and never replies, one request in flight to a host: the first request
+ * hangs, the other two wait in the host scheduler behind it. The crawl
+ * has to end on the idle timeout (20 s) rather than after the requests
+ * have timed out one after another (30 s each).
+ *
+ *   g++ -std=c++17 -O2 -Iinclude test/host_stall_test.cpp -o host_stall_test -lboost_system -pthread
+ *   ./host_stall_test
+ *
+ * The crawl writes its files in a directory made under /tmp.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+
+#include <core.h>
+
+int main() {
+	static const std::chrono::seconds limit(45);
+
+	char dir[] = "/tmp/host_stall_XXXXXX";
+	if (nullptr == mkdtemp(dir) || 0 != chdir(dir)) {
+		std::cerr << "FAIL: no directory to crawl in" << std::endl;
+		return 1;
+	}
+
+	/* listens, never accepts: the connections complete and nothing is answered */
+	boost::asio::io_context context;
+	boost::asio::ip::tcp::acceptor acceptor(
+		context, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)
+	);
+	const std::string host = "127.0.0.1:" + std::to_string(acceptor.local_endpoint().port());
+
+	std::vector<crawler::url_message> seeds;
+	for (const char* path : { "/a", "/b", "/c" }) { seeds.emplace_back("http://" + host + path); }
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::thread watchdog([start]() {
+		while (std::chrono::steady_clock::now() - start < limit) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		std::cerr << "FAIL: the crawl is still running after " << limit.count() << " s" << std::endl;
+		std::_Exit(1);
+	});
+	watchdog.detach();
+
+	{
+		crawler::core crawl(seeds.begin(), seeds.end(), "graph");
+		crawl.politeness(1, std::chrono::milliseconds(0));
+		crawl.checkpoint_every(std::chrono::seconds(0));
+		crawl.serve_stats(0);
+		crawl.run();
+	}
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start
+	);
+	std::cout << "ended after " << elapsed.count() << " ms with " << host << " blocked" << std::endl;
+	std::cout << "OK" << std::endl;
+	return 0;
+}
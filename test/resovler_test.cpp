@@ -0,0 +1,137 @@
+/*
+ * Checks that link_resovler finds the links response_resovler (the regex
+ * extractor it replaced) finds, on a corpus of pages written with the
+ * forms of links the regex understands: root relative, protocol
+ * relative, absolute http(s), single or double quotes, and javascript:
+ * links which both skip. The regex results are canonicalized before the
+ * comparison, link_resovler gives canonical urls. The regex drops the
+ * trailing '/' of a protocol relative link ("//host/js/" is "host/js"),
+ * link_resovler keeps it, so trailing slashes are not compared.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude test/resovler_test.cpp -o resovler_test -lboost_regex -pthread
+ *   ./resovler_test [page base]...
+ *
+ * Pages given on the command line (a file and the url it was fetched
+ * from) are compared as well. Last, the seeds: url_canonicalizer takes
+ * http(s) urls and host:port ones, and refuses the other schemes.
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <resovler.h>
+
+namespace {
+
+	std::vector<std::string> links_of(tools::string_resovler& resovler, const std::string& page, const std::string& base) {
+		std::vector<std::string> result;
+		resovler.resovle(page, base, [&result](std::string_view, size_t, const std::string& link) {
+			if (!link.empty()) { result.push_back(link); }
+		});
+		return result;
+	}
+
+	void drop_trailing_slashes(std::vector<std::string>& links) {
+		for (auto& each : links) {
+			if (!each.empty() && '/' == each.back()) { each.pop_back(); }
+		}
+	}
+
+	std::string make_page(size_t seed) {
+		std::string page = "<html><head><title>page " + std::to_string(seed) + "</title></head><body>\n";
+
+		for (size_t i = 0; i < 200; ++i) {
+			const std::string n = std::to_string(seed * 1000 + i);
+			page += "<div class=\"row\"><p>some text to pad the page " + n + "</p>";
+
+			switch ((seed + i) % 7) {
+			case 0: page += "<a href=\"/css/css" + n + ".html\" title=\"t\">x</a>"; break;
+			case 1: page += "<a target=\"_blank\" href=\"//www.runoob.com/js/" + n + "/\">x</a>"; break;
+			case 2: page += "<a href=\"https://www.w3cschool.cn/p" + n + "\">x</a>"; break;
+			case 3: page += "<a href='/'>home</a>"; break;
+			case 4: page += "<a href=\"javascript:void(0)\">j</a><a class=\"c\" href=\"/a/b" + n + "\">r</a>"; break;
+			case 5: page += "<a href=\"http://Example.COM/q?x=" + n + "\">q</a>"; break;
+			case 6: page += "<img src=\"/img/" + n + ".png\"><a id=\"k\" href='/k/" + n + ".htm'>k</a>"; break;
+			}
+
+			page += "</div>\n";
+		}
+
+		return page + "</body></html>";
+	}
+
+	bool same_links(const std::string& page, const std::string& base, const std::string& name) {
+		crawler::response_resovler regex;
+		crawler::link_resovler     links;
+		crawler::url_canonicalizer canonicalizer;
+
+		auto expected = links_of(regex, page, base);
+		for (auto& each : expected) { each = canonicalizer.canonicalize(each); }
+
+		auto found = links_of(links, page, base);
+
+		drop_trailing_slashes(expected);
+		drop_trailing_slashes(found);
+
+		if (expected == found) { return true; }
+
+		std::cerr << name << ": " << expected.size() << " links by regex, " << found.size() << " by link_resovler" << std::endl;
+		for (size_t i = 0; i < std::max(expected.size(), found.size()); ++i) {
+			auto a = i < expected.size() ? expected[i] : std::string("-");
+			auto b = i < found.size() ? found[i] : std::string("-");
+			if (a != b) { std::cerr << "  first difference at " << i << ": " << a << " | " << b << std::endl; break; }
+		}
+		return false;
+	}
+
+	bool seeds_canonicalized() {
+		static const std::pair<const char*, const char*> cases[] = {
+			{ "http://Example.COM/a",   "example.com/a" },
+			{ "https://x.com:80/",      "x.com" },
+			{ "x.com/a#top",            "x.com/a" },
+			{ "localhost:8080/a",       "localhost:8080/a" },
+			{ "mailto:a@b.com",         nullptr },
+			{ "ftp://x.com/a",          nullptr },
+			{ "javascript:void(0)",     nullptr },
+			{ "http:x.com",             nullptr }
+		};
+
+		crawler::url_canonicalizer canonicalizer;
+		std::string out;
+		bool result = true;
+
+		for (const auto& each : cases) {
+			bool passed = canonicalizer.canonicalize(each.first, out);
+			if (passed != (nullptr != each.second) || (passed && out != each.second)) {
+				std::cerr << "seed " << each.first << ": " << (passed ? out : std::string("refused")) << std::endl;
+				result = false;
+			}
+		}
+		return result;
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t failed = 0, pages = 0;
+
+	for (size_t seed = 0; seed < 16; ++seed, ++pages) {
+		if (!same_links(make_page(seed), "www.runoob.com/html/html-tutorial.html", "page " + std::to_string(seed))) { ++failed; }
+	}
+
+	for (int i = 1; i + 1 < argc; i += 2, ++pages) {
+		std::ifstream in(argv[i], std::ios::binary);
+		std::stringstream page;
+		page << in.rdbuf();
+		if (!same_links(page.str(), argv[i + 1], argv[i])) { ++failed; }
+	}
+
+	std::cout << pages - failed << "/" << pages << " pages with the same links" << std::endl;
+
+	bool seeds = seeds_canonicalized();
+	std::cout << "seeds " << (seeds ? "ok" : "wrong") << std::endl;
+
+	return 0 == failed && seeds ? 0 : 1;
+}
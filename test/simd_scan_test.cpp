@@ -0,0 +1,91 @@
+/*
+ * Checks that scan_tags_sse2 and scan_tags_avx2 report the candidates of
+ * scan_tags_scalar, on random text drawn from the bytes the scan looks
+ * at, at every alignment and length around the vector widths, with every
+ * max from 1 up. The avx2 path is only run on a cpu which has it.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude test/simd_scan_test.cpp -o simd_scan_test
+ *   ./simd_scan_test
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <simd_scan.h>
+
+namespace {
+
+	typedef tools::simd::scan_tags_fn scan_fn;
+
+	bool same(scan_fn fn, const char* first, const char* last, size_t max, const char* name) {
+		std::vector<const char*> expected(max), found(max);
+
+		size_t a = tools::simd::scan_tags_scalar(first, last, expected.data(), max);
+		size_t b = fn(first, last, found.data(), max);
+
+		if (a == b && std::equal(expected.begin(), expected.begin() + a, found.begin())) { return true; }
+
+		std::cerr << name << ": " << b << " candidates, " << a << " expected, text of "
+		          << (last - first) << " bytes, max " << max << std::endl;
+		return false;
+	}
+}
+
+int main() {
+	using namespace tools::simd;
+
+	std::vector<std::pair<scan_fn, const char*>> paths;
+#ifdef _CRAWLER_SIMD_X86_
+	if (detect_cpu().sse2) { paths.emplace_back(&scan_tags_sse2, "sse2"); }
+	if (detect_cpu().avx2) { paths.emplace_back(&scan_tags_avx2, "avx2"); }
+#endif
+	if (paths.empty()) {
+		std::cout << "no vector path on this cpu, nothing to compare" << std::endl;
+		return 0;
+	}
+
+	/* '<' followed by any of the others, 'A' and '!' included */
+	static const char alphabet[] = "<<aA!b >\"'=\0";
+
+	std::mt19937 rng(20180707);
+	std::string  buffer(512 + 64, ' ');
+	size_t       failed = 0, runs = 0;
+
+	for (size_t round = 0; round < 20000 && 0 == failed; ++round) {
+		const size_t offset = rng() % 64;
+		const size_t length = round < 512 ? round % 129 : rng() % 512;
+		const size_t max    = 1 + rng() % (length + 2);
+
+		for (size_t i = 0; i < length; ++i) { buffer[offset + i] = alphabet[rng() % (sizeof (alphabet) - 1)]; }
+
+		const char* first = buffer.data() + offset;
+
+		for (const auto& each : paths) {
+			runs += 2;
+			if (!same(each.first, first, first + length, max, each.second)) { ++failed; }
+			/* as many as there are, no max reached */
+			if (!same(each.first, first, first + length, length + 1, each.second)) { ++failed; }
+		}
+	}
+
+	/* a '<' ending the text is no candidate, its next byte is past the end */
+	std::string tail;
+	for (size_t length = 1; length < 100; ++length) {
+		tail.assign(length, 'x');
+		tail.back() = '<';
+		tail += 'a';
+
+		for (const auto& each : paths) {
+			++runs;
+			if (!same(each.first, tail.data(), tail.data() + length, 4, each.second)) { ++failed; }
+		}
+	}
+
+	std::cout << runs - failed << "/" << runs << " scans equal to scalar (";
+	for (size_t i = 0; i < paths.size(); ++i) { std::cout << (0 == i ? "" : ", ") << paths[i].second; }
+	std::cout << ")" << std::endl;
+
+	return 0 == failed ? 0 : 1;
+}